@@ -0,0 +1,210 @@
+/*
+ * Copyright (c) 2014 Codethink Ltd. (http://www.codethink.co.uk)
+ *
+ * This file is part of ebb
+ *
+ * ebb is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * ebb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Synthetic screencast corpus
+ *
+ * Encodes a set of made up screencasts, of the kinds of activity ebb sees,
+ * at each of the usual resolutions:
+ *
+ * - terminal: a page of text that only changes by the cursor blinking
+ * - typing: bursts of typing on the last line, with pauses between
+ * - scrolling: output scrolling past a line at a time
+ * - fullscreen: the whole screen changing to a new page every second
+ *
+ * The default is lossless H.264, so unchanged frames decode identically,
+ * as they do from a screen recorder.
+ *
+ * Usage: corpus <out_dir> [<codec> [<crf>]]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/avutil.h>
+#include <libavutil/pixfmt.h>
+
+#include "../src/encode.h"
+#include "../src/log.h"
+#include "synth.h"
+
+enum log_level level = LOG_INFO;
+
+/** Frame rate of the clips */
+#define CLIP_FPS 25
+
+/** Length of each clip, in frames */
+#define CLIP_FRAMES (10 * CLIP_FPS)
+
+/** Work out what a clip shows at a frame */
+typedef void (*scene_fn)(int f, struct synth_screen *screen);
+
+/** A kind of clip */
+struct scene {
+	const char *name;
+	scene_fn screen;
+};
+
+/** A resolution to make clips at */
+struct resolution {
+	const char *name;
+	int w, h;
+};
+
+static const struct resolution resolutions[] = {
+	{ "720p", 1280, 720 },
+	{ "1080p", 1920, 1080 },
+	{ "4K", 3840, 2160 },
+	{ NULL, 0, 0 }
+};
+
+
+/** A still terminal, with the cursor blinking twice a second */
+static void scene_terminal(int f, struct synth_screen *screen)
+{
+	screen->page = 1;
+	screen->top = 0;
+	screen->typed = 12;
+	screen->cursor = (f / (CLIP_FPS / 4)) % 2 == 0;
+}
+
+
+/** Two seconds typing, at a character every two frames, then a pause */
+static void scene_typing(int f, struct synth_screen *screen)
+{
+	int burst = f / (4 * CLIP_FPS);
+	int t = f % (4 * CLIP_FPS);
+
+	screen->page = 2;
+	screen->top = 0;
+	screen->typed = (burst * CLIP_FPS + (t < 2 * CLIP_FPS ?
+			t : 2 * CLIP_FPS) / 2) % SYNTH_COLS;
+	screen->cursor = true;
+}
+
+
+/** A line of output every three frames */
+static void scene_scrolling(int f, struct synth_screen *screen)
+{
+	screen->page = 3;
+	screen->top = f / 3;
+	screen->typed = -1;
+	screen->cursor = false;
+}
+
+
+/** A new page every second */
+static void scene_fullscreen(int f, struct synth_screen *screen)
+{
+	screen->page = 4 + f / CLIP_FPS;
+	screen->top = 0;
+	screen->typed = -1;
+	screen->cursor = false;
+}
+
+static const struct scene scenes[] = {
+	{ "terminal", scene_terminal },
+	{ "typing", scene_typing },
+	{ "scrolling", scene_scrolling },
+	{ "fullscreen", scene_fullscreen },
+	{ NULL, NULL }
+};
+
+
+/** Encode one clip */
+static bool write_clip(const char *file_name, const struct scene *scene,
+		int w, int h, const char *codec, const char *crf)
+{
+	AVRational fps = { CLIP_FPS, 1 };
+	struct encoder *enc;
+	AVFrame *frame;
+	bool ok = true;
+	int f;
+
+	frame = avcodec_alloc_frame();
+	if (frame == NULL || avpicture_alloc((AVPicture *)frame,
+			PIX_FMT_RGB24, w, h) < 0) {
+		LOG(LOG_ERROR, "Could not allocate frame\n");
+		av_free(frame);
+		return false;
+	}
+
+	enc = encoder_open(file_name, NULL, codec, crf, w, h, fps);
+	if (enc == NULL) {
+		ok = false;
+		goto free;
+	}
+
+	for (f = 0; f < CLIP_FRAMES && ok; f++) {
+		struct synth_screen screen;
+
+		scene->screen(f, &screen);
+		synth_draw(frame, w, h, &screen);
+		ok = encoder_write(enc, frame, f);
+	}
+
+	if (!encoder_close(enc))
+		ok = false;
+
+free:
+	avpicture_free((AVPicture *)frame);
+	av_free(frame);
+
+	return ok;
+}
+
+
+int main(int argc, char *argv[])
+{
+	const struct resolution *res;
+	const struct scene *scene;
+	const char *codec = "libx264";
+	const char *crf = "0";
+
+	if (argc < 2 || argc > 4) {
+		LOG(LOG_ERROR, "Usage: %s <out_dir> [<codec> [<crf>]]\n",
+				argv[0]);
+		return EXIT_FAILURE;
+	}
+	if (argc > 2) {
+		codec = argv[2];
+		crf = NULL;
+	}
+	if (argc > 3)
+		crf = argv[3];
+
+	av_register_all();
+
+	for (res = resolutions; res->name != NULL; res++) {
+		for (scene = scenes; scene->name != NULL; scene++) {
+			char file_name[strlen(argv[1]) + 64];
+
+			sprintf(file_name, "%s/%s-%s.mkv", argv[1],
+					scene->name, res->name);
+			LOG(LOG_INFO, "Writing %s\n", file_name);
+			if (!write_clip(file_name, scene, res->w, res->h,
+					codec, crf))
+				return EXIT_FAILURE;
+		}
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,354 @@
+/*
+ * Copyright (c) 2014 Codethink Ltd. (http://www.codethink.co.uk)
+ *
+ * This file is part of ebb
+ *
+ * ebb is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * ebb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Kernel microbenchmarks
+ *
+ * Times the per frame work of comparing and writing at common screencast
+ * resolutions: the difference kernels that frames_differ() runs over each
+ * dirty tile, with each neighbourhood test, tile hashing, the conversion
+ * to RGB24 and image_write_png() with each profile.
+ *
+ * The frames compared differ everywhere by less than the tolerance, so
+ * nothing is found and the whole frame is scanned, which is the most work
+ * a comparison can be.
+ *
+ * Usage: kernels <out_dir>
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libavcodec/avcodec.h>
+#include <libavutil/avutil.h>
+#include <libavutil/pixfmt.h>
+#include <libswscale/swscale.h>
+
+#include "../src/diff.h"
+#include "../src/hash.h"
+#include "../src/log.h"
+#include "../src/png_out.h"
+#include "../src/stats.h"
+#include "synth.h"
+
+enum log_level level = LOG_RESULT;
+
+/** Minimum time to run each benchmark for (ns) */
+#define BENCH_TIME 500000000
+
+/** Difference below which pixels are the same, as ebb's default */
+#define TOLERANCE (255 * 3 / 10)
+
+/** A resolution to benchmark at */
+struct resolution {
+	const char *name;
+	int w, h;
+};
+
+static const struct resolution resolutions[] = {
+	{ "720p", 1280, 720 },
+	{ "1080p", 1920, 1080 },
+	{ "4K", 3840, 2160 },
+	{ NULL, 0, 0 }
+};
+
+/** A neighbourhood configuration to benchmark */
+struct neighbourhood {
+	const char *name;
+	int size, votes;
+};
+
+static const struct neighbourhood neighbourhoods[] = {
+	{ "2x2 all", 2, 4 },
+	{ "2x2 3/4", 2, 3 },
+	{ "3x3 any", 3, 1 },
+	{ "4x4 8/16", 4, 8 },
+	{ NULL, 0, 0 }
+};
+
+/** Everything a benchmark needs */
+struct bench {
+	int w, h;
+	AVFrame *prev;			/**< RGB24 frame */
+	AVFrame *curr;			/**< RGB24 frame, a little different */
+	AVFrame *yuv;			/**< YUV420P copy of curr */
+	AVFrame *rgb;			/**< Conversion output */
+	struct SwsContext *sws;
+	uint8_t *mask[DIFF_MAX_SIZE];
+	diff_window_fn window;
+	int size, votes;
+	const struct png_profile *png;
+	char *file_name;
+	uint64_t hash;			/**< Result, so it's not optimised out */
+};
+
+typedef void (*bench_fn)(struct bench *b);
+
+
+/** Allocate a frame with its own buffer */
+static AVFrame *frame_alloc(enum PixelFormat pix_fmt, int w, int h)
+{
+	AVFrame *frame = avcodec_alloc_frame();
+
+	if (frame == NULL)
+		return NULL;
+
+	if (avpicture_alloc((AVPicture *)frame, pix_fmt, w, h) < 0) {
+		av_free(frame);
+		return NULL;
+	}
+
+	return frame;
+}
+
+
+/** Free a frame from frame_alloc() */
+static void frame_free(AVFrame *frame)
+{
+	if (frame == NULL)
+		return;
+
+	avpicture_free((AVPicture *)frame);
+	av_free(frame);
+}
+
+
+/** Scan a frame with the RGB24 mask kernel and a neighbourhood test */
+static void bench_differ_rgb(struct bench *b)
+{
+	uint8_t *window[DIFF_MAX_SIZE];
+	int n = b->w - b->size + 1;
+	int y, r;
+
+	for (y = 0; y < b->h; y++) {
+		diff.mask_rgb24(b->prev->data[0] + y * b->prev->linesize[0],
+				b->curr->data[0] + y * b->curr->linesize[0],
+				b->mask[y % b->size], b->w, TOLERANCE);
+		if (y < b->size - 1)
+			continue;
+
+		for (r = 0; r < b->size; r++)
+			window[r] = b->mask[(y + 1 + r) % b->size];
+		b->hash += b->window(window, n, 3, b->size, b->votes);
+	}
+}
+
+
+/** Scan a frame's luma with the 8-bit mask kernel, as --compare luma */
+static void bench_differ_luma(struct bench *b)
+{
+	uint8_t *window[DIFF_MAX_SIZE];
+	int n = b->w - b->size + 1;
+	int y, r;
+
+	for (y = 0; y < b->h; y++) {
+		/* The first plane of the RGB frames stands in for luma, at
+		 * the same width */
+		diff.mask_8(b->prev->data[0] + y * b->prev->linesize[0],
+				b->curr->data[0] + y * b->curr->linesize[0],
+				b->mask[y % b->size], b->w, TOLERANCE / 3);
+		if (y < b->size - 1)
+			continue;
+
+		for (r = 0; r < b->size; r++)
+			window[r] = b->mask[(y + 1 + r) % b->size];
+		b->hash += b->window(window, n, 1, b->size, b->votes);
+	}
+}
+
+
+/** Hash every row of a frame, as tile hashing does */
+static void bench_hash(struct bench *b)
+{
+	int y;
+
+	for (y = 0; y < b->h; y++)
+		b->hash = hash64(b->curr->data[0] + y * b->curr->linesize[0],
+				b->w * 3, b->hash);
+}
+
+
+/** Convert a YUV420P frame to RGB24, as frame_to_rgb() does */
+static void bench_to_rgb(struct bench *b)
+{
+	b->sws = sws_getCachedContext(b->sws,
+			b->w, b->h, PIX_FMT_YUV420P, b->w, b->h, PIX_FMT_RGB24,
+			SWS_BICUBIC, NULL, NULL, NULL);
+	sws_scale(b->sws, (const uint8_t * const*)b->yuv->data,
+			b->yuv->linesize, 0, b->h,
+			b->rgb->data, b->rgb->linesize);
+}
+
+
+/** Write a frame as a PNG */
+static void bench_png(struct bench *b)
+{
+	if (!image_write_png(b->file_name, b->curr, b->w, b->h, b->png)) {
+		LOG(LOG_ERROR, "Could not write %s\n", b->file_name);
+		exit(EXIT_FAILURE);
+	}
+}
+
+
+/** Run a benchmark until enough time has passed, and report it */
+static void bench_run(struct bench *b, const char *name, const char *res,
+		bench_fn fn)
+{
+	uint64_t start = stats_now();
+	uint64_t elapsed;
+	int i = 0;
+
+	do {
+		fn(b);
+		i++;
+		elapsed = stats_now() - start;
+	} while (elapsed < BENCH_TIME || i < 3);
+
+	LOG(LOG_RESULT, "%-28s %-6s %10.3f %10.1f\n", name, res,
+			elapsed / 1e6 / i, i / (elapsed / 1e9));
+}
+
+
+/** Set up the frames for a resolution */
+static bool bench_init(struct bench *b, int w, int h, const char *dir)
+{
+	struct synth_screen screen = { 1, 0, -1, true };
+	struct SwsContext *sws;
+	int i, y, x;
+
+	memset(b, 0, sizeof(*b));
+	b->w = w;
+	b->h = h;
+	b->prev = frame_alloc(PIX_FMT_RGB24, w, h);
+	b->curr = frame_alloc(PIX_FMT_RGB24, w, h);
+	b->yuv = frame_alloc(PIX_FMT_YUV420P, w, h);
+	b->rgb = frame_alloc(PIX_FMT_RGB24, w, h);
+	b->file_name = malloc(strlen(dir) + sizeof("/bench.png"));
+	if (b->prev == NULL || b->curr == NULL || b->yuv == NULL ||
+			b->rgb == NULL || b->file_name == NULL)
+		return false;
+	sprintf(b->file_name, "%s/bench.png", dir);
+
+	for (i = 0; i < DIFF_MAX_SIZE; i++) {
+		b->mask[i] = malloc(3 * w + DIFF_MASK_PAD);
+		if (b->mask[i] == NULL)
+			return false;
+	}
+
+	/* The current frame has noise the tolerance hides */
+	synth_draw(b->prev, w, h, &screen);
+	for (y = 0; y < h; y++) {
+		const uint8_t *p = b->prev->data[0] + y * b->prev->linesize[0];
+		uint8_t *c = b->curr->data[0] + y * b->curr->linesize[0];
+
+		for (x = 0; x < w * 3; x++)
+			c[x] = p[x] < 0xf0 ? p[x] + (x + y) % 16 : p[x];
+	}
+
+	sws = sws_getCachedContext(NULL, w, h, PIX_FMT_RGB24,
+			w, h, PIX_FMT_YUV420P, SWS_BICUBIC, NULL, NULL, NULL);
+	if (sws == NULL)
+		return false;
+	sws_scale(sws, (const uint8_t * const*)b->curr->data,
+			b->curr->linesize, 0, h, b->yuv->data, b->yuv->linesize);
+	sws_freeContext(sws);
+
+	return true;
+}
+
+
+/** Free a resolution's frames */
+static void bench_fini(struct bench *b)
+{
+	int i;
+
+	for (i = 0; i < DIFF_MAX_SIZE; i++)
+		free(b->mask[i]);
+	if (b->file_name != NULL)
+		remove(b->file_name);
+	free(b->file_name);
+	frame_free(b->prev);
+	frame_free(b->curr);
+	frame_free(b->yuv);
+	frame_free(b->rgb);
+	sws_freeContext(b->sws);
+}
+
+
+int main(int argc, char *argv[])
+{
+	const struct resolution *res;
+	struct bench b;
+	char name[64];
+	int simd;
+
+	if (argc != 2) {
+		LOG(LOG_ERROR, "Usage: %s <out_dir>\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	LOG(LOG_RESULT, "%-28s %-6s %10s %10s\n",
+			"Benchmark", "Size", "ms/frame", "frames/s");
+
+	for (res = resolutions; res->name != NULL; res++) {
+		const struct neighbourhood *nb;
+		const struct png_profile *p;
+
+		if (!bench_init(&b, res->w, res->h, argv[1])) {
+			LOG(LOG_ERROR, "Could not allocate frames\n");
+			return EXIT_FAILURE;
+		}
+
+		for (simd = 0; simd <= 1; simd++) {
+			/* Without vector kernels, there's nothing more */
+			diff_init(simd);
+			if (simd && strcmp(diff.name, "scalar") == 0)
+				break;
+
+			for (nb = neighbourhoods; nb->name != NULL; nb++) {
+				b.size = nb->size;
+				b.votes = nb->votes;
+				b.window = diff_window(nb->size, nb->votes);
+
+				snprintf(name, sizeof(name), "differ rgb %s %s",
+						nb->name, diff.name);
+				bench_run(&b, name, res->name,
+						bench_differ_rgb);
+				snprintf(name, sizeof(name), "differ luma %s %s",
+						nb->name, diff.name);
+				bench_run(&b, name, res->name,
+						bench_differ_luma);
+			}
+		}
+
+		bench_run(&b, "tile hash", res->name, bench_hash);
+		bench_run(&b, "yuv420p to rgb24", res->name, bench_to_rgb);
+		for (p = png_profiles; p->name != NULL; p++) {
+			b.png = p;
+			snprintf(name, sizeof(name), "png %s", p->name);
+			bench_run(&b, name, res->name, bench_png);
+		}
+
+		LOG(LOG_DEBUG, "Result %" PRIx64 "\n", b.hash);
+		bench_fini(&b);
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,33 @@
+#!/bin/sh
+#
+# End-to-end benchmark of ebb over the synthetic corpus
+#
+# Runs ebb on every clip in the corpus directory, writing PNGs, and
+# reports frames decoded per second, frames kept and bytes written, from
+# ebb's --stats report.  Extra arguments are passed to ebb, so runs with
+# e.g. --no-simd or --threads 1 can be compared.
+#
+# Usage: bench/run.sh <ebb> <corpus_dir> <out_dir> [<ebb args>...]
+#
+
+set -e
+
+ebb=$1
+corpus=$2
+out=$3
+shift 3
+
+printf "%-22s %10s %8s %12s\n" "Clip" "frames/s" "Kept" "Bytes"
+for clip in "$corpus"/*.mkv; do
+	name=$(basename "$clip" .mkv)
+
+	rm -rf "$out/$name"
+	mkdir -p "$out/$name"
+	"$ebb" --stats "$@" "$clip" "$out/$name/frame.png" |
+		sed -n "s/.*decoded (\([0-9.]*\) frames\/s), \([0-9]*\) kept, \([0-9]*\) bytes written/\1 \2 \3/p" |
+		while read fps kept bytes; do
+			printf "%-22s %10s %8s %12s\n" \
+					"$name" "$fps" "$kept" "$bytes"
+		done
+	rm -rf "$out/$name"
+done
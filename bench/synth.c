@@ -0,0 +1,111 @@
+/*
+ * Copyright (c) 2014 Codethink Ltd. (http://www.codethink.co.uk)
+ *
+ * This file is part of ebb
+ *
+ * ebb is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * ebb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include "../src/hash.h"
+#include "synth.h"
+
+
+/** Number of characters on a line of the made up text */
+static int line_length(uint64_t page, int line)
+{
+	uint64_t key[2] = { page, line };
+	uint64_t r = hash64(key, sizeof(key), 0);
+
+	/* Some blank lines, mostly short ones, and a few long ones */
+	if (r % 8 == 0)
+		return 0;
+	if (r % 8 < 6)
+		return 8 + (r >> 8) % 64;
+	return (r >> 8) % SYNTH_COLS;
+}
+
+
+/** Dot pattern of a character, as 5 by 7 bits */
+static uint64_t glyph(uint64_t page, int line, int col)
+{
+	uint64_t key[3] = { page, line, col };
+	uint64_t c = hash64(key, sizeof(key), 1) % 64;
+
+	/* A couple of characters in every 64 are spaces */
+	if (c < 2)
+		return 0;
+	return hash64(&c, sizeof(c), 2) & ((1ull << 35) - 1);
+}
+
+
+/** Draw a character cell's dots, with its top left at row */
+static void draw_cell(uint8_t *row, int linesize, int cw, int ch,
+		uint64_t dots, bool cursor)
+{
+	static const uint8_t fg[3] = { 0xcc, 0xcc, 0xcc };
+	const int dw = cw / 6 > 0 ? cw / 6 : 1;
+	const int dh = ch / 12 > 0 ? ch / 12 : 1;
+	int y, x;
+
+	for (y = 0; y < ch; y++) {
+		uint8_t *p = row + y * linesize;
+		int gy = y / dh - 2;
+
+		for (x = 0; x < cw; x++) {
+			int gx = x / dw;
+			bool on = cursor;
+
+			if (!on && gy >= 0 && gy < 7 && gx < 5)
+				on = (dots >> (gy * 5 + gx)) & 1;
+			if (on)
+				memcpy(p + x * 3, fg, 3);
+		}
+	}
+}
+
+
+/* Exported function, documented in synth.h */
+void synth_draw(AVFrame *frame, int w, int h,
+		const struct synth_screen *screen)
+{
+	const int cw = w / SYNTH_COLS;
+	const int ch = h / SYNTH_ROWS;
+	int y, r, c;
+
+	/* Background */
+	for (y = 0; y < h; y++) {
+		uint8_t *p = frame->data[0] + y * frame->linesize[0];
+
+		memset(p, 0x1e, w * 3);
+	}
+
+	for (r = 0; r < SYNTH_ROWS; r++) {
+		int line = screen->top + r;
+		int len = line_length(screen->page, line);
+		uint8_t *row = frame->data[0] + r * ch * frame->linesize[0];
+
+		if (r == SYNTH_ROWS - 1 && screen->typed >= 0)
+			len = screen->typed < SYNTH_COLS ?
+					screen->typed : SYNTH_COLS - 1;
+
+		for (c = 0; c < len; c++)
+			draw_cell(row + c * cw * 3, frame->linesize[0], cw, ch,
+					glyph(screen->page, line, c), false);
+
+		if (r == SYNTH_ROWS - 1 && screen->cursor)
+			draw_cell(row + len * cw * 3, frame->linesize[0],
+					cw, ch, 0, true);
+	}
+}
@@ -0,0 +1,62 @@
+/*
+ * Copyright (c) 2014 Codethink Ltd. (http://www.codethink.co.uk)
+ *
+ * This file is part of ebb
+ *
+ * ebb is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * ebb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Synthetic screencast frames
+ *
+ * Draws terminal-like pictures for the benchmarks: light text on a dark
+ * background, in a grid of character cells that scales with the frame
+ * height, so every resolution shows the same 160 by 45 characters.  The
+ * text is made up, but the same for the same arguments, so runs can be
+ * compared.
+ */
+
+#ifndef EBB_BENCH_SYNTH_H
+#define EBB_BENCH_SYNTH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <libavcodec/avcodec.h>
+
+/** Columns of characters */
+#define SYNTH_COLS 160
+
+/** Rows of characters */
+#define SYNTH_ROWS 45
+
+/** What a synthetic terminal shows */
+struct synth_screen {
+	uint64_t page;		/**< Which made up text to show */
+	int top;		/**< Line of the text at the top row */
+	int typed;		/**< Characters shown on the last row, or -1 */
+	bool cursor;		/**< Whether the cursor is drawn */
+};
+
+/**
+ * Draw a synthetic terminal into an RGB24 frame
+ *
+ * \param frame   Frame to draw into, allocated for w by h RGB24
+ * \param w       Frame width
+ * \param h       Frame height
+ * \param screen  What to show
+ */
+void synth_draw(AVFrame *frame, int w, int h,
+		const struct synth_screen *screen);
+
+#endif
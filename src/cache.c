@@ -0,0 +1,263 @@
+/*
+ * Copyright (c) 2014 Codethink Ltd. (http://www.codethink.co.uk)
+ *
+ * This file is part of ebb
+ *
+ * ebb is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * ebb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "cache.h"
+#include "hash.h"
+
+/** Identifies a cache file, and its layout version */
+#define CACHE_MAGIC "EBBCACH1"
+
+/** Bytes read from each end of an input file to identify it */
+#define CACHE_SAMPLE (1024 * 1024)
+
+/** Start of a cache file, followed by the timestamps and then the flags */
+struct cache_header {
+	char magic[8];		/**< CACHE_MAGIC */
+	uint64_t key;		/**< Key cache was saved with */
+	uint64_t count;		/**< Number of frames */
+};
+
+
+/** Hash some bytes from a file, at an offset */
+static bool hash_file_range(FILE *fp, long offset, size_t len,
+		uint8_t *buf, uint64_t *h)
+{
+	size_t got;
+
+	if (fseek(fp, offset, SEEK_SET) != 0)
+		return false;
+
+	got = fread(buf, 1, len, fp);
+	if (got != len)
+		return false;
+
+	*h = hash64(buf, got, *h);
+	return true;
+}
+
+
+/* Exported function, documented in cache.h */
+bool cache_key(const char *input_path, const char *settings, uint64_t *key)
+{
+	uint8_t *buf = NULL;
+	struct stat s;
+	uint64_t h = 0;
+	int64_t ident[2];
+	size_t len;
+	bool res = false;
+	FILE *fp;
+
+	fp = fopen(input_path, "rb");
+	if (fp == NULL || fstat(fileno(fp), &s) != 0)
+		goto free;
+
+	ident[0] = s.st_size;
+	ident[1] = s.st_mtime;
+	h = hash64(ident, sizeof(ident), h);
+	h = hash64(settings, strlen(settings), h);
+
+	len = s.st_size < CACHE_SAMPLE ? s.st_size : CACHE_SAMPLE;
+	buf = malloc(CACHE_SAMPLE);
+	if (buf == NULL)
+		goto free;
+	if (!hash_file_range(fp, 0, len, buf, &h) ||
+			!hash_file_range(fp, s.st_size - len, len, buf, &h))
+		goto free;
+
+	*key = h;
+	res = true;
+
+free:
+	free(buf);
+	if (fp != NULL)
+		fclose(fp);
+
+	return res;
+}
+
+
+/* Exported function, documented in cache.h */
+void cache_init(struct cache *c)
+{
+	c->pts = NULL;
+	c->different = NULL;
+	c->count = 0;
+	c->size = 0;
+}
+
+
+/* Exported function, documented in cache.h */
+void cache_fini(struct cache *c)
+{
+	free(c->pts);
+	free(c->different);
+	cache_init(c);
+}
+
+
+/** Make space for at least a number of frames in a cache */
+static bool cache_reserve(struct cache *c, int size)
+{
+	int64_t *pts;
+	uint8_t *different;
+
+	if (size <= c->size)
+		return true;
+
+	pts = realloc(c->pts, size * sizeof(*pts));
+	if (pts == NULL)
+		return false;
+	c->pts = pts;
+
+	different = realloc(c->different, size * sizeof(*different));
+	if (different == NULL)
+		return false;
+	c->different = different;
+
+	c->size = size;
+	return true;
+}
+
+
+/* Exported function, documented in cache.h */
+bool cache_add(struct cache *c, bool different, int64_t pts)
+{
+	if (c->count == c->size &&
+			!cache_reserve(c, c->size ? c->size * 2 : 1024))
+		return false;
+
+	c->pts[c->count] = pts;
+	c->different[c->count] = different;
+	c->count++;
+
+	return true;
+}
+
+
+/** A frame's result, for sorting */
+struct cache_entry {
+	int64_t pts;
+	uint8_t different;
+};
+
+
+/** Compare two cache entries by timestamp, for qsort */
+static int cache_entry_cmp(const void *a, const void *b)
+{
+	const struct cache_entry *ea = a;
+	const struct cache_entry *eb = b;
+
+	return (ea->pts > eb->pts) - (ea->pts < eb->pts);
+}
+
+
+/* Exported function, documented in cache.h */
+bool cache_sort(struct cache *c)
+{
+	struct cache_entry *e;
+	int i;
+
+	for (i = 0; i < c->count; i++) {
+		if (c->pts[i] == INT64_MIN)
+			return true;
+	}
+
+	e = malloc(c->count * sizeof(*e) + 1);
+	if (e == NULL)
+		return false;
+
+	for (i = 0; i < c->count; i++) {
+		e[i].pts = c->pts[i];
+		e[i].different = c->different[i];
+	}
+	qsort(e, c->count, sizeof(*e), cache_entry_cmp);
+	for (i = 0; i < c->count; i++) {
+		c->pts[i] = e[i].pts;
+		c->different[i] = e[i].different;
+	}
+	free(e);
+
+	return true;
+}
+
+
+/* Exported function, documented in cache.h */
+bool cache_load(struct cache *c, const char *file_name, uint64_t key)
+{
+	struct cache_header hdr;
+	bool res = false;
+	FILE *fp;
+
+	fp = fopen(file_name, "rb");
+	if (fp == NULL)
+		return false;
+
+	if (fread(&hdr, sizeof(hdr), 1, fp) != 1 ||
+			memcmp(hdr.magic, CACHE_MAGIC, sizeof(hdr.magic)) != 0 ||
+			hdr.key != key || hdr.count > INT32_MAX)
+		goto free;
+
+	if (!cache_reserve(c, hdr.count))
+		goto free;
+	if (fread(c->pts, sizeof(*c->pts), hdr.count, fp) != hdr.count ||
+			fread(c->different, sizeof(*c->different),
+					hdr.count, fp) != hdr.count)
+		goto free;
+	c->count = hdr.count;
+
+	/* It all worked! */
+	res = true;
+
+free:
+	fclose(fp);
+
+	return res;
+}
+
+
+/* Exported function, documented in cache.h */
+bool cache_save(const struct cache *c, const char *file_name, uint64_t key)
+{
+	struct cache_header hdr;
+	bool res;
+	FILE *fp;
+
+	fp = fopen(file_name, "wb");
+	if (fp == NULL)
+		return false;
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, CACHE_MAGIC, sizeof(hdr.magic));
+	hdr.key = key;
+	hdr.count = c->count;
+
+	res = fwrite(&hdr, sizeof(hdr), 1, fp) == 1 &&
+			fwrite(c->pts, sizeof(*c->pts), c->count, fp) ==
+					(size_t)c->count &&
+			fwrite(c->different, sizeof(*c->different),
+					c->count, fp) == (size_t)c->count;
+	if (fclose(fp) != 0)
+		res = false;
+
+	return res;
+}
@@ -0,0 +1,99 @@
+/*
+ * Copyright (c) 2014 Codethink Ltd. (http://www.codethink.co.uk)
+ *
+ * This file is part of ebb
+ *
+ * ebb is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * ebb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Difference cache
+ *
+ * Saves whether each frame differed from the last different one, so later
+ * runs on the same input with the same comparison settings can make their
+ * decisions without decoding anything.  The cache is only valid for the
+ * key it was saved with, which identifies the input file and settings.
+ */
+
+#ifndef EBB_CACHE_H
+#define EBB_CACHE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/** Per frame comparison results */
+struct cache {
+	int64_t *pts;		/**< Timestamp of each frame */
+	uint8_t *different;	/**< Whether each frame differed */
+	int count;		/**< Number of frames */
+	int size;		/**< Space for frames */
+};
+
+/**
+ * Make a cache key for an input file and comparison settings
+ *
+ * The file is identified from its size, modification time and the data at
+ * its start and end, so making a key doesn't mean reading all of it.
+ *
+ * \param input_path  Path to input file
+ * \param settings    Description of settings that affect comparison
+ * \param key         Updated to the key
+ * \return true on success, or false if the file can't be read
+ */
+bool cache_key(const char *input_path, const char *settings, uint64_t *key);
+
+/** Initialise an empty cache */
+void cache_init(struct cache *c);
+
+/** Free a cache's resources */
+void cache_fini(struct cache *c);
+
+/**
+ * Add the next frame's result to a cache
+ *
+ * \return true on success, or false on memory exhaustion
+ */
+bool cache_add(struct cache *c, bool different, int64_t pts);
+
+/**
+ * Put a cache's frames in timestamp order
+ *
+ * For results noted in decode order, which differs from presentation order
+ * when there are B-frames.  If any frame has no timestamp (INT64_MIN), the
+ * order can't be known, so is left alone.
+ *
+ * \return true on success, or false on memory exhaustion
+ */
+bool cache_sort(struct cache *c);
+
+/**
+ * Load a cache from a file
+ *
+ * \param c          Empty cache to fill
+ * \param file_name  File to load from
+ * \param key        Key the cache must have been saved with
+ * \return true on success, or false if there's no valid cache for the key
+ */
+bool cache_load(struct cache *c, const char *file_name, uint64_t key);
+
+/**
+ * Save a cache to a file
+ *
+ * \param c          Cache to save
+ * \param file_name  File to save to
+ * \param key        Key to save the cache with
+ * \return true on success, else false
+ */
+bool cache_save(const struct cache *c, const char *file_name, uint64_t key);
+
+#endif
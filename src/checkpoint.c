@@ -0,0 +1,108 @@
+/*
+ * Copyright (c) 2014 Codethink Ltd. (http://www.codethink.co.uk)
+ *
+ * This file is part of ebb
+ *
+ * ebb is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * ebb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "checkpoint.h"
+
+/** Identifies a checkpoint file, and its layout version */
+#define CHECKPOINT_MAGIC "EBBCKPT1"
+
+/** Layout of a checkpoint file */
+struct checkpoint_file {
+	char magic[8];		/**< CHECKPOINT_MAGIC */
+	uint64_t key;		/**< Key checkpoint was saved with */
+	int64_t pts;		/**< Timestamp of frame to carry on from */
+	int32_t frames;		/**< Its frame number */
+	int32_t out_frames;	/**< Its output frame number */
+};
+
+
+/* Exported function, documented in checkpoint.h */
+bool checkpoint_load(struct checkpoint *cp, const char *file_name,
+		uint64_t key)
+{
+	struct checkpoint_file f;
+	bool res = false;
+	FILE *fp;
+
+	fp = fopen(file_name, "rb");
+	if (fp == NULL)
+		return false;
+
+	if (fread(&f, sizeof(f), 1, fp) != 1 ||
+			memcmp(f.magic, CHECKPOINT_MAGIC,
+					sizeof(f.magic)) != 0 ||
+			f.key != key || f.frames < 0 || f.out_frames < 0)
+		goto free;
+
+	cp->pts = f.pts;
+	cp->frames = f.frames;
+	cp->out_frames = f.out_frames;
+
+	/* It all worked! */
+	res = true;
+
+free:
+	fclose(fp);
+
+	return res;
+}
+
+
+/* Exported function, documented in checkpoint.h */
+bool checkpoint_save(const struct checkpoint *cp, const char *file_name,
+		uint64_t key)
+{
+	struct checkpoint_file f;
+	char *tmp_name;
+	bool res;
+	FILE *fp;
+
+	tmp_name = malloc(strlen(file_name) + sizeof(".tmp"));
+	if (tmp_name == NULL)
+		return false;
+	strcpy(tmp_name, file_name);
+	strcat(tmp_name, ".tmp");
+
+	fp = fopen(tmp_name, "wb");
+	if (fp == NULL) {
+		free(tmp_name);
+		return false;
+	}
+
+	memset(&f, 0, sizeof(f));
+	memcpy(f.magic, CHECKPOINT_MAGIC, sizeof(f.magic));
+	f.key = key;
+	f.pts = cp->pts;
+	f.frames = cp->frames;
+	f.out_frames = cp->out_frames;
+
+	res = fwrite(&f, sizeof(f), 1, fp) == 1;
+	if (fclose(fp) != 0)
+		res = false;
+	if (res && rename(tmp_name, file_name) != 0)
+		res = false;
+	if (!res)
+		remove(tmp_name);
+	free(tmp_name);
+
+	return res;
+}
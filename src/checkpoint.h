@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2014 Codethink Ltd. (http://www.codethink.co.uk)
+ *
+ * This file is part of ebb
+ *
+ * ebb is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * ebb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Checkpoints
+ *
+ * Notes how far a run has got, so that if it's stopped, a later run can
+ * carry on from there instead of starting again.  A checkpoint is taken at
+ * a different frame, once everything before it has been written, so a run
+ * can carry on by seeking back to it and treating it as the first frame.
+ * Like the difference cache, a checkpoint is only valid for the key it was
+ * saved with.
+ */
+
+#ifndef EBB_CHECKPOINT_H
+#define EBB_CHECKPOINT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/** Where to carry on from */
+struct checkpoint {
+	int64_t pts;		/**< Timestamp of a different frame */
+	int frames;		/**< Its frame number */
+	int out_frames;		/**< Its output frame number */
+};
+
+/**
+ * Load a checkpoint from a file
+ *
+ * \param cp         Checkpoint to fill in
+ * \param file_name  File to load from
+ * \param key        Key the checkpoint must have been saved with
+ * \return true on success, or false if there's no valid checkpoint for
+ *         the key
+ */
+bool checkpoint_load(struct checkpoint *cp, const char *file_name,
+		uint64_t key);
+
+/**
+ * Save a checkpoint to a file
+ *
+ * The checkpoint is written alongside the file and renamed over it, so a
+ * run stopped while saving leaves the last checkpoint in place.
+ *
+ * \param cp         Checkpoint to save
+ * \param file_name  File to save to
+ * \param key        Key to save the checkpoint with
+ * \return true on success, else false
+ */
+bool checkpoint_save(const struct checkpoint *cp, const char *file_name,
+		uint64_t key);
+
+#endif
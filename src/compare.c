@@ -0,0 +1,768 @@
+/*
+ * Copyright (c) 2014 Codethink Ltd. (http://www.codethink.co.uk)
+ *
+ * This file is part of ebb
+ *
+ * ebb is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * ebb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <libavutil/avutil.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
+
+#include "compare.h"
+#include "hash.h"
+#include "stats.h"
+
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define NATIVE_PIX_FMT_BE PIX_FMT_BE
+#else
+#define NATIVE_PIX_FMT_BE 0
+#endif
+
+
+/**
+ * Find the 8-bit tolerance for differences summed over some samples
+ *
+ * The tolerance option is a percentage of the largest possible difference.
+ */
+static int sample_tolerance(const struct compare_settings *s, int samples)
+{
+	return 255 * samples * s->tolerance / 100;
+}
+
+
+/** Set up the neighbourhood test, which is the same for every layout */
+static void compare_format_init_window(struct compare_format *cf,
+		const struct compare_settings *s)
+{
+	cf->border = s->border;
+	cf->roi = NULL;
+	cf->size = s->size;
+	cf->votes = s->votes;
+	cf->window = diff_window(cf->size, cf->votes);
+}
+
+
+/** Set up comparison of frames converted to RGB24 */
+static void compare_format_init_rgb(struct compare_format *cf,
+		const struct compare_settings *s)
+{
+	cf->rgb = true;
+	cf->planes = 1;
+	cf->bytes = 1;
+	cf->chroma_w = 0;
+	cf->chroma_h = 0;
+	cf->tolerance = sample_tolerance(s, 3);
+	compare_format_init_window(cf, s);
+}
+
+
+/**
+ * Work out how to compare frames of a given pixel format natively
+ *
+ * Only YUV formats with a plane of their own for Y, and 8 to 16 bits per
+ * sample, are handled.  U and V may have a plane each, or share one, as
+ * in NV12 and P010.  Samples stored in the high bits of 16, as in P010,
+ * are compared as 16-bit.
+ *
+ * \return true if the format can be compared natively, else false
+ */
+static bool compare_format_init(struct compare_format *cf,
+		const struct compare_settings *s, enum PixelFormat pix_fmt)
+{
+	const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(pix_fmt);
+	const enum compare_mode mode = s->mode;
+	int depth;
+
+	if (desc == NULL || mode == COMPARE_RGB)
+		return false;
+
+	/* Need separate Y, U and V planes */
+	if (!(desc->flags & PIX_FMT_PLANAR) || (desc->flags & PIX_FMT_RGB) ||
+			(desc->flags & PIX_FMT_PAL) ||
+			(desc->flags & PIX_FMT_HWACCEL) ||
+			desc->nb_components < 3)
+		return false;
+
+	depth = desc->comp[0].depth_minus1 + 1;
+	if (depth < 8 || depth > 16)
+		return false;
+
+	/* Samples must be in native byte order for us to read them */
+	if (depth > 8 && (desc->flags & PIX_FMT_BE) != NATIVE_PIX_FMT_BE)
+		return false;
+
+	cf->rgb = false;
+	cf->planes = (mode == COMPARE_LUMA) ? 1 : 3;
+	cf->interleaved = desc->comp[1].plane == desc->comp[2].plane;
+	cf->bytes = (depth > 8) ? 2 : 1;
+	cf->chroma_w = desc->log2_chroma_w;
+	cf->chroma_h = desc->log2_chroma_h;
+	cf->tolerance = sample_tolerance(s, cf->planes);
+	cf->tolerance <<= depth + desc->comp[0].shift - 8;
+	compare_format_init_window(cf, s);
+
+	return true;
+}
+
+
+/** Find the degree to which a sample in two planes' rows differs */
+static inline int sample_difference(const uint8_t *prev, const uint8_t *curr,
+		int x, int bytes)
+{
+	if (bytes == 2)
+		return abs(((const uint16_t *)prev)[x] -
+				((const uint16_t *)curr)[x]);
+
+	return abs(prev[x] - curr[x]);
+}
+
+
+/**
+ * Mark the differing pixels of a row of native YUV frames, including chroma
+ *
+ * Chroma is subsampled, so this doesn't map onto the vector kernels.
+ */
+static void row_mask_yuv(const AVFrame *frame_prev, const AVFrame *frame_curr,
+		int y, int x0, int n, uint8_t *mask,
+		const struct compare_format *cf)
+{
+	const int cy = y >> cf->chroma_h;
+	int x, p;
+
+	for (x = x0; x < x0 + n; x++) {
+		const int cx = x >> cf->chroma_w;
+		int d;
+
+		d = sample_difference(
+				frame_prev->data[0] + y * frame_prev->linesize[0],
+				frame_curr->data[0] + y * frame_curr->linesize[0],
+				x, cf->bytes);
+
+		for (p = 1; p < cf->planes; p++) {
+			const int cp = cf->interleaved ? 1 : p;
+			const int ci = cf->interleaved ? cx * 2 + p - 1 : cx;
+
+			d += sample_difference(
+				frame_prev->data[cp] + cy * frame_prev->linesize[cp],
+				frame_curr->data[cp] + cy * frame_curr->linesize[cp],
+				ci, cf->bytes);
+		}
+
+		mask[x - x0] = (d > cf->tolerance) ? 0xff : 0;
+	}
+}
+
+
+/** Mark the pixels of row y, from x0, that differ between two frames */
+static inline void row_mask(const AVFrame *frame_prev,
+		const AVFrame *frame_curr, int y, int x0, int n,
+		uint8_t *mask, const struct compare_format *cf)
+{
+	const uint8_t *prev = frame_prev->data[0] + y * frame_prev->linesize[0];
+	const uint8_t *curr = frame_curr->data[0] + y * frame_curr->linesize[0];
+
+	if (cf->rgb) {
+		diff.mask_rgb24(prev + x0 * 3, curr + x0 * 3, mask, n,
+				cf->tolerance);
+	} else if (cf->planes > 1) {
+		row_mask_yuv(frame_prev, frame_curr, y, x0, n, mask, cf);
+	} else if (cf->bytes == 2) {
+		diff.mask_16(prev + x0 * 2, curr + x0 * 2, mask, n,
+				cf->tolerance);
+	} else {
+		diff.mask_8(prev + x0, curr + x0, mask, n, cf->tolerance);
+	}
+}
+
+
+/**
+ * Allocate a tile map for frames of the given size
+ *
+ * \param spread  Whether a change can make a neighbourhood whose top left
+ *                pixel is unchanged differ, so the tiles above and to the
+ *                left of a changed tile need checking too
+ */
+static bool tile_map_init(struct tile_map *tm, int w, int h, bool spread)
+{
+	tm->spread = spread;
+	tm->cols = (w + TILE_SIZE - 1) / TILE_SIZE;
+	tm->rows = (h + TILE_SIZE - 1) / TILE_SIZE;
+	tm->ref = calloc(tm->cols * tm->rows, sizeof(*tm->ref));
+	tm->curr = calloc(tm->cols * tm->rows, sizeof(*tm->curr));
+	tm->dirty = calloc(tm->cols * tm->rows, sizeof(*tm->dirty));
+
+	return tm->ref != NULL && tm->curr != NULL && tm->dirty != NULL;
+}
+
+
+/** Free a tile map */
+static void tile_map_fini(struct tile_map *tm)
+{
+	free(tm->ref);
+	free(tm->curr);
+	free(tm->dirty);
+}
+
+
+/** Hash each tile of a frame into the tile map's current hashes */
+static void tile_map_hash(struct tile_map *tm, const AVFrame *frame,
+		int w, int h, const struct compare_format *cf)
+{
+	const int planes = cf->rgb ? 1 :
+			(cf->interleaved && cf->planes > 1) ? 2 : cf->planes;
+	const int bytes = cf->rgb ? 3 : cf->bytes;
+	uint64_t t = stats_start();
+	int tx, ty, p, y;
+
+	for (ty = 0; ty < tm->rows; ty++) {
+		uint64_t *hash = tm->curr + ty * tm->cols;
+
+		for (tx = 0; tx < tm->cols; tx++)
+			hash[tx] = 0;
+
+		for (p = 0; p < planes; p++) {
+			const int sw = (p == 0) ? 0 : cf->chroma_w;
+			const int sh = (p == 0) ? 0 : cf->chroma_h;
+			const int pw = (w + (1 << sw) - 1) >> sw;
+			const int ph = (h + (1 << sh) - 1) >> sh;
+			const int y1 = FFMIN(ph, ((ty + 1) * TILE_SIZE) >> sh);
+			const int pb = (p > 0 && cf->interleaved) ?
+					2 * bytes : bytes;
+
+			for (y = (ty * TILE_SIZE) >> sh; y < y1; y++) {
+				const uint8_t *row = frame->data[p] +
+						y * frame->linesize[p];
+
+				for (tx = 0; tx < tm->cols; tx++) {
+					int x0 = (tx * TILE_SIZE) >> sw;
+					int x1 = FFMIN(pw,
+						((tx + 1) * TILE_SIZE) >> sw);
+
+					hash[tx] = hash64(row + x0 * pb,
+							(x1 - x0) * pb,
+							hash[tx]);
+				}
+			}
+		}
+	}
+
+	stats_end(STATS_COMPARE, t);
+}
+
+
+/**
+ * Mark the tiles whose hashes differ from the last different frame's
+ *
+ * \return true if any tile is dirty, else false
+ */
+static bool tile_map_mark(struct tile_map *tm)
+{
+	bool any = false;
+	int i;
+
+	for (i = 0; i < tm->cols * tm->rows; i++) {
+		tm->dirty[i] = tm->curr[i] != tm->ref[i];
+		any |= tm->dirty[i];
+	}
+
+	/* Neighbourhoods are at most a tile across, so can only reach into
+	 * the next tile right and down.  Each tile only reads the tiles after
+	 * it, which haven't been spread to yet. */
+	if (tm->spread && any) {
+		int tx, ty;
+
+		for (ty = 0; ty < tm->rows; ty++) {
+			uint8_t *d = tm->dirty + ty * tm->cols;
+			bool below = ty + 1 < tm->rows;
+
+			for (tx = 0; tx < tm->cols; tx++) {
+				bool right = tx + 1 < tm->cols;
+
+				d[tx] |= (right && d[tx + 1]) ||
+						(below && d[tx + tm->cols]) ||
+						(right && below &&
+						d[tx + tm->cols + 1]);
+			}
+		}
+	}
+
+	return any;
+}
+
+
+/** Make the current frame's hashes those of the last different frame */
+static void tile_map_swap(struct tile_map *tm)
+{
+	uint64_t *tmp = tm->ref;
+
+	tm->ref = tm->curr;
+	tm->curr = tmp;
+}
+
+
+/**
+ * Check a rectangle of neighbourhoods for a difference
+ *
+ * \param y0  First row of neighbourhoods
+ * \param y1  Row after the last
+ * \param x0  First column of neighbourhoods
+ * \param n   Number of neighbourhoods on each row
+ */
+static bool region_differs(const AVFrame *frame_prev,
+		const AVFrame *frame_curr, int y0, int y1, int x0, int n,
+		const struct compare_format *cf, uint8_t **mask)
+{
+	const int step = cf->rgb ? 3 : 1;
+	const int size = cf->size;
+	const int len = n + size - 1;
+	uint8_t *window[DIFF_MAX_SIZE];
+	int y, r;
+
+	/* Each row's mask gets used for size rows of neighbourhoods, with
+	 * the masks reused round robin */
+	for (r = 0; r < size - 1; r++)
+		row_mask(frame_prev, frame_curr, y0 + r, x0, len, mask[r], cf);
+
+	for (y = y0; y < y1; y++) {
+		row_mask(frame_prev, frame_curr, y + size - 1, x0, len,
+				mask[(y - y0 + size - 1) % size], cf);
+
+		for (r = 0; r < size; r++)
+			window[r] = mask[(y - y0 + r) % size];
+
+		if (cf->window(window, n, step, size, cf->votes)) {
+			/* Found a difference */
+			return true;
+		}
+	}
+
+	/* No difference */
+	return false;
+}
+
+
+/**
+ * Check the neighbourhoods in a rectangle that are in dirty tiles
+ *
+ * \param y0  First row of neighbourhoods
+ * \param y1  Row after the last
+ * \param x0  First column of neighbourhoods
+ * \param x1  Column after the last
+ */
+static bool tiles_differ(const AVFrame *frame_prev,
+		const AVFrame *frame_curr, int y0, int y1, int x0, int x1,
+		const struct compare_format *cf, uint8_t **mask,
+		const struct tile_map *tm)
+{
+	int tx, ty;
+
+	for (ty = y0 / TILE_SIZE; ty * TILE_SIZE < y1; ty++) {
+		const uint8_t *dirty = tm->dirty + ty * tm->cols;
+		int ry0 = FFMAX(y0, ty * TILE_SIZE);
+		int ry1 = FFMIN(y1, (ty + 1) * TILE_SIZE);
+
+		for (tx = x0 / TILE_SIZE; tx * TILE_SIZE < x1; tx++) {
+			int end = tx;
+			int rx0, rx1;
+
+			if (!dirty[tx])
+				continue;
+
+			while (end * TILE_SIZE < x1 && dirty[end])
+				end++;
+
+			rx0 = FFMAX(x0, tx * TILE_SIZE);
+			rx1 = FFMIN(x1, end * TILE_SIZE);
+			if (region_differs(frame_prev, frame_curr, ry0, ry1,
+					rx0, rx1 - rx0, cf, mask))
+				return true;
+
+			tx = end;
+		}
+	}
+
+	/* No difference */
+	return false;
+}
+
+
+/**
+ * Find whether two frames many be considered different
+ *
+ * Frames differ if there is a neighbourhood, 2x2 pixels by default, in
+ * which enough pixels have changed by more than the tolerance; by default
+ * all of them.  Then a neighbourhood can only differ if its top left pixel
+ * has changed, so only neighbourhoods whose top left pixel is in a dirty
+ * tile are checked.  Otherwise the tile map spreads dirty tiles up and
+ * left to cover the neighbourhoods that reach into them.  With a region of
+ * interest, only the neighbourhoods entirely inside it are checked.
+ *
+ * \param frame_prev  Previous frame
+ * \param frame_curr  Current frame
+ * \param w           Frame width
+ * \param h           Frame height
+ * \param cf          Layout of the frames
+ * \param mask        cf->size row masks of at least 3 * w + DIFF_MASK_PAD
+ * \param tm          Tile map, with the dirty tiles marked
+ * \return true if the frames differ, else false
+ */
+static bool frames_differ(const AVFrame *frame_prev,
+		const AVFrame *frame_curr, int w, int h,
+		const struct compare_format *cf, uint8_t **mask,
+		const struct tile_map *tm)
+{
+	bool differ = false;
+	uint64_t t;
+	int y0, x0, n, b, i;
+
+	/* Don't check for differences within border, whatever the layout.
+	 * Since we're checking a neighbourhood per pixel, the last rows/cols
+	 * are only looked at as part of the neighbourhoods before them. */
+	y0 = cf->border;
+	x0 = cf->border;
+	h -= cf->border + cf->size - 1;
+	w -= cf->border + cf->size - 1;
+
+	/* Number of neighbourhoods on each row */
+	n = w - x0;
+	if (n <= 0 || h <= y0)
+		return false;
+
+	t = stats_start();
+	if (cf->roi == NULL) {
+		differ = tiles_differ(frame_prev, frame_curr, y0, h,
+				x0, x0 + n, cf, mask, tm);
+		goto done;
+	}
+
+	/* Only check the parts of the region of interest that are inside
+	 * the border */
+	for (b = 0; b < cf->roi->n_bands; b++) {
+		const struct roi_band *band = &cf->roi->bands[b];
+		int by0 = FFMAX(y0, band->y0);
+		int by1 = FFMIN(h, band->y1);
+
+		for (i = band->first; by0 < by1 &&
+				i < band->first + band->count; i++) {
+			const struct roi_span *span = &cf->roi->spans[i];
+			int sx0 = FFMAX(x0, span->x0);
+			int sx1 = FFMIN(x0 + n, span->x1);
+
+			if (sx0 < sx1 && tiles_differ(frame_prev, frame_curr,
+					by0, by1, sx0, sx1, cf, mask, tm)) {
+				differ = true;
+				goto done;
+			}
+		}
+	}
+
+done:
+	stats_end(STATS_COMPARE, t);
+	return differ;
+}
+
+
+/* Exported function, documented in compare.h */
+void frame_to_rgb(struct SwsContext **img_convert_ctx,
+		const AVFrame *src, enum PixelFormat pix_fmt, int w, int h,
+		AVFrame *dst)
+{
+	uint64_t t = stats_start();
+
+	*img_convert_ctx = sws_getCachedContext(*img_convert_ctx,
+			w, h, pix_fmt, w, h, dst->format,
+			SWS_BICUBIC, NULL, NULL, NULL);
+	sws_scale(*img_convert_ctx, (const uint8_t * const*)
+			((const AVPicture *)src)->data,
+			((const AVPicture *)src)->linesize, 0, h,
+			((AVPicture *)dst)->data,
+			((AVPicture *)dst)->linesize);
+	stats_end(STATS_CONVERT, t);
+}
+
+
+/**
+ * Downscale a decoded frame for comparison
+ *
+ * Area averaging is used, which is cheap and keeps small changes, such as
+ * typing, visible at low sizes.
+ */
+static void frame_scale(struct SwsContext **scale_ctx, const AVFrame *src,
+		enum PixelFormat pix_fmt, int w, int h,
+		AVFrame *dst, enum PixelFormat dst_fmt, int dw, int dh)
+{
+	uint64_t t = stats_start();
+
+	*scale_ctx = sws_getCachedContext(*scale_ctx,
+			w, h, pix_fmt, dw, dh, dst_fmt,
+			SWS_AREA, NULL, NULL, NULL);
+	sws_scale(*scale_ctx, (const uint8_t * const*)
+			((const AVPicture *)src)->data,
+			((const AVPicture *)src)->linesize, 0, h,
+			((AVPicture *)dst)->data,
+			((AVPicture *)dst)->linesize);
+	stats_end(STATS_CONVERT, t);
+}
+
+
+/* Exported function, documented in compare.h */
+AVFrame *frame_alloc(enum PixelFormat pix_fmt, int w, int h)
+{
+	AVFrame *frame = avcodec_alloc_frame();
+
+	if (frame == NULL)
+		return NULL;
+
+	if (avpicture_alloc((AVPicture *)frame, pix_fmt, w, h) < 0) {
+		av_free(frame);
+		return NULL;
+	}
+
+	frame->width = w;
+	frame->height = h;
+	frame->format = pix_fmt;
+
+	return frame;
+}
+
+
+/* Exported function, documented in compare.h */
+void frame_free(AVFrame *frame)
+{
+	if (frame == NULL)
+		return;
+
+	avpicture_free((AVPicture *)frame);
+	av_free(frame);
+}
+
+
+/** Hash every plane of a decoded frame */
+static uint64_t frame_hash(const AVFrame *frame, enum PixelFormat pix_fmt,
+		int w, int h)
+{
+	const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(pix_fmt);
+	uint64_t t = stats_start();
+	uint64_t hash = 0;
+	int planes = 0;
+	int i, p, y;
+
+	for (i = 0; i < desc->nb_components; i++)
+		planes = FFMAX(planes, desc->comp[i].plane + 1);
+
+	for (p = 0; p < planes; p++) {
+		int bytes = av_image_get_linesize(pix_fmt, w, p);
+		int rows = h;
+
+		if (p == 1 || p == 2)
+			rows = (h + (1 << desc->log2_chroma_h) - 1) >>
+					desc->log2_chroma_h;
+
+		for (y = 0; y < rows; y++)
+			hash = hash64(frame->data[p] + y * frame->linesize[p],
+					bytes, hash);
+	}
+
+	/* A palette change changes the picture */
+	if (desc->flags & PIX_FMT_PAL)
+		hash = hash64(frame->data[1], 256 * 4, hash);
+
+	stats_end(STATS_COMPARE, t);
+	return hash;
+}
+
+
+/* Exported function, documented in compare.h */
+bool compare_init(struct compare *c, const struct compare_settings *s,
+		enum PixelFormat pix_fmt, int w, int h)
+{
+	int i;
+
+	memset(c, 0, sizeof(*c));
+	c->pix_fmt = pix_fmt;
+	c->w = w;
+	c->h = h;
+	c->cw = w;
+	c->ch = h;
+
+	/* Set up native comparison, if it was asked for and is possible */
+	compare_format_init_rgb(&c->cf, s);
+	if (s->mode != COMPARE_RGB)
+		c->native = compare_format_init(&c->cf, s, pix_fmt);
+
+	/* Compare downscaled copies of frames, if asked and they're big
+	 * enough, in the same format as we would at full size */
+	c->scale = 1;
+	if (s->scale > 1 && w / s->scale >= 8 && h / s->scale >= 8) {
+		c->scale = s->scale;
+		c->cw = w / c->scale;
+		c->ch = h / c->scale;
+		c->small_fmt = c->native ? pix_fmt : PIX_FMT_RGB24;
+		c->cf.border = (c->cf.border + c->scale - 1) / c->scale;
+		c->small_prev = frame_alloc(c->small_fmt, c->cw, c->ch);
+		c->small_curr = frame_alloc(c->small_fmt, c->cw, c->ch);
+		if (c->small_prev == NULL || c->small_curr == NULL)
+			return false;
+	}
+
+	/* Allocate row masks for frame comparison, one per neighbourhood
+	 * row */
+	for (i = 0; i < c->cf.size; i++) {
+		c->mask[i] = av_malloc(3 * w + DIFF_MASK_PAD);
+		if (c->mask[i] == NULL)
+			return false;
+	}
+
+	/* Allocate tile hashes, to skip unchanged parts of frames */
+	return tile_map_init(&c->tiles, c->cw, c->ch,
+			c->cf.votes < c->cf.size * c->cf.size);
+}
+
+
+/* Exported function, documented in compare.h */
+bool compare_set_roi(struct compare *c, const uint8_t *map)
+{
+	if (!roi_init(&c->roi, map, c->cw, c->ch, c->cf.size))
+		return false;
+
+	c->cf.roi = &c->roi;
+	return true;
+}
+
+
+/* Exported function, documented in compare.h */
+void compare_fini(struct compare *c)
+{
+	int i;
+
+	frame_free(c->small_prev);
+	frame_free(c->small_curr);
+	if (c->scale_ctx != NULL)
+		sws_freeContext(c->scale_ctx);
+	roi_fini(&c->roi);
+	for (i = 0; i < DIFF_MAX_SIZE; i++)
+		av_free(c->mask[i]);
+	tile_map_fini(&c->tiles);
+}
+
+
+/* Exported function, documented in compare.h */
+bool compare_repeat(struct compare *c, const AVFrame *frame)
+{
+	uint64_t hash = frame_hash(frame, c->pix_fmt, c->w, c->h);
+	bool same = hash == c->frame_hash;
+
+	c->frame_hash = hash;
+	return same;
+}
+
+
+/** Find whether a frame differs, leaving the tile map's reference alone */
+static bool compare_check(struct compare *c, const AVFrame *prev,
+		const AVFrame *curr, bool force)
+{
+	tile_map_hash(&c->tiles, curr, c->cw, c->ch, &c->cf);
+
+	return force || (tile_map_mark(&c->tiles) &&
+			frames_differ(prev, curr, c->cw, c->ch, &c->cf,
+			c->mask, &c->tiles));
+}
+
+
+/* Exported function, documented in compare.h */
+bool compare_differs(struct compare *c, const AVFrame *prev,
+		const AVFrame *curr, bool force)
+{
+	if (!compare_check(c, prev, curr, force))
+		return false;
+
+	tile_map_swap(&c->tiles);
+	return true;
+}
+
+
+/* Exported function, documented in compare.h */
+bool compare_peek(struct compare *c, const AVFrame *prev,
+		const AVFrame *curr)
+{
+	return compare_check(c, prev, curr, false);
+}
+
+
+/* Exported function, documented in compare.h */
+bool compare_scaled(struct compare *c, const AVFrame *frame, bool force)
+{
+	AVFrame *frame_tmp;
+
+	frame_scale(&c->scale_ctx, frame, c->pix_fmt, c->w, c->h,
+			c->small_curr, c->small_fmt, c->cw, c->ch);
+	if (!compare_differs(c, c->small_prev, c->small_curr, force))
+		return false;
+
+	frame_tmp = c->small_prev;
+	c->small_prev = c->small_curr;
+	c->small_curr = frame_tmp;
+	return true;
+}
+
+
+/* Exported function, documented in compare.h */
+bool compare_scaled_peek(struct compare *c, const AVFrame *frame)
+{
+	frame_scale(&c->scale_ctx, frame, c->pix_fmt, c->w, c->h,
+			c->small_curr, c->small_fmt, c->cw, c->ch);
+
+	return compare_check(c, c->small_prev, c->small_curr, false);
+}
+
+
+/* Exported function, documented in compare.h */
+bool compare_next(struct compare *c, struct SwsContext **img_convert_ctx,
+		const AVFrame *frame, AVFrame *native, const AVFrame *rgb_prev,
+		AVFrame *rgb_curr, bool force)
+{
+	bool different;
+
+	if (c->scale > 1) {
+		/* Compare a cheap downscaled copy */
+		if (compare_repeat(c, frame) && !force)
+			return false;
+		different = compare_scaled(c, frame, force);
+	} else if (c->native) {
+		/* Compare the frame's own planes directly */
+		different = compare_differs(c, native, frame, force);
+	} else {
+		/* A frame identical to the one before can't be different,
+		 * whether that one was or not, so don't convert it.  (When
+		 * comparing natively, the tile hashes catch this.) */
+		if (compare_repeat(c, frame) && !force)
+			return false;
+
+		/* Conversion to RGB24 ensures three 8-bit colour channels,
+		 * whatever the frame's format */
+		frame_to_rgb(img_convert_ctx, frame, c->pix_fmt, c->w, c->h,
+				rgb_curr);
+		different = compare_differs(c, rgb_prev, rgb_curr, force);
+	}
+
+	if (different && native != NULL)
+		av_picture_copy((AVPicture *)native, (const AVPicture *)frame,
+				c->pix_fmt, c->w, c->h);
+
+	return different;
+}
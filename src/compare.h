@@ -0,0 +1,268 @@
+/*
+ * Copyright (c) 2014 Codethink Ltd. (http://www.codethink.co.uk)
+ *
+ * This file is part of ebb
+ *
+ * ebb is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * ebb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Frame comparison
+ *
+ * Finds whether a frame differs from the last different one, using the
+ * difference kernels.  Frames are compared as RGB24, or in the decoder's
+ * planar YUV format, and may first be shrunk.  The samples in each tile of
+ * a frame are hashed, so only tiles that changed need comparing.
+ *
+ * A comparison keeps what it needs of the last different frame, apart
+ * from the frame itself at full size, which is left to the caller, so it
+ * can be shared with whatever outputs it.  Comparisons keep no global
+ * state, so any number may be used at once, each from one thread.
+ */
+
+#ifndef EBB_COMPARE_H
+#define EBB_COMPARE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <libavcodec/avcodec.h>
+#include <libavutil/pixfmt.h>
+#include <libswscale/swscale.h>
+
+#include "diff.h"
+#include "roi.h"
+
+/** Default change a pixel may have and still be the same (percent) */
+#define COMPARE_TOLERANCE 10
+
+/** Default width and height of neighbourhoods (px) */
+#define COMPARE_SIZE 2
+
+/** Default border to ignore changes in (px) */
+#define COMPARE_BORDER 5
+
+/** Frames are hashed in tiles this many pixels square */
+#define TILE_SIZE 64
+
+/** Ways of comparing frames */
+enum compare_mode {
+	COMPARE_RGB,	/**< Convert to RGB24 and compare all channels */
+	COMPARE_LUMA,	/**< Compare the decoder's native Y plane */
+	COMPARE_YUV,	/**< Compare the decoder's native Y, U and V planes */
+	COMPARE_AUTO	/**< Compare Y, U and V natively if the pixel
+			 *   format allows it, else as RGB24 */
+};
+
+/** What makes frames differ */
+struct compare_settings {
+	enum compare_mode mode;	/**< How to compare frames */
+	int tolerance;		/**< Pixel tolerance (percent) */
+	int size;		/**< Neighbourhood size (px) */
+	int votes;		/**< Changed pixels for neighbourhood */
+	int border;		/**< Border to ignore changes in (px) */
+	int scale;		/**< Downscaling for comparison, or 1 */
+};
+
+/** Layout of the frames being compared */
+struct compare_format {
+	bool rgb;		/**< Whether frames are packed RGB24 */
+	int planes;		/**< Number of planes to compare (1 or 3) */
+	bool interleaved;	/**< Whether U and V share a plane, as in NV12 */
+	int bytes;		/**< Bytes per sample (1 or 2) */
+	int chroma_w;		/**< Log2 of horizontal chroma subsampling */
+	int chroma_h;		/**< Log2 of vertical chroma subsampling */
+	int tolerance;		/**< Pixel tolerance, scaled to bit depth */
+	int size;		/**< Neighbourhood size */
+	int votes;		/**< Changed pixels for neighbourhood to differ */
+	diff_window_fn window;	/**< Neighbourhood test */
+	int border;		/**< Border to ignore changes in (px) */
+	const struct roi *roi;	/**< Region of interest, or NULL for all */
+};
+
+/**
+ * Which tiles of a frame have changed
+ *
+ * Frames are split into TILE_SIZE square tiles, and the samples compared
+ * in each tile are hashed.  A tile with the same hash as in the last
+ * different frame is unchanged, so can't contain a difference, and the
+ * comparison only needs to look at the dirty tiles.
+ */
+struct tile_map {
+	int cols;		/**< Tiles across */
+	int rows;		/**< Tiles down */
+	uint64_t *ref;		/**< Tile hashes of last different frame */
+	uint64_t *curr;		/**< Tile hashes of current frame */
+	uint8_t *dirty;		/**< Whether each tile has changed */
+	bool spread;		/**< Whether changes affect tiles above/left */
+};
+
+/** A comparison of the frames of one video */
+struct compare {
+	enum PixelFormat pix_fmt;	/**< Pixel format of frames */
+	int w, h;			/**< Frame dimensions */
+	struct compare_format cf;	/**< How frames are compared */
+	struct tile_map tiles;		/**< Which tiles have changed */
+	uint64_t frame_hash;		/**< Hash of last frame checked */
+	bool native;			/**< Whether comparing natively */
+	int scale;			/**< Downscaling for comparison */
+	int cw, ch;			/**< Compared frame dimensions */
+	enum PixelFormat small_fmt;	/**< Downscaled frame pixel format */
+	AVFrame *small_prev;		/**< Last different frame, downscaled */
+	AVFrame *small_curr;		/**< Current frame, downscaled */
+	struct SwsContext *scale_ctx;	/**< Downscaler */
+	struct roi roi;			/**< Region of interest */
+	uint8_t *mask[DIFF_MAX_SIZE];	/**< Row masks for comparison */
+};
+
+/**
+ * Set up a comparison
+ *
+ * Frames are compared natively if the settings ask for it and the pixel
+ * format allows it, else as RGB24.  They're downscaled if asked and big
+ * enough.  On failure, what was set up must still be freed with
+ * compare_fini().
+ *
+ * \param c        Comparison to set up
+ * \param s        What makes frames differ
+ * \param pix_fmt  Pixel format of the frames
+ * \param w        Frame width
+ * \param h        Frame height
+ * \return true on success, else false
+ */
+bool compare_init(struct compare *c, const struct compare_settings *s,
+		enum PixelFormat pix_fmt, int w, int h);
+
+/**
+ * Only look for changes in a region of interest
+ *
+ * \param c    Comparison
+ * \param map  One entry per compared pixel, c->cw by c->ch, non-zero for
+ *             those to compare
+ * \return true on success, or false on memory exhaustion
+ */
+bool compare_set_roi(struct compare *c, const uint8_t *map);
+
+/** Free a comparison's resources */
+void compare_fini(struct compare *c);
+
+/**
+ * Find whether a frame is identical to the last one checked
+ *
+ * \param c      Comparison
+ * \param frame  Frame in the comparison's pixel format
+ * \return true if every sample is the same, else false
+ */
+bool compare_repeat(struct compare *c, const AVFrame *frame);
+
+/**
+ * Find whether a frame differs from the last different frame
+ *
+ * If it differs, its tiles become those of the last different frame, so
+ * the caller must keep \a curr as the new last different frame.
+ *
+ * \param c      Comparison
+ * \param prev   Last different frame, as compared
+ * \param curr   Frame to compare, as compared
+ * \param force  Whether to treat the frame as different regardless
+ * \return true if the frame differs, else false
+ */
+bool compare_differs(struct compare *c, const AVFrame *prev,
+		const AVFrame *curr, bool force);
+
+/**
+ * Find whether a frame differs from the last different frame, leaving
+ * that as the last different frame whatever the answer
+ *
+ * This lets frames be compared out of order.
+ *
+ * \param c     Comparison
+ * \param prev  Last different frame, as compared
+ * \param curr  Frame to compare, as compared
+ * \return true if the frame differs, else false
+ */
+bool compare_peek(struct compare *c, const AVFrame *prev,
+		const AVFrame *curr);
+
+/**
+ * Find whether a frame differs, comparing downscaled copies
+ *
+ * The comparison keeps the downscaled copy of the last different frame
+ * itself.
+ *
+ * \param c      Comparison, with c->scale > 1
+ * \param frame  Frame in the comparison's pixel format
+ * \param force  Whether to treat the frame as different regardless
+ * \return true if the frame differs, else false
+ */
+bool compare_scaled(struct compare *c, const AVFrame *frame, bool force);
+
+/**
+ * Find whether a frame differs, comparing downscaled copies, like
+ * compare_peek()
+ *
+ * \param c      Comparison, with c->scale > 1
+ * \param frame  Frame in the comparison's pixel format
+ * \return true if the frame differs, else false
+ */
+bool compare_scaled_peek(struct compare *c, const AVFrame *frame);
+
+/** Whether a comparison converts frames to RGB24 to compare them */
+static inline bool compare_in_rgb(const struct compare *c)
+{
+	return !c->native && c->scale == 1;
+}
+
+/**
+ * Compare the next frame with the last different one, however the
+ * comparison was set up
+ *
+ * This is the comparison ebb and libebb share.  If the frame differs,
+ * it's copied into \a native, when there is one.  In RGB24, the frame is
+ * converted into \a rgb_curr, and if it differs the caller must swap
+ * \a rgb_prev and \a rgb_curr.
+ *
+ * \param c                Comparison
+ * \param img_convert_ctx  Converter to RGB24, set up when first used
+ * \param frame            Frame in the comparison's pixel format
+ * \param native           Last different frame in that format, which
+ *                         must be given unless compare_in_rgb(), else
+ *                         may be NULL
+ * \param rgb_prev         Last different frame in RGB24, if
+ *                         compare_in_rgb()
+ * \param rgb_curr         Frame to convert into, likewise
+ * \param force            Whether to treat the frame as different
+ *                         regardless
+ * \return true if the frame differs, else false
+ */
+bool compare_next(struct compare *c, struct SwsContext **img_convert_ctx,
+		const AVFrame *frame, AVFrame *native, const AVFrame *rgb_prev,
+		AVFrame *rgb_curr, bool force);
+
+/**
+ * Convert a frame to RGB
+ *
+ * \param dst  Frame from frame_alloc(), in RGB24 or RGB48BE, which sets
+ *             how many bits each channel gets
+ */
+void frame_to_rgb(struct SwsContext **img_convert_ctx,
+		const AVFrame *src, enum PixelFormat pix_fmt, int w, int h,
+		AVFrame *dst);
+
+/** Allocate a frame with its own buffer */
+AVFrame *frame_alloc(enum PixelFormat pix_fmt, int w, int h);
+
+/** Free a frame allocated by frame_alloc */
+void frame_free(AVFrame *frame);
+
+#endif
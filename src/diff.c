@@ -0,0 +1,685 @@
+/*
+ * Copyright (c) 2014 Codethink Ltd. (http://www.codethink.co.uk)
+ *
+ * This file is part of ebb
+ *
+ * ebb is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * ebb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "diff.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define DIFF_X86
+#include <immintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define DIFF_NEON
+#include <arm_neon.h>
+#endif
+
+struct diff_kernels diff;
+
+
+/*
+ * Scalar kernels
+ *
+ * These define the results that the vector kernels must reproduce, and
+ * the vector kernels use them to finish off the ends of rows.
+ */
+
+static void mask_rgb24_c(const uint8_t *prev, const uint8_t *curr,
+		uint8_t *mask, int n, int tolerance)
+{
+	int x;
+
+	for (x = 0; x < n * 3; x += 3) {
+		int d = abs(prev[x + 0] - curr[x + 0]) +
+			abs(prev[x + 1] - curr[x + 1]) +
+			abs(prev[x + 2] - curr[x + 2]);
+
+		mask[x + 0] = (d > tolerance) ? 0xff : 0;
+		mask[x + 1] = 0;
+		mask[x + 2] = 0;
+	}
+}
+
+static void mask_8_c(const uint8_t *prev, const uint8_t *curr,
+		uint8_t *mask, int n, int tolerance)
+{
+	int x;
+
+	for (x = 0; x < n; x++)
+		mask[x] = (abs(prev[x] - curr[x]) > tolerance) ? 0xff : 0;
+}
+
+static void mask_16_c(const uint8_t *prev, const uint8_t *curr,
+		uint8_t *mask, int n, int tolerance)
+{
+	const uint16_t *p = (const uint16_t *)prev;
+	const uint16_t *c = (const uint16_t *)curr;
+	int x;
+
+	for (x = 0; x < n; x++)
+		mask[x] = (abs(p[x] - c[x]) > tolerance) ? 0xff : 0;
+}
+
+static bool rows_c(const uint8_t *mask_t, const uint8_t *mask_n,
+		int n, int step)
+{
+	int i;
+
+	for (i = 0; i < n * step; i += step) {
+		if (mask_t[i] & mask_t[i + step] &
+				mask_n[i] & mask_n[i + step])
+			return true;
+	}
+
+	return false;
+}
+
+
+/*
+ * For packed RGB, per pixel sums are found at every sample position, and
+ * then masked so only those at the start of a pixel remain.  Row starts
+ * are pixel aligned, so the pattern has a period of three samples.
+ */
+#define P3 0xff, 0, 0
+#define P3x8 P3, P3, P3, P3, P3, P3, P3, P3
+static const uint8_t rgb_pattern[96] = { P3x8, P3x8, P3x8, P3x8 };
+#undef P3x8
+#undef P3
+
+/** Clamp a tolerance to the range a kernel's lanes can compare against */
+static inline int clamp_tolerance(int tolerance, int max)
+{
+	if (tolerance < 0)
+		return -1;
+	return (tolerance > max) ? max : tolerance;
+}
+
+
+#ifdef DIFF_X86
+
+__attribute__((target("sse2")))
+static inline __m128i sse2_absdiff_u8(__m128i a, __m128i b)
+{
+	return _mm_or_si128(_mm_subs_epu8(a, b), _mm_subs_epu8(b, a));
+}
+
+__attribute__((target("sse2")))
+static inline __m128i sse2_load_absdiff(const uint8_t *prev,
+		const uint8_t *curr)
+{
+	return sse2_absdiff_u8(
+			_mm_loadu_si128((const __m128i *)prev),
+			_mm_loadu_si128((const __m128i *)curr));
+}
+
+__attribute__((target("sse2")))
+static void mask_rgb24_sse2(const uint8_t *prev, const uint8_t *curr,
+		uint8_t *mask, int n, int tolerance)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i tol = _mm_set1_epi16(clamp_tolerance(tolerance, 0x7fff));
+	const int len = n * 3;
+	int i, b;
+
+	if (tolerance < 0) {
+		mask_rgb24_c(prev, curr, mask, n, tolerance);
+		return;
+	}
+
+	/* Blocks read two samples past their end, for the sums */
+	for (i = 0; i + 48 + 2 <= len; i += 48) {
+		for (b = i; b < i + 48; b += 16) {
+			__m128i d0 = sse2_load_absdiff(prev + b, curr + b);
+			__m128i d1 = sse2_load_absdiff(prev + b + 1,
+					curr + b + 1);
+			__m128i d2 = sse2_load_absdiff(prev + b + 2,
+					curr + b + 2);
+			__m128i lo, hi, m;
+
+			lo = _mm_add_epi16(_mm_add_epi16(
+					_mm_unpacklo_epi8(d0, zero),
+					_mm_unpacklo_epi8(d1, zero)),
+					_mm_unpacklo_epi8(d2, zero));
+			hi = _mm_add_epi16(_mm_add_epi16(
+					_mm_unpackhi_epi8(d0, zero),
+					_mm_unpackhi_epi8(d1, zero)),
+					_mm_unpackhi_epi8(d2, zero));
+
+			m = _mm_packs_epi16(_mm_cmpgt_epi16(lo, tol),
+					_mm_cmpgt_epi16(hi, tol));
+			m = _mm_and_si128(m, _mm_loadu_si128(
+					(const __m128i *)(rgb_pattern + b - i)));
+			_mm_storeu_si128((__m128i *)(mask + b), m);
+		}
+	}
+
+	mask_rgb24_c(prev + i, curr + i, mask + i, n - i / 3, tolerance);
+}
+
+__attribute__((target("sse2")))
+static void mask_8_sse2(const uint8_t *prev, const uint8_t *curr,
+		uint8_t *mask, int n, int tolerance)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i tol = _mm_set1_epi8(clamp_tolerance(tolerance, 0xff));
+	int x;
+
+	if (tolerance < 0 || tolerance >= 0xff) {
+		mask_8_c(prev, curr, mask, n, tolerance);
+		return;
+	}
+
+	for (x = 0; x + 16 <= n; x += 16) {
+		__m128i d = sse2_load_absdiff(prev + x, curr + x);
+		__m128i same = _mm_cmpeq_epi8(_mm_subs_epu8(d, tol), zero);
+
+		_mm_storeu_si128((__m128i *)(mask + x),
+				_mm_andnot_si128(same, _mm_set1_epi8(-1)));
+	}
+
+	mask_8_c(prev + x, curr + x, mask + x, n - x, tolerance);
+}
+
+__attribute__((target("sse2")))
+static inline __m128i sse2_same_16(const uint8_t *prev, const uint8_t *curr,
+		__m128i tol)
+{
+	__m128i p = _mm_loadu_si128((const __m128i *)prev);
+	__m128i c = _mm_loadu_si128((const __m128i *)curr);
+	__m128i d = _mm_or_si128(_mm_subs_epu16(p, c), _mm_subs_epu16(c, p));
+
+	return _mm_cmpeq_epi16(_mm_subs_epu16(d, tol), _mm_setzero_si128());
+}
+
+__attribute__((target("sse2")))
+static void mask_16_sse2(const uint8_t *prev, const uint8_t *curr,
+		uint8_t *mask, int n, int tolerance)
+{
+	const __m128i tol = _mm_set1_epi16(clamp_tolerance(tolerance, 0xffff));
+	int x;
+
+	if (tolerance < 0 || tolerance >= 0xffff) {
+		mask_16_c(prev, curr, mask, n, tolerance);
+		return;
+	}
+
+	for (x = 0; x + 16 <= n; x += 16) {
+		__m128i lo = sse2_same_16(prev + x * 2, curr + x * 2, tol);
+		__m128i hi = sse2_same_16(prev + x * 2 + 16,
+				curr + x * 2 + 16, tol);
+		__m128i same = _mm_packs_epi16(lo, hi);
+
+		_mm_storeu_si128((__m128i *)(mask + x),
+				_mm_andnot_si128(same, _mm_set1_epi8(-1)));
+	}
+
+	mask_16_c(prev + x * 2, curr + x * 2, mask + x, n - x, tolerance);
+}
+
+__attribute__((target("sse2")))
+static bool rows_sse2(const uint8_t *mask_t, const uint8_t *mask_n,
+		int n, int step)
+{
+	const int len = n * step;
+	int i;
+
+	for (i = 0; i + 16 <= len; i += 16) {
+		__m128i m = _mm_and_si128(
+				_mm_and_si128(
+				_mm_loadu_si128((const __m128i *)(mask_t + i)),
+				_mm_loadu_si128((const __m128i *)
+						(mask_t + i + step))),
+				_mm_and_si128(
+				_mm_loadu_si128((const __m128i *)(mask_n + i)),
+				_mm_loadu_si128((const __m128i *)
+						(mask_n + i + step))));
+
+		if (_mm_movemask_epi8(m) != 0)
+			return true;
+	}
+
+	/* Finish off any neighbourhoods that didn't fill a vector */
+	i = (i + step - 1) / step;
+	return rows_c(mask_t + i * step, mask_n + i * step, n - i, step);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i avx2_load_absdiff(const uint8_t *prev,
+		const uint8_t *curr)
+{
+	__m256i a = _mm256_loadu_si256((const __m256i *)prev);
+	__m256i b = _mm256_loadu_si256((const __m256i *)curr);
+
+	return _mm256_or_si256(_mm256_subs_epu8(a, b), _mm256_subs_epu8(b, a));
+}
+
+__attribute__((target("avx2")))
+static void mask_rgb24_avx2(const uint8_t *prev, const uint8_t *curr,
+		uint8_t *mask, int n, int tolerance)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i tol = _mm256_set1_epi16(
+			clamp_tolerance(tolerance, 0x7fff));
+	const int len = n * 3;
+	int i, b;
+
+	if (tolerance < 0) {
+		mask_rgb24_c(prev, curr, mask, n, tolerance);
+		return;
+	}
+
+	/* The unpacks and packs both work within 128-bit lanes, so they
+	 * cancel out and the mask comes out in sample order */
+	for (i = 0; i + 96 + 2 <= len; i += 96) {
+		for (b = i; b < i + 96; b += 32) {
+			__m256i d0 = avx2_load_absdiff(prev + b, curr + b);
+			__m256i d1 = avx2_load_absdiff(prev + b + 1,
+					curr + b + 1);
+			__m256i d2 = avx2_load_absdiff(prev + b + 2,
+					curr + b + 2);
+			__m256i lo, hi, m;
+
+			lo = _mm256_add_epi16(_mm256_add_epi16(
+					_mm256_unpacklo_epi8(d0, zero),
+					_mm256_unpacklo_epi8(d1, zero)),
+					_mm256_unpacklo_epi8(d2, zero));
+			hi = _mm256_add_epi16(_mm256_add_epi16(
+					_mm256_unpackhi_epi8(d0, zero),
+					_mm256_unpackhi_epi8(d1, zero)),
+					_mm256_unpackhi_epi8(d2, zero));
+
+			m = _mm256_packs_epi16(_mm256_cmpgt_epi16(lo, tol),
+					_mm256_cmpgt_epi16(hi, tol));
+			m = _mm256_and_si256(m, _mm256_loadu_si256(
+					(const __m256i *)(rgb_pattern + b - i)));
+			_mm256_storeu_si256((__m256i *)(mask + b), m);
+		}
+	}
+
+	mask_rgb24_c(prev + i, curr + i, mask + i, n - i / 3, tolerance);
+}
+
+__attribute__((target("avx2")))
+static void mask_8_avx2(const uint8_t *prev, const uint8_t *curr,
+		uint8_t *mask, int n, int tolerance)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i tol = _mm256_set1_epi8(clamp_tolerance(tolerance, 0xff));
+	int x;
+
+	if (tolerance < 0 || tolerance >= 0xff) {
+		mask_8_c(prev, curr, mask, n, tolerance);
+		return;
+	}
+
+	for (x = 0; x + 32 <= n; x += 32) {
+		__m256i d = avx2_load_absdiff(prev + x, curr + x);
+		__m256i same = _mm256_cmpeq_epi8(_mm256_subs_epu8(d, tol), zero);
+
+		_mm256_storeu_si256((__m256i *)(mask + x),
+				_mm256_andnot_si256(same, _mm256_set1_epi8(-1)));
+	}
+
+	mask_8_c(prev + x, curr + x, mask + x, n - x, tolerance);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i avx2_same_16(const uint8_t *prev, const uint8_t *curr,
+		__m256i tol)
+{
+	__m256i p = _mm256_loadu_si256((const __m256i *)prev);
+	__m256i c = _mm256_loadu_si256((const __m256i *)curr);
+	__m256i d = _mm256_or_si256(_mm256_subs_epu16(p, c),
+			_mm256_subs_epu16(c, p));
+
+	return _mm256_cmpeq_epi16(_mm256_subs_epu16(d, tol),
+			_mm256_setzero_si256());
+}
+
+__attribute__((target("avx2")))
+static void mask_16_avx2(const uint8_t *prev, const uint8_t *curr,
+		uint8_t *mask, int n, int tolerance)
+{
+	const __m256i tol = _mm256_set1_epi16(
+			clamp_tolerance(tolerance, 0xffff));
+	int x;
+
+	if (tolerance < 0 || tolerance >= 0xffff) {
+		mask_16_c(prev, curr, mask, n, tolerance);
+		return;
+	}
+
+	for (x = 0; x + 32 <= n; x += 32) {
+		__m256i lo = avx2_same_16(prev + x * 2, curr + x * 2, tol);
+		__m256i hi = avx2_same_16(prev + x * 2 + 32,
+				curr + x * 2 + 32, tol);
+		/* Undo the lane interleaving of the pack */
+		__m256i same = _mm256_permute4x64_epi64(
+				_mm256_packs_epi16(lo, hi), 0xd8);
+
+		_mm256_storeu_si256((__m256i *)(mask + x),
+				_mm256_andnot_si256(same, _mm256_set1_epi8(-1)));
+	}
+
+	mask_16_c(prev + x * 2, curr + x * 2, mask + x, n - x, tolerance);
+}
+
+__attribute__((target("avx2")))
+static bool rows_avx2(const uint8_t *mask_t, const uint8_t *mask_n,
+		int n, int step)
+{
+	const int len = n * step;
+	int i;
+
+	for (i = 0; i + 32 <= len; i += 32) {
+		__m256i m = _mm256_and_si256(
+				_mm256_and_si256(
+				_mm256_loadu_si256((const __m256i *)
+						(mask_t + i)),
+				_mm256_loadu_si256((const __m256i *)
+						(mask_t + i + step))),
+				_mm256_and_si256(
+				_mm256_loadu_si256((const __m256i *)
+						(mask_n + i)),
+				_mm256_loadu_si256((const __m256i *)
+						(mask_n + i + step))));
+
+		if (!_mm256_testz_si256(m, m))
+			return true;
+	}
+
+	/* Finish off any neighbourhoods that didn't fill a vector */
+	i = (i + step - 1) / step;
+	return rows_c(mask_t + i * step, mask_n + i * step, n - i, step);
+}
+
+#endif /* DIFF_X86 */
+
+
+#ifdef DIFF_NEON
+
+static inline bool neon_any(uint8x16_t v)
+{
+#ifdef __aarch64__
+	return vmaxvq_u8(v) != 0;
+#else
+	uint8x8_t r = vorr_u8(vget_low_u8(v), vget_high_u8(v));
+
+	return vget_lane_u64(vreinterpret_u64_u8(r), 0) != 0;
+#endif
+}
+
+static void mask_rgb24_neon(const uint8_t *prev, const uint8_t *curr,
+		uint8_t *mask, int n, int tolerance)
+{
+	const uint16x8_t tol = vdupq_n_u16(clamp_tolerance(tolerance, 0xffff));
+	const int len = n * 3;
+	int i, b;
+
+	if (tolerance < 0) {
+		mask_rgb24_c(prev, curr, mask, n, tolerance);
+		return;
+	}
+
+	for (i = 0; i + 48 + 2 <= len; i += 48) {
+		for (b = i; b < i + 48; b += 16) {
+			uint8x16_t d0 = vabdq_u8(vld1q_u8(prev + b),
+					vld1q_u8(curr + b));
+			uint8x16_t d1 = vabdq_u8(vld1q_u8(prev + b + 1),
+					vld1q_u8(curr + b + 1));
+			uint8x16_t d2 = vabdq_u8(vld1q_u8(prev + b + 2),
+					vld1q_u8(curr + b + 2));
+			uint16x8_t lo, hi;
+			uint8x16_t m;
+
+			lo = vaddw_u8(vaddl_u8(vget_low_u8(d0),
+					vget_low_u8(d1)), vget_low_u8(d2));
+			hi = vaddw_u8(vaddl_u8(vget_high_u8(d0),
+					vget_high_u8(d1)), vget_high_u8(d2));
+
+			m = vcombine_u8(vmovn_u16(vcgtq_u16(lo, tol)),
+					vmovn_u16(vcgtq_u16(hi, tol)));
+			m = vandq_u8(m, vld1q_u8(rgb_pattern + b - i));
+			vst1q_u8(mask + b, m);
+		}
+	}
+
+	mask_rgb24_c(prev + i, curr + i, mask + i, n - i / 3, tolerance);
+}
+
+static void mask_8_neon(const uint8_t *prev, const uint8_t *curr,
+		uint8_t *mask, int n, int tolerance)
+{
+	const uint8x16_t tol = vdupq_n_u8(clamp_tolerance(tolerance, 0xff));
+	int x;
+
+	if (tolerance < 0 || tolerance >= 0xff) {
+		mask_8_c(prev, curr, mask, n, tolerance);
+		return;
+	}
+
+	for (x = 0; x + 16 <= n; x += 16) {
+		uint8x16_t d = vabdq_u8(vld1q_u8(prev + x), vld1q_u8(curr + x));
+
+		vst1q_u8(mask + x, vcgtq_u8(d, tol));
+	}
+
+	mask_8_c(prev + x, curr + x, mask + x, n - x, tolerance);
+}
+
+static void mask_16_neon(const uint8_t *prev, const uint8_t *curr,
+		uint8_t *mask, int n, int tolerance)
+{
+	const uint16_t *p = (const uint16_t *)prev;
+	const uint16_t *c = (const uint16_t *)curr;
+	const uint16x8_t tol = vdupq_n_u16(clamp_tolerance(tolerance, 0xffff));
+	int x;
+
+	if (tolerance < 0 || tolerance >= 0xffff) {
+		mask_16_c(prev, curr, mask, n, tolerance);
+		return;
+	}
+
+	for (x = 0; x + 16 <= n; x += 16) {
+		uint16x8_t lo = vabdq_u16(vld1q_u16(p + x), vld1q_u16(c + x));
+		uint16x8_t hi = vabdq_u16(vld1q_u16(p + x + 8),
+				vld1q_u16(c + x + 8));
+
+		vst1q_u8(mask + x, vcombine_u8(
+				vmovn_u16(vcgtq_u16(lo, tol)),
+				vmovn_u16(vcgtq_u16(hi, tol))));
+	}
+
+	mask_16_c(prev + x * 2, curr + x * 2, mask + x, n - x, tolerance);
+}
+
+static bool rows_neon(const uint8_t *mask_t, const uint8_t *mask_n,
+		int n, int step)
+{
+	const int len = n * step;
+	int i;
+
+	for (i = 0; i + 16 <= len; i += 16) {
+		uint8x16_t m = vandq_u8(
+				vandq_u8(vld1q_u8(mask_t + i),
+					vld1q_u8(mask_t + i + step)),
+				vandq_u8(vld1q_u8(mask_n + i),
+					vld1q_u8(mask_n + i + step)));
+
+		if (neon_any(m))
+			return true;
+	}
+
+	/* Finish off any neighbourhoods that didn't fill a vector */
+	i = (i + step - 1) / step;
+	return rows_c(mask_t + i * step, mask_n + i * step, n - i, step);
+}
+
+#endif /* DIFF_NEON */
+
+
+/*
+ * Window kernels
+ *
+ * Marked mask entries are 0xff and everything else is 0, so marked pixels
+ * can be counted by adding up the low bits of their entries.
+ */
+
+/** Every pixel of a 2x2 neighbourhood marked, with the rows kernel */
+static bool window_all_2x2(uint8_t *const *masks, int n, int step,
+		int size, int votes)
+{
+	(void)size;
+	(void)votes;
+
+	return diff.rows(masks[0], masks[1], n, step);
+}
+
+/** Any pixel marked, which doesn't depend on the neighbourhood shape */
+static bool window_any(uint8_t *const *masks, int n, int step,
+		int size, int votes)
+{
+	const int len = (n + size - 1) * step;
+	int r, i;
+
+	(void)votes;
+
+	for (r = 0; r < size; r++) {
+		const uint8_t *m = masks[r];
+		uint64_t acc = 0;
+
+		for (i = 0; i + 8 <= len; i += 8) {
+			uint64_t v;
+
+			memcpy(&v, m + i, sizeof(v));
+			acc |= v;
+		}
+		for (; i < len; i++)
+			acc |= m[i];
+
+		if (acc != 0)
+			return true;
+	}
+
+	return false;
+}
+
+/** Some pixels of a 2x2 neighbourhood marked */
+static bool window_2x2(uint8_t *const *masks, int n, int step,
+		int size, int votes)
+{
+	const uint8_t *mask_t = masks[0];
+	const uint8_t *mask_n = masks[1];
+	int i;
+
+	(void)size;
+
+	for (i = 0; i < n * step; i += step) {
+		int count = (mask_t[i] & 1) + (mask_t[i + step] & 1) +
+				(mask_n[i] & 1) + (mask_n[i + step] & 1);
+
+		if (count >= votes)
+			return true;
+	}
+
+	return false;
+}
+
+/**
+ * Any other configuration
+ *
+ * Keeps a running total of the marked pixels in the last \a size columns,
+ * so each pixel is only counted once.
+ */
+static bool window_count(uint8_t *const *masks, int n, int step,
+		int size, int votes)
+{
+	int cols[DIFF_MAX_SIZE];
+	int sum = 0;
+	int x, r;
+
+	for (x = 0; x < n + size - 1; x++) {
+		int count = 0;
+
+		for (r = 0; r < size; r++)
+			count += masks[r][x * step] & 1;
+
+		if (x >= size)
+			sum -= cols[x % size];
+		cols[x % size] = count;
+		sum += count;
+
+		if (x >= size - 1 && sum >= votes)
+			return true;
+	}
+
+	return false;
+}
+
+
+/* Exported function, documented in diff.h */
+void diff_init(bool simd)
+{
+	diff.name = "scalar";
+	diff.mask_rgb24 = mask_rgb24_c;
+	diff.mask_8 = mask_8_c;
+	diff.mask_16 = mask_16_c;
+	diff.rows = rows_c;
+
+	if (!simd)
+		return;
+
+#ifdef DIFF_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		diff.name = "avx2";
+		diff.mask_rgb24 = mask_rgb24_avx2;
+		diff.mask_8 = mask_8_avx2;
+		diff.mask_16 = mask_16_avx2;
+		diff.rows = rows_avx2;
+	} else if (__builtin_cpu_supports("sse2")) {
+		diff.name = "sse2";
+		diff.mask_rgb24 = mask_rgb24_sse2;
+		diff.mask_8 = mask_8_sse2;
+		diff.mask_16 = mask_16_sse2;
+		diff.rows = rows_sse2;
+	}
+#endif
+
+#ifdef DIFF_NEON
+	diff.name = "neon";
+	diff.mask_rgb24 = mask_rgb24_neon;
+	diff.mask_8 = mask_8_neon;
+	diff.mask_16 = mask_16_neon;
+	diff.rows = rows_neon;
+#endif
+}
+
+
+/* Exported function, documented in diff.h */
+diff_window_fn diff_window(int size, int votes)
+{
+	if (votes <= 1)
+		return window_any;
+	if (size == 2 && votes == 4)
+		return window_all_2x2;
+	if (size == 2)
+		return window_2x2;
+
+	return window_count;
+}
@@ -0,0 +1,127 @@
+/*
+ * Copyright (c) 2014 Codethink Ltd. (http://www.codethink.co.uk)
+ *
+ * This file is part of ebb
+ *
+ * ebb is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * ebb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Frame difference kernels
+ *
+ * Frames are compared a row at a time.  First, each row of the two frames
+ * is turned into a mask, with one entry per sample, marking the pixels that
+ * differ by more than the tolerance.  Then pairs of adjacent row masks are
+ * checked for any 2x2 neighbourhood in which every pixel is marked.
+ *
+ * Each row mask is used for two neighbourhood rows, so the per pixel work
+ * is only done once.  There are scalar, SSE2, AVX2 and NEON versions of
+ * the kernels, and diff_init() picks the best the CPU supports.
+ *
+ * Neighbourhoods of other sizes, or which differ when only some of their
+ * pixels are marked, are tested by window kernels.  diff_window() picks
+ * one specialised for the configuration, so the per pixel loops have no
+ * configuration dependent branches.
+ */
+
+#ifndef EBB_DIFF_H
+#define EBB_DIFF_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/** Extra mask entries needed past the end of a row, for vector code */
+#define DIFF_MASK_PAD 64
+
+/** Largest neighbourhood size for window kernels */
+#define DIFF_MAX_SIZE 8
+
+/**
+ * Mark the pixels in a row that differ by more than a tolerance
+ *
+ * For each of the \a n pixels, the mask entry at the pixel's first sample
+ * is set to 0xff if the pixel differs, and every other entry is cleared.
+ *
+ * \param prev       Row from previous frame
+ * \param curr       Row from current frame
+ * \param mask       Mask to fill, one entry per sample
+ * \param n          Number of pixels in the row
+ * \param tolerance  Difference a pixel may have and still be the same
+ */
+typedef void (*diff_row_mask_fn)(const uint8_t *prev, const uint8_t *curr,
+		uint8_t *mask, int n, int tolerance);
+
+/**
+ * Find whether two adjacent row masks have a fully marked neighbourhood
+ *
+ * Checks the 2x2 neighbourhoods whose left pixel is one of the first
+ * \a n pixels, so the masks must cover n + 1 pixels.
+ *
+ * \param mask_t  Mask of the top row
+ * \param mask_n  Mask of the next row
+ * \param n       Number of neighbourhoods to check
+ * \param step    Mask entries per pixel
+ * \return true if any neighbourhood differs, else false
+ */
+typedef bool (*diff_rows_fn)(const uint8_t *mask_t, const uint8_t *mask_n,
+		int n, int step);
+
+/** The set of difference kernels in use */
+struct diff_kernels {
+	const char *name;		/**< Name of instruction set */
+	diff_row_mask_fn mask_rgb24;	/**< Packed 8-bit RGB, step 3 */
+	diff_row_mask_fn mask_8;	/**< One 8-bit sample per pixel */
+	diff_row_mask_fn mask_16;	/**< One 16-bit sample per pixel */
+	diff_rows_fn rows;		/**< Neighbourhood test */
+};
+
+extern struct diff_kernels diff;
+
+/**
+ * Find whether a window of row masks has a neighbourhood that differs
+ *
+ * A neighbourhood is \a size pixels square, and differs if at least
+ * \a votes of its pixels are marked.  Checks the neighbourhoods whose left
+ * pixel is one of the first \a n pixels, so the masks must cover
+ * n + size - 1 pixels.
+ *
+ * \param masks  The \a size row masks, top first
+ * \param n      Number of neighbourhoods to check
+ * \param step   Mask entries per pixel
+ * \param size   Width and height of neighbourhoods
+ * \param votes  Marked pixels needed for a neighbourhood to differ
+ * \return true if any neighbourhood differs, else false
+ */
+typedef bool (*diff_window_fn)(uint8_t *const *masks, int n, int step,
+		int size, int votes);
+
+/**
+ * Select the difference kernels to use
+ *
+ * \param simd  Whether to use vector instructions, if the CPU has them
+ */
+void diff_init(bool simd);
+
+/**
+ * Select the window kernel for a neighbourhood configuration
+ *
+ * The 2x2 neighbourhood with every pixel marked uses the rows kernel
+ * chosen by diff_init().
+ *
+ * \param size   Width and height of neighbourhoods, up to DIFF_MAX_SIZE
+ * \param votes  Marked pixels needed, from 1 to size * size
+ * \return the kernel
+ */
+diff_window_fn diff_window(int size, int votes);
+
+#endif
@@ -28,9 +28,15 @@
  *           -crf 20 -pix_fmt yuv420p -r 25 result.mp4
  */
 
+/* For syncfs() */
+#define _GNU_SOURCE
+
 #include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <inttypes.h>
 #include <stdio.h>
 #include <stdbool.h>
 
@@ -38,34 +44,65 @@
 #include <libavcodec/avcodec.h>
 #include <libavformat/avformat.h>
 #include <libavutil/avutil.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
 #include <libavutil/pixfmt.h>
 #include <libswscale/swscale.h>
 
+#include <libgen.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
-enum log_level {
-	LOG_DEBUG,
-	LOG_INFO,
-	LOG_RESULT,
-	LOG_WARNING,
-	LOG_ERROR
-};
+#include "cache.h"
+#include "checkpoint.h"
+#include "compare.h"
+#include "diff.h"
+#include "edl.h"
+#include "encode.h"
+#include "hash.h"
+#include "hwaccel.h"
+#include "libebb.h"
+#include "log.h"
+#include "pack.h"
+#include "pipeline.h"
+#include "png_out.h"
+#include "raw.h"
+#include "remux.h"
+#include "roi.h"
+#include "stats.h"
 
 enum log_level level;
 
-#define LOG(lev, fmt, ...)				\
-	if (lev >= level)				\
-		printf(fmt, ##__VA_ARGS__);
-
 
 #define SECOND_IN_CS	100
-#define SLACK_TIME_CS	80
 #define SPLASH_TIME_CS  300
-#define PIXEL_TOLERANCE	((255 * 3) / 10)
-#define BORDER 5
+#define PIPELINE_DEPTH 8
+#define WRITE_MEMORY_MIB 256
+#define CACHE_SUFFIX ".ebb-cache"
+#define CHECKPOINT_SUFFIX ".ebb-checkpoint"
+#define CHECKPOINT_INTERVAL 60
+#define DEFAULT_FPS 25
+#define PACKET_LOG_SIZE 256
+#define STATIC_CHECK_FRAMES 100
+#define STATIC_VERIFY_INTERVAL 32
+#define SPARSE_IDLE 50
+#define SPARSE_MAX 64
+
+/** Ways of finding which frames changed */
+enum detect_mode {
+	DETECT_DECODE,		/**< Decode and compare every frame */
+	DETECT_PACKETS,		/**< Don't compare frames with tiny packets */
+	DETECT_PACKETS_ONLY	/**< Only look at packet sizes, not frames */
+};
 
-#define PATH_LEN (1024*1024)
-char path[PATH_LEN];
+/** A rectangle of the frame to compare, or to leave out */
+struct roi_rect {
+	int x, y;			/**< Top left corner (px) */
+	int w, h;			/**< Dimensions (px) */
+	bool include;			/**< Whether to compare it */
+};
 
 struct {
 	const char *input_path;		/**< Video */
@@ -74,15 +111,59 @@ struct {
 	int border;			/**< Border to ignore changes in (px) */
 	int slack;			/**< Unchanging time to allow */
 	int splash;			/**< Time to display splash */
+	enum compare_mode compare;	/**< How to compare frames */
+	bool simd;			/**< Whether to use vector kernels */
+	int threads;			/**< Threads to use, or 0 for auto */
+	int writers;			/**< PNG writer threads, or 0 for auto */
+	int write_memory;		/**< Memory for frames being written (MiB) */
+	const struct png_profile *png;	/**< How to encode PNGs */
+	int png_depth;			/**< Bits per PNG channel, 8 or 16 */
+	bool pack;			/**< Whether to put PNGs in a tar file */
+	bool fsync;			/**< Whether to flush output to disc */
+	const char *encode;		/**< Video encoder, or NULL for PNGs */
+	const char *crf;		/**< Constant rate factor for encoder */
+	bool remux;			/**< Whether to copy without re-encoding */
+	bool keyframes;			/**< Whether to only compare keyframes */
+	int chunks;			/**< Ranges to compare in parallel */
+	const char *hwaccel;		/**< VA-API device to decode on, or NULL */
+	const char *batch;		/**< Batch output pattern, or NULL */
+	const char *manifest;		/**< Batch manifest file, or NULL */
+	int jobs;			/**< Batch files at once, or 0 for auto */
+	bool analyze;			/**< Whether to only write an EDL */
+	enum edl_format edl_format;	/**< How to write the EDL */
+	enum detect_mode detect;	/**< How to find changed frames */
+	int static_packet;		/**< Largest static packet, or 0 */
+	int sparse;			/**< Frames per comparison when idle */
+	bool sparse_key;		/**< Whether to skip to keyframes when idle */
+	bool raw;			/**< Whether to write raw frames */
+	enum raw_format raw_format;	/**< How to write raw frames */
+	bool cache;			/**< Whether to use a difference cache */
+	int checkpoint;			/**< Seconds between checkpoints, or 0 */
+	bool resume;			/**< Whether to carry on from one */
+	int tolerance;			/**< Pixel tolerance (percent) */
+	int size;			/**< Neighbourhood size (px) */
+	int votes;			/**< Changed pixels for neighbourhood */
+	int compare_scale;		/**< Downscaling for comparison */
+	struct roi_rect *rects;		/**< Rectangles to compare or not */
+	int n_rects;			/**< Number of rectangles */
+	const char *mask;		/**< PNG of pixels to compare, or NULL */
+	bool stats;			/**< Whether to report timings */
+	int progress;			/**< Seconds between progress, or 0 */
+	const char *format;		/**< Output container, or NULL */
+	bool stream;			/**< Whether input is a live stream */
 } options;
 
+/** Set when asked to stop reading a live stream */
+static volatile sig_atomic_t interrupted;
+
 
 /** Display usage/help text */
 static void show_usage(const char *prog_name)
 {
 	printf("Usage:\n"
 			"\t%s [options] <in_file> <out_file> [<splash_file>]\n"
-			"\n", prog_name);
+			"\t%s [options] --batch P <in_file>...\n"
+			"\n", prog_name, prog_name);
 
 	printf("\t    <in_file> is path to video file\n");
 	printf("\t   <out_file> is path to destination name\n");
@@ -94,183 +175,292 @@ static void show_usage(const char *prog_name)
 			"\t--border N  -b N   Set border in px (changes are ignored outside)\n"
 			"\t--slack N   -s N   Set slack time in cs (unchanging time allowed)\n"
 			"\t--intro N   -i N   Set time to show splash screen in cs\n"
+			"\t--compare M -c M   Compare frames as auto, rgb, luma or yuv\n"
+			"\t--tolerance N      Set change a pixel may have in percent\n"
+			"\t--neighbourhood N  Set size of pixel neighbourhoods compared\n"
+			"\t--votes N          Set changed pixels that make a change\n"
+			"\t--compare-scale N  Compare frames shrunk N times each way\n"
+			"\t--include R        Only compare rectangle R, given as x,y,w,h\n"
+			"\t--exclude R        Don't compare rectangle R\n"
+			"\t--mask F           Only compare light pixels of PNG F\n"
+			"\t--no-simd          Don't use vector instructions\n"
+			"\t--threads N -t N   Set number of threads (0 for auto)\n"
+			"\t--writers N        Set number of PNG writer threads\n"
+			"\t--write-memory N   Set memory for frames being written in MiB\n"
+			"\t--png-profile P    Use PNG profile fast, balanced, small or interlaced\n"
+			"\t--png-depth N      Write PNGs with 8 or 16 bits per channel\n"
+			"\t--pack             Put the PNGs in one tar file, not a file each\n"
+			"\t--fsync            Flush the output to disc once, when done\n"
+			"\t--encode C  -e C   Encode a video with codec C, not PNGs\n"
+			"\t--crf N            Set constant rate factor for --encode\n"
+			"\t--remux            Copy the video, cutting at keyframes\n"
+			"\t--keyframes        Only decode and compare keyframes\n"
+			"\t--analyze-only F   Only write kept spans as json, edl or ffmpeg\n"
+			"\t--raw F            Write raw frames as y4m or rawvideo\n"
+			"\t--detect M         Find changes by decode, packets or packets-only\n"
+			"\t--static-packet N  Take packets of up to N bytes as static\n"
+			"\t--sparse N         Compare every Nth frame of long pauses\n"
+			"\t--sparse key       Only decode keyframes of long pauses\n"
+			"\t--cache            Save and reuse frame differences\n"
+			"\t--checkpoint N     Save progress every N seconds\n"
+			"\t--resume           Carry on from where an earlier run stopped\n"
+			"\t--format F         Set container format for --encode\n"
+			"\t--stats            Report time spent in each stage\n"
+			"\t--progress N       Write JSON progress every N seconds\n"
+			"\t--chunks N         Split input into N ranges done in parallel\n"
+			"\t--hwaccel vaapi    Decode on the GPU with VA-API\n"
+			"\t--hwaccel-device P Use DRM render node P for --hwaccel\n"
+			"\t--batch P          Do each input, output to P with %%s for name\n"
+			"\t--manifest F       Do each input listed in F, for --batch\n"
+			"\t--jobs N           Set number of --batch inputs done at once\n"
 			"\t--quiet     -q     Only report warnings and errors\n"
 			"\t--verbose   -v     Verbose output\n"
 			"\t--debug     -d     Debug output\n");
 }
 
 
-/** Save a AVFrame to disc as a PNG */
-bool image_write_png(const char *file_name, const AVFrame *frame, int w, int h)
-{
-	FILE *fp;
-	png_structp png_ptr;
-	png_infop info_ptr;
-	int colour_type;
-	png_byte **rows;
-	int y;
+/** A reference counted image, shared between pipeline stages */
+struct image {
+	int refs;		/**< Number of holders of the image */
+	AVFrame *frame;		/**< The image data */
+	struct image_pool *pool;	/**< Pool to return to, or NULL */
+	struct image *next;	/**< Next unused image in pool */
+};
 
-	colour_type = PNG_COLOR_TYPE_RGB;
 
-	/* Open the file to save frame into */
-	fp = fopen(file_name, "wb");
-	if (fp == NULL)
-		return false;
+/**
+ * A pool of images of one format and size
+ *
+ * Images taken from a pool go back to it when their last reference is
+ * dropped, so once enough are in flight, no more get allocated.
+ */
+struct image_pool {
+	pthread_mutex_t lock;
+	enum PixelFormat pix_fmt;	/**< Format of images */
+	int w, h;			/**< Size of images */
+	struct image *unused;		/**< Images waiting to be reused */
+	int count;			/**< Number of images allocated */
+};
 
-	/* png_write_image requires an array of row pointers, and AVFrames
-	 * don't contain one, so make our own. */
-	rows = malloc(h * sizeof(png_byte *));
-	if (rows == NULL) {
-		fclose(fp);
-		return false;
-	}
-	for (y = 0; y < h; y++) {
-		rows[y] = frame->data[0] + y * frame->linesize[0];
-	}
 
-	/* Create and initialize the png_struct */
-	png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING,
-			NULL, NULL, NULL);
+/** Allocate an image, with a single reference */
+static struct image *image_alloc(enum PixelFormat pix_fmt, int w, int h)
+{
+	struct image *img = malloc(sizeof(*img));
 
-	if (png_ptr == NULL) {
-		fclose(fp);
-		free(rows);
-		return false;
-	}
+	if (img == NULL)
+		return NULL;
 
-	/* Allocate/initialize the image information data. */
-	info_ptr = png_create_info_struct(png_ptr);
-	if (info_ptr == NULL) {
-		fclose(fp);
-		free(rows);
-		png_destroy_write_struct(&png_ptr, NULL);
-		return false;
-	}
-	/* Set error handling, needed because I gave NULLs to
-	 * png_create_write_struct. */
-	if (setjmp(png_jmpbuf(png_ptr))) {
-		/* If we get here, we had a problem reading the file */
-		fclose(fp);
-		png_destroy_write_struct(&png_ptr, &info_ptr);
-		return false;
+	img->frame = frame_alloc(pix_fmt, w, h);
+	if (img->frame == NULL) {
+		free(img);
+		return NULL;
 	}
+	img->refs = 1;
+	img->pool = NULL;
+	img->next = NULL;
 
-	/* set up the output control */
-	png_init_io(png_ptr, fp);
+	return img;
+}
 
-	/* Set the image information. */
-	png_set_IHDR(png_ptr, info_ptr, w, h, 8,
-			colour_type, PNG_INTERLACE_ADAM7,
-			PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
 
-	/* Write the file header information. */
-	png_write_info(png_ptr, info_ptr);
+/** Take a reference to an image */
+static struct image *image_ref(struct image *img)
+{
+	__sync_fetch_and_add(&img->refs, 1);
+	return img;
+}
 
-	/* pack pixels into bytes */
-	png_set_packing(png_ptr);
 
-	/* write the png */
-	png_write_image(png_ptr, rows);
-	free(rows);
+/** Drop a reference to an image, freeing it if it was the last one */
+static void image_unref(struct image *img)
+{
+	struct image_pool *pool;
 
-	/* finish writing the rest of the file */
-	png_write_end(png_ptr, info_ptr);
+	if (img == NULL)
+		return;
 
-	/* clean up after the write, and free any memory allocated */
-	png_destroy_write_struct(&png_ptr, &info_ptr);
+	if (__sync_sub_and_fetch(&img->refs, 1) != 0)
+		return;
 
-	/* close the file */
-	fclose(fp);
+	pool = img->pool;
+	if (pool != NULL) {
+		pthread_mutex_lock(&pool->lock);
+		img->next = pool->unused;
+		pool->unused = img;
+		pthread_mutex_unlock(&pool->lock);
+	} else {
+		frame_free(img->frame);
+		free(img);
+	}
+}
 
-	return true;
+
+/** Set up an empty image pool */
+static void image_pool_init(struct image_pool *pool,
+		enum PixelFormat pix_fmt, int w, int h)
+{
+	pthread_mutex_init(&pool->lock, NULL);
+	pool->pix_fmt = pix_fmt;
+	pool->w = w;
+	pool->h = h;
+	pool->unused = NULL;
+	pool->count = 0;
 }
 
 
-/** Find the degree to which two pixels differ (0 to 255*3) */
-static inline int pixel_difference(const uint8_t *prev, const uint8_t *curr)
+/** Free an image pool, once all its images have been returned to it */
+static void image_pool_fini(struct image_pool *pool)
 {
-	int pr = prev[0], pg = prev[1], pb = prev[2];
-	int cr = curr[0], cg = curr[1], cb = curr[2];
+	struct image *img;
 
-	return abs(pr - cr) + abs(pg - cg) + abs(pb - cb);
+	while (pool->unused != NULL) {
+		img = pool->unused;
+		pool->unused = img->next;
+		frame_free(img->frame);
+		free(img);
+	}
+	pthread_mutex_destroy(&pool->lock);
 }
 
 
-/** Find whether two 2x2 pixel neighbourhoods may be considered different */
-static inline bool neighbourhoods_differ(
-		const uint8_t *prev_t, const uint8_t *prev_n,
-		const uint8_t *curr_t, const uint8_t *curr_n,
-		int x)
+/** Take an image from a pool, with a single reference */
+static struct image *image_pool_get(struct image_pool *pool)
 {
-	int tl = pixel_difference(prev_t + x, curr_t + x);
-	int tr = pixel_difference(prev_t + x + 3, curr_t + x + 3);
-	int bl = pixel_difference(prev_n + x, curr_n + x);
-	int br = pixel_difference(prev_n + x + 3, curr_n + x + 3);
-	int different = 0;
+	struct image *img;
+
+	pthread_mutex_lock(&pool->lock);
+	img = pool->unused;
+	if (img != NULL)
+		pool->unused = img->next;
+	pthread_mutex_unlock(&pool->lock);
+
+	if (img == NULL) {
+		img = image_alloc(pool->pix_fmt, pool->w, pool->h);
+		if (img == NULL)
+			return NULL;
+		img->pool = pool;
+		__sync_fetch_and_add(&pool->count, 1);
+	}
+	img->refs = 1;
+
+	return img;
+}
 
-	/* Check if difference is greater than tolerance threashold */
-	if (tl > PIXEL_TOLERANCE)
-		different++;
-	if (tr > PIXEL_TOLERANCE)
-		different++;
-	if (bl > PIXEL_TOLERANCE)
-		different++;
-	if (br > PIXEL_TOLERANCE)
-		different++;
 
-	/* Only count it as different if three of the pixels had a difference */
-	if (different > 3)
+/**
+ * Ensure an image isn't shared with anyone else, so it can be changed
+ *
+ * If anyone else holds the image, the caller's reference is swapped for
+ * another image from the pool.
+ *
+ * \return true on success, else false
+ */
+static bool image_make_writable(struct image **img, struct image_pool *pool)
+{
+	if (*img != NULL && __sync_fetch_and_add(&(*img)->refs, 0) == 1)
 		return true;
 
-	return false;
+	image_unref(*img);
+	*img = image_pool_get(pool);
+
+	return *img != NULL;
 }
 
 
-/** Find whether two frames many be considered different */
-static bool frames_differ(AVFrame *frame_prev, AVFrame *frame_curr,
-		int w, int h)
+/**
+ * Load a PNG as an RGB24 image, scaled to the given size
+ *
+ * \return new image, or NULL on failure
+ */
+static struct image *image_read_png(const char *file_name, int w, int h)
 {
-	const uint8_t *prev_t, *prev_n;
-	const uint8_t *curr_t, *curr_n;
-	int x, y;
+	FILE *fp;
+	png_structp png_ptr;
+	png_infop info_ptr;
+	png_uint_32 png_w, png_h;
+	AVFrame * volatile src = NULL;
+	png_bytep * volatile rows = NULL;
+	struct image *img = NULL;
+	struct SwsContext *sws_ctx;
+	png_uint_32 y;
+
+	fp = fopen(file_name, "rb");
+	if (fp == NULL)
+		return NULL;
+
+	png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING,
+			NULL, NULL, NULL);
+	if (png_ptr == NULL) {
+		fclose(fp);
+		return NULL;
+	}
+
+	info_ptr = png_create_info_struct(png_ptr);
+	if (info_ptr == NULL) {
+		fclose(fp);
+		png_destroy_read_struct(&png_ptr, NULL, NULL);
+		return NULL;
+	}
+
+	if (setjmp(png_jmpbuf(png_ptr))) {
+		/* If we get here, we had a problem reading the file */
+		fclose(fp);
+		png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+		free(rows);
+		frame_free(src);
+		return NULL;
+	}
 
-	/* Don't check for differences within border */
-	w -= 2 * options.border;
-	h -= 2 * options.border;
+	png_init_io(png_ptr, fp);
+	png_read_info(png_ptr, info_ptr);
 
-	/* Since we're cheking a 2x2 pixel neighbourhood per pixel, don't
-	 * need to look at last row/col */
-	w--;
-	h--;
+	/* Whatever the PNG has, get 8-bit RGB out of it */
+	png_set_expand(png_ptr);
+	png_set_strip_16(png_ptr);
+	png_set_strip_alpha(png_ptr);
+	png_set_gray_to_rgb(png_ptr);
+	png_set_interlace_handling(png_ptr);
+	png_read_update_info(png_ptr, info_ptr);
 
-	/* Row data length is 3 times pixel width, due to 3 colour channels */	
-	w *= 3;
+	png_w = png_get_image_width(png_ptr, info_ptr);
+	png_h = png_get_image_height(png_ptr, info_ptr);
 
-	/* Position of this row in current and previous frames */
-	prev_t = frame_prev->data[0];
-	curr_t = frame_curr->data[0];
+	src = frame_alloc(PIX_FMT_RGB24, png_w, png_h);
+	rows = malloc(png_h * sizeof(png_bytep));
+	if (src == NULL || rows == NULL)
+		png_error(png_ptr, "out of memory");
+	for (y = 0; y < png_h; y++)
+		rows[y] = src->data[0] + y * src->linesize[0];
 
-	/* Check frames */
-	for (y = options.border; y < h; y++) {
-		/* Position of nect row in current and previous frames */
-		prev_n = prev_t + frame_prev->linesize[0];
-		curr_n = curr_t + frame_curr->linesize[0];
+	png_read_image(png_ptr, rows);
+	png_read_end(png_ptr, NULL);
 
-		/* Check for differences between frames on this row */
-		for (x = options.border * 3; x < w; x += 3) {
-			if (neighbourhoods_differ(
-					prev_t, prev_n,
-					curr_t, curr_n, x)) {
-				/* Found a difference */
-				return true;
-			}
+	png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+	fclose(fp);
+	free(rows);
+
+	/* Scale it to fit the video */
+	img = image_alloc(PIX_FMT_RGB24, w, h);
+	if (img != NULL) {
+		sws_ctx = sws_getCachedContext(NULL, png_w, png_h,
+				PIX_FMT_RGB24, w, h, PIX_FMT_RGB24,
+				SWS_BICUBIC, NULL, NULL, NULL);
+		if (sws_ctx == NULL) {
+			image_unref(img);
+			img = NULL;
+		} else {
+			sws_scale(sws_ctx, (const uint8_t * const*)
+					((AVPicture *)src)->data,
+					((AVPicture *)src)->linesize, 0, png_h,
+					((AVPicture *)img->frame)->data,
+					((AVPicture *)img->frame)->linesize);
+			sws_freeContext(sws_ctx);
 		}
-		prev_t = prev_n;
-		curr_t = curr_n;
 	}
+	frame_free(src);
 
-	/* No difference */
-	return false;
+	return img;
 }
 
 
@@ -305,16 +495,16 @@ static inline void get_times(int f1, int f2, AVRational *fps,
 }
 
 
-/** Dump splash screen frames */
-static int dump_splash(const char *splash, int len, const char *output_path,
-		AVRational *fps)
+/** Dump splash screen frames into a pack, linking them to the first */
+static int pack_splash(const char *splash, struct pack *pack, int lim)
 {
+	char name[sizeof("00000000.png") + 8];
 	int i;
-	int lim = (options.splash * fps->num) / (SECOND_IN_CS * fps->den);
 
 	for (i = 0; i < lim; i++) {
-		sprintf(path, "%.*s%.08i.png", len, output_path, i);
-		if (link(splash, path) < 0) {
+		sprintf(name, "%.08i.png", i);
+		if (i == 0 ? !pack_add_file(pack, name, splash) :
+				!pack_link(pack, name, "00000000.png")) {
 			LOG(LOG_INFO, "Could not copy splash image %s\n",
 					splash);
 			break;
@@ -327,284 +517,3140 @@ static int dump_splash(const char *splash, int len, const char *output_path,
 }
 
 
-bool excise_boring_bits(AVFormatContext *fmt_ctx, AVCodecContext *dec_ctx,
-		int stream_id, AVStream *vs)
+/** Dump splash screen frames, into a pack if there is one */
+static int dump_splash(const char *splash, int len, const char *output_path,
+		struct pack *pack, AVRational *fps)
 {
-	AVPacket pkt;
-	AVFrame *frame = NULL;
-	AVFrame *frame_curr = NULL;
-	AVFrame *frame_prev = NULL;
-	AVFrame *frame_tmp = NULL;
-	struct SwsContext *img_convert_ctx = NULL;
-	int s1, s2, m1, m2, h1, h2;
-	bool res = false;
-	int frames = 0; /* Current frame count */
-	int out_frames;
-	int skip = 0; /* Current count of frames to skip*/
-	int path_len = strlen(options.output_path);
-	int ret;
-	size_t len;
-	uint8_t *buffer;
-	const int slack = options.slack * vs->avg_frame_rate.num /
-			(SECOND_IN_CS * vs->avg_frame_rate.den);
+	char file_name[len + sizeof("00000000.png") + 8];
+	int i;
+	int lim = (options.splash * fps->num) / (SECOND_IN_CS * fps->den);
 
-	/* Initialize decode packet */
-	av_init_packet(&pkt);
-	pkt.data = NULL;
-	pkt.size = 0;
+	if (pack != NULL)
+		return pack_splash(splash, pack, lim);
 
-	/* Allocate frame for decoding into */
-	frame = avcodec_alloc_frame();
-	if (frame == NULL) {
-		LOG(LOG_ERROR, "Could not allocate frame\n");
-		goto free;
+	for (i = 0; i < lim; i++) {
+		sprintf(file_name, "%.*s%.08i.png", len, output_path, i);
+		if (link(splash, file_name) < 0) {
+			LOG(LOG_INFO, "Could not copy splash image %s\n",
+					splash);
+			break;
+		}
 	}
 
-	/* Allocate frames for RGB conversion */
-	frame_curr = avcodec_alloc_frame();
-	if (frame_curr == NULL) {
-		LOG(LOG_ERROR, "Could not allocate frame for rgb conversion\n");
-		goto free;
-	}
+	LOG(LOG_INFO, "Splash frames: %i\n", i);
 
-	/* Allocate frames for RGB conversion */
-	frame_prev = avcodec_alloc_frame();
-	if (frame_prev == NULL) {
-		LOG(LOG_ERROR, "Could not allocate frame for rgb conversion\n");
-		goto free;
-	}
+	return i;
+}
 
-	/* Allocate current and previous rgb frames */
-	len = avpicture_get_size(PIX_FMT_RGB24,
-			dec_ctx->width, dec_ctx->height);
-	buffer = av_malloc(len);
-	avpicture_fill((AVPicture *)frame_curr, buffer, PIX_FMT_RGB24,
-			dec_ctx->width, dec_ctx->height);
-	buffer = av_malloc(len);
-	avpicture_fill((AVPicture *)frame_prev, buffer, PIX_FMT_RGB24,
-			dec_ctx->width, dec_ctx->height);
-
-	/* Remove any ".png" from of output filename length */
-	if (path_len > 4 && strcmp(options.output_path + path_len - 4,
-			".png") == 0)
-		path_len -= 4;
 
-	/* Output any splash title screen that is required */
-	out_frames = 0;
-	if (options.splash_path != NULL) {
-		out_frames = dump_splash(options.splash_path,
-				path_len, options.output_path,
-				&vs->avg_frame_rate);
-	}
+/** A decoded frame, sent from the decoder to the compare stage */
+struct decoded_frame {
+	AVFrame *frame;		/**< Frame in the decoder's pixel format */
+	struct image *image;	/**< Copy holding frame, or NULL */
+	int64_t pts;		/**< Frame's timestamp, in stream time base */
+	int pkt_size;		/**< Size of frame's packet, or -1 */
+	bool pkt_key;		/**< Whether frame's packet is a keyframe */
+	bool probe;		/**< Whether it's a keyframe skipped to */
+};
 
-	/* Read the frames from the input file */
-	while (av_read_frame(fmt_ctx, &pkt) >= 0) {
-		int got_frame;
 
-		/* Skip non-video packets */
-		if (pkt.stream_index != stream_id) {
-			LOG(LOG_DEBUG, "Not video stream!\n");
-			av_free_packet(&pkt);
-			continue;
-		}
+/**
+ * Sizes of recently decoded packets
+ *
+ * Decoders hold on to packets for a while, so a decoded frame's packet is
+ * found from its timestamp.
+ */
+struct packet_log {
+	int64_t pts[PACKET_LOG_SIZE];	/**< Timestamp of each packet */
+	int size[PACKET_LOG_SIZE];	/**< Size of each packet */
+	bool key[PACKET_LOG_SIZE];	/**< Whether each is a keyframe */
+	int next;			/**< Where the next packet goes */
+};
 
-		/* Try decoding a frame */
-		ret = avcodec_decode_video2(dec_ctx, frame,
-				&got_frame, &pkt);
-		if (ret < 0) {
-			LOG(LOG_WARNING, "Warning: could not decode frame\n");
-			break;
-		}
 
-		/* Handle the frame, if we got one */
-		if (got_frame) {
-			bool write_frame = true;
-
-			/* TODO: Could do without the conversion to RGB, which
-			 *       would be faster, but would have to deal with
-			 *       all sorts of different frame types.
-			 *       Would need to understand if they're all 8-bit
-			 *       per channel, and how to get the channel count.
-			 *       Conversion to RGB24 ensures three 8-bit colour
-			 *       channels.
-                         */
-			img_convert_ctx = sws_getCachedContext(img_convert_ctx,
-					dec_ctx->width, dec_ctx->height,
-					dec_ctx->pix_fmt, dec_ctx->width,
-					dec_ctx->height, PIX_FMT_RGB24,
-					SWS_BICUBIC, NULL, NULL,NULL);
-			sws_scale(img_convert_ctx, (const uint8_t * const*)
-					((AVPicture*)frame)->data,
-					((AVPicture*)frame)->linesize, 0,
-					dec_ctx->height,
-					((AVPicture *)frame_curr)->data,
-					((AVPicture *)frame_curr)->linesize);
-
-			if (frames == 0 || frames_differ(frame_prev, frame_curr,
-					dec_ctx->width, dec_ctx->height)) {
-				/* This frame has something new */
-				frame_tmp = frame_prev;
-				frame_prev = frame_curr;
-				frame_curr = frame_tmp;
-
-				LOG(LOG_DEBUG, "%i: Different\n", frames);
-
-				if (skip > slack) {
-					/* Log which frames got skipped */
-					int f1 = frames - (skip - slack);
-					int f2 = frames;
-
-					get_times(f1, f2, &vs->avg_frame_rate,
-							&s1, &m1, &h1,
-							&s2, &m2, &h2);
-					LOG(LOG_INFO, "Skip frames %i to %i ",
-							f1, f2);
-					LOG(LOG_INFO, "(%.2i:%.2i:%.2i - "
-							"%.2i:%.2i:%.2i)\n",
-							h1, m1, s1,
-							h2, m2, s2);
-				}
-				skip = 0;
+/** Empty a packet log */
+static void packet_log_init(struct packet_log *log)
+{
+	int i;
 
-			} else {
-				/* Frames are the same */
-				skip++;
+	for (i = 0; i < PACKET_LOG_SIZE; i++)
+		log->pts[i] = AV_NOPTS_VALUE;
+	log->next = 0;
+}
 
-				LOG(LOG_DEBUG, "%i: Same\n", frames);
 
-				if (skip > slack) {
-					write_frame = false;
-				}
-			}
+/** Note a packet given to the decoder */
+static void packet_log_add(struct packet_log *log, const AVPacket *pkt)
+{
+	if (pkt->data == NULL || pkt->pts == AV_NOPTS_VALUE)
+		return;
 
-			/* Write frame_prev to the output file, if we've
-			 * decided to keep it */
-			if (write_frame) {
-				sprintf(path, "%.*s%.08i.png", path_len,
-						options.output_path,
-						out_frames);
-				image_write_png(path, frame_prev,
-						dec_ctx->width,
-						dec_ctx->height);
-				out_frames++;
-			}
+	log->pts[log->next] = pkt->pts;
+	log->size[log->next] = pkt->size;
+	log->key[log->next] = pkt->flags & AV_PKT_FLAG_KEY;
+	log->next = (log->next + 1) % PACKET_LOG_SIZE;
+}
 
-			frames++;
-		}
 
-		av_free_packet(&pkt);
-	}
+/** Find a decoded frame's packet, setting its size to -1 if we can't */
+static void packet_log_find(const struct packet_log *log,
+		struct decoded_frame *df)
+{
+	int i;
 
-	get_times(frames, out_frames, &vs->avg_frame_rate,
-			&s1, &m1, &h1, &s2, &m2, &h2);
-	LOG(LOG_RESULT, "Frames %i --> %i ", frames, out_frames);
-	LOG(LOG_RESULT, "(%.2i:%.2i:%.2i --> %.2i:%.2i:%.2i)\n",
-			h1, m1, s1, h2, m2, s2);
+	df->pkt_size = -1;
+	df->pkt_key = false;
+	if (df->pts == AV_NOPTS_VALUE)
+		return;
 
-	/* It all worked! */
-	res = true;
-free:
-	if (frame != NULL)
-		av_free(frame);
-	if (frame_curr != NULL)
-		av_free(frame_curr);
-	if (frame_prev != NULL)
-		av_free(frame_prev);
-	if (img_convert_ctx != NULL) {
-                sws_freeContext(img_convert_ctx);
+	for (i = 0; i < PACKET_LOG_SIZE; i++) {
+		if (log->pts[i] == df->pts) {
+			df->pkt_size = log->size[i];
+			df->pkt_key = log->key[i];
+			return;
+		}
 	}
-
-	return res;
 }
 
 
+/** A kept frame, sent from the compare stage to the writer */
+struct write_job {
+	struct image *image;	/**< RGB image to write */
+	int index;		/**< Output frame number */
+	int copies;		/**< Number of frames after that are the same */
+	struct png_output *out;	/**< Where it goes, if written as a PNG */
+};
+
+
+/** A range of the input, compared by its own worker */
+struct chunk {
+	int stream_id;			/**< Index of video stream */
+	int64_t start;			/**< First timestamp, or AV_NOPTS_VALUE */
+	int64_t end;			/**< Timestamp after the last */
+	bool write;			/**< Whether to save different frames */
+	const char *input_path;		/**< Video */
+	const char *output_path;	/**< Output path */
+	int path_len;			/**< Length of output path prefix */
+
+	int64_t *pts;			/**< Timestamp of each frame */
+	bool *different;		/**< Whether each frame differed */
+	int count;			/**< Number of frames */
+	int size;			/**< Space for frames */
+
+	bool failed;			/**< Whether something went wrong */
+	pthread_t thread;		/**< Worker thread */
+};
+
+
+/** Where the image for kept frames is, when putting chunks together */
+struct stitch {
+	char *file;			/**< File with last different frame */
+	bool moved;			/**< Whether file is an output yet */
+	const char *output_path;	/**< Output path */
+	int path_len;			/**< Length of output path prefix */
+};
+
+
+/** Where progress is saved, and where a run carries on from */
+struct resume {
+	char *file_name;		/**< Checkpoint file, or NULL */
+	uint64_t key;			/**< Key of input and settings */
+	uint64_t interval;		/**< Time between checkpoints (ns) */
+	bool found;			/**< Whether to carry on from one */
+	struct checkpoint from;		/**< Where to carry on from */
+};
+
+
 /**
- * Excise the boring bits of an input video, and save the remaining to output
+ * An input being worked on, and where its output goes
  *
- * \return true on success, else false
+ * In batch mode, several inputs are worked on at once, sharing the PNG
+ * writers and the memory for frames being written.
  */
-bool excise_boring_bits_wrapper(void)
-{
-	AVFormatContext *fmt_ctx = NULL;
-	AVCodecContext *dec_ctx = NULL;
-	AVCodec *dec = NULL;
-	int stream_id;
-	AVStream *vs;
-	bool res = false;
-	int ret;
+struct input {
+	const char *input_path;		/**< Video */
+	const char *output_path;	/**< Output path */
+	int path_len;			/**< Length of output path, without ".png" */
+	const char *hwaccel;		/**< VA-API device to decode on, or NULL */
+	int threads;			/**< Decoder threads */
+	struct stage *writer;		/**< Shared PNG writer stage, or NULL */
+	struct budget *budget;		/**< Shared write memory, or NULL */
+};
 
-	/* Register all the formats and codecs supported by ffmpeg.
-	 * We don't know what format the input file is, and this is
-	 * quicker than actually testing. */
-	av_register_all();
 
-	/* Open the input file, and allocate it's format context */
-	ret = avformat_open_input(&fmt_ctx, options.input_path, NULL, NULL);
-	if (ret < 0) {
-		LOG(LOG_ERROR, "Could not open input video: '%s'\n",
-				options.input_path);
-		goto free;
-	}
+/** State of the convert and compare stage */
+struct excise_state {
+	enum PixelFormat pix_fmt;	/**< Decoder pixel format */
+	int w, h;			/**< Frame dimensions */
+	AVRational fps;			/**< Input frame rate */
+	AVRational time_base;		/**< Input stream time base */
+	int64_t start_pts;		/**< Timestamp of first frame */
+	int slack;			/**< Slack time in frames */
+	bool keyframes;			/**< Whether only keyframes are decoded */
+	bool analyze;			/**< Whether decisions only go in edl */
+	struct edl edl;			/**< Decision on each frame */
+	struct cache *cache;		/**< Where to note results, or NULL */
 
-	/* Get info about the stream */
-	ret = avformat_find_stream_info(fmt_ctx, NULL);
-	if (ret < 0) {
-		LOG(LOG_ERROR, "Warning: Couldn't get input stream info\n");
-	}
+	struct compare cmp;		/**< How frames are compared */
+	bool native_stale;		/**< Whether image_prev is outdated */
+	AVFrame *frame_native;		/**< Last different native frame */
+	struct image *image_prev;	/**< Last different frame, in RGB */
+	struct image *image_curr;	/**< Current frame, in RGB */
+	struct image_pool pool;		/**< RGB images */
+	bool pool_ready;		/**< Whether pool is set up */
+	struct SwsContext *img_convert_ctx;
 
-	/* Find the "best" video stream in the file */
-	ret = av_find_best_stream(fmt_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
-	if (ret < 0) {
-		LOG(LOG_ERROR, "Could not find video stream in input file: "
-				"'%s'\n", options.input_path);
-		goto free;
-	}
+	int frames;			/**< Current frame count */
+	int out_frames;			/**< Output frame count */
+	int skip;			/**< Current count of frames to skip */
+	bool failed;			/**< Whether something went wrong */
 
-	/* Got the stream number of the video, so get its stream */
-	stream_id = ret;
-	vs = fmt_ctx->streams[stream_id];
+	int static_bytes;		/**< Largest packet taken as static */
+	int static_seen;		/**< Number of static packets seen */
 
-	/* Get the decoder for the stream */
-	dec_ctx = vs->codec;
-	dec = avcodec_find_decoder(dec_ctx->codec_id);
-	if (!dec) {
-		LOG(LOG_ERROR, "Could not find codec for input video\n");
-		goto free;
-	}
+	int sparse;			/**< Frames per comparison when idle */
+	struct decoded_frame held[SPARSE_MAX];	/**< Frames not compared yet */
+	int n_held;			/**< Number of frames held */
 
-	/* Initialise the decoder */
-	ret = avcodec_open2(dec_ctx, dec, NULL);
-	if (ret < 0) {
-		LOG(LOG_ERROR, "Could not open codec for input video\n");
-		return ret;
-	}
+	bool key_skip;			/**< Whether to skip to keyframes when
+					 *   idle */
+	int idle;			/**< Whether the pause is long enough
+					 *   to skip, read by the decoder */
+	bool rewind;			/**< Whether a keyframe skipped to
+					 *   differed */
 
-	LOG(LOG_DEBUG, "Frame rate: %i/%i\n",
-			vs->avg_frame_rate.num, vs->avg_frame_rate.den);
+	enum PixelFormat rgb_fmt;	/**< Format of RGB images */
+	size_t image_size;		/**< Bytes in an RGB image */
 
-	/* Do the excising of boring bits */
-	res = excise_boring_bits(fmt_ctx, dec_ctx, stream_id, vs);
-	if (res == false) {
-		goto free;
-	}
+	struct stage *writer;		/**< Where kept frames go, or NULL */
+	struct write_job pending;	/**< Kept frame not yet sent to writer */
+	struct raw_writer *raw;		/**< Raw frame output, or NULL */
 
-	/* It all worked! */
-	res = true;
+	int64_t *drop;			/**< Timestamps of dropped frames */
+	int n_drop;			/**< Number of dropped frames */
+	int drop_size;			/**< Space for dropped frames */
 
-free:
-	if (dec_ctx != NULL)
-		avcodec_close(dec_ctx);
-	if (fmt_ctx != NULL)
-		avformat_close_input(&fmt_ctx);
+	struct chunk *chunk;		/**< Chunk being compared, or NULL */
+	struct stitch *stitch;		/**< Kept frame files, or NULL */
 
-	return res;
-}
+	struct resume *resume;		/**< Checkpointing, or NULL */
+	uint64_t checkpoint_next;	/**< When a checkpoint is due (ns) */
+	int64_t resume_pts;		/**< Frame to carry on from, if any */
+};
 
 
-int main(int argc, char *argv[])
+/** Note a dropped frame's timestamp, for remuxing */
+static bool drop_add(struct excise_state *st, int64_t pts)
 {
-	bool ok;
-	int a;
+	if (pts == AV_NOPTS_VALUE)
+		return true;
+
+	if (st->n_drop == st->drop_size) {
+		int size = st->drop_size ? st->drop_size * 2 : 1024;
+		int64_t *drop = realloc(st->drop, size * sizeof(*drop));
+
+		if (drop == NULL)
+			return false;
+		st->drop = drop;
+		st->drop_size = size;
+	}
+
+	st->drop[st->n_drop++] = pts;
+
+	return true;
+}
+
+
+/** Order timestamps for qsort */
+static int pts_cmp(const void *a, const void *b)
+{
+	int64_t pa = *(const int64_t *)a;
+	int64_t pb = *(const int64_t *)b;
+
+	return (pa > pb) - (pa < pb);
+}
+
+
+/**
+ * Where the writer stage puts an input's PNGs
+ *
+ * The writer stage may be shared with other inputs, so the input's own
+ * frames are counted until they're written.
+ */
+struct png_output {
+	const char *output_path;	/**< Output path */
+	int path_len;		/**< Length of output path, without ".png" */
+	struct pack *pack;	/**< Pack to put PNGs in, or NULL for files */
+	pthread_mutex_t lock;
+	pthread_cond_t written;
+	int unwritten;		/**< Frames sent to the writer, not written */
+};
+
+
+/** Set up where an input's PNGs go */
+static void png_output_init(struct png_output *out, const struct input *in)
+{
+	out->output_path = in->output_path;
+	out->path_len = in->path_len;
+	out->pack = NULL;
+	pthread_mutex_init(&out->lock, NULL);
+	pthread_cond_init(&out->written, NULL);
+	out->unwritten = 0;
+}
+
+
+/** Count frames sent to the writer for an input, or written, if negative */
+static void png_output_count(struct png_output *out, int n)
+{
+	pthread_mutex_lock(&out->lock);
+	out->unwritten += n;
+	if (out->unwritten == 0)
+		pthread_cond_broadcast(&out->written);
+	pthread_mutex_unlock(&out->lock);
+}
+
+
+/** Wait for every frame sent to the writer for an input to be written */
+static void png_output_wait(struct png_output *out)
+{
+	pthread_mutex_lock(&out->lock);
+	while (out->unwritten > 0)
+		pthread_cond_wait(&out->written, &out->lock);
+	pthread_mutex_unlock(&out->lock);
+}
+
+
+/** Free where an input's PNGs went, once they're all written */
+static void png_output_fini(struct png_output *out)
+{
+	pthread_cond_destroy(&out->written);
+	pthread_mutex_destroy(&out->lock);
+}
+
+
+/** Save a kept frame, and its copies, as PNG files */
+static void write_png_files(const struct png_output *out,
+		const struct write_job *job, const struct png_buf *buf)
+{
+	char file_name[out->path_len + sizeof("00000000.png") + 8];
+	char copy_name[sizeof(file_name)];
+	bool ok;
+	int i;
+
+	sprintf(file_name, "%.*s%.08i.png", out->path_len,
+			out->output_path, job->index);
+	ok = png_buf_save(buf, file_name);
+
+	/* Frames the same as this one can share its file, where the file
+	 * system lets them */
+	for (i = 1; i <= job->copies; i++) {
+		sprintf(copy_name, "%.*s%.08i.png", out->path_len,
+				out->output_path, job->index + i);
+		unlink(copy_name);
+		if (!ok || link(file_name, copy_name) < 0)
+			png_buf_save(buf, copy_name);
+	}
+}
+
+
+/** Add a kept frame, and its copies, to the pack */
+static void write_png_pack(const struct png_output *out,
+		const struct write_job *job, const struct png_buf *buf)
+{
+	char name[sizeof("00000000.png") + 8];
+	char copy_name[sizeof(name)];
+	int i;
+
+	sprintf(name, "%.08i.png", job->index);
+	if (!pack_add(out->pack, name, buf->data, buf->len))
+		return;
+
+	for (i = 1; i <= job->copies; i++) {
+		sprintf(copy_name, "%.08i.png", job->index + i);
+		pack_link(out->pack, copy_name, name);
+	}
+}
+
+
+/**
+ * Writer stage: save a kept frame as a PNG
+ *
+ * There may be several writer threads, so frames can be written in any
+ * order, but each one's file name comes from the number it was given.
+ * The PNG is encoded once, whatever number of copies it's written as.
+ * In batch mode the writer threads are shared, so each frame says which
+ * input's output it goes in.
+ */
+static void write_stage_process(void *ctx, void *item)
+{
+	struct write_job *job = item;
+	struct png_output *out = job->out;
+	struct png_buf buf = { NULL, 0, 0 };
+	uint64_t t = stats_start();
+
+	if (image_encode_png(&buf, job->image->frame,
+			job->image->frame->width, job->image->frame->height,
+			options.png)) {
+		if (out->pack != NULL)
+			write_png_pack(out, job, &buf);
+		else
+			write_png_files(out, job, &buf);
+	}
+	png_buf_free(&buf);
+	stats_end(STATS_WRITE, t);
+
+	image_unref(job->image);
+	png_output_count(out, -1);
+}
+
+
+/**
+ * Encoder stage: encode a kept frame into the output video
+ *
+ * This must only have one thread, so frames reach the encoder in order.
+ */
+static void encode_stage_process(void *ctx, void *item)
+{
+	struct encoder *encoder = ctx;
+	struct write_job *job = item;
+	uint64_t t = stats_start();
+	int i;
+
+	for (i = 0; i <= job->copies; i++)
+		encoder_write(encoder, job->image->frame, job->index + i);
+	stats_end(STATS_WRITE, t);
+
+	image_unref(job->image);
+}
+
+
+/** Send splash screen frames to the encoder */
+static int encode_splash(const char *splash, struct stage *writer,
+		AVRational *fps, int w, int h, size_t image_size)
+{
+	struct image *img;
+	int i;
+	int lim = (options.splash * fps->num) / (SECOND_IN_CS * fps->den);
+
+	img = image_read_png(splash, w, h);
+	if (img == NULL) {
+		LOG(LOG_INFO, "Could not read splash image %s\n", splash);
+		return 0;
+	}
+
+	for (i = 0; i < lim; i++) {
+		struct write_job job;
+
+		job.image = image_ref(img);
+		job.index = i;
+		job.copies = 0;
+		job.out = NULL;
+		if (!stage_send_cost(writer, &job, image_size)) {
+			LOG(LOG_ERROR, "Could not pass splash frame to writer\n");
+			image_unref(job.image);
+			break;
+		}
+	}
+	image_unref(img);
+
+	LOG(LOG_INFO, "Splash frames: %i\n", i);
+
+	return i;
+}
+
+
+/** Make sure image_prev holds the last different frame, in RGB */
+static bool image_prev_rgb(struct excise_state *st)
+{
+	if (!st->native_stale)
+		return true;
+
+	if (!image_make_writable(&st->image_prev, &st->pool)) {
+		LOG(LOG_ERROR, "Could not allocate frame for "
+				"rgb conversion\n");
+		st->failed = true;
+		return false;
+	}
+	frame_to_rgb(&st->img_convert_ctx, st->frame_native,
+			st->pix_fmt, st->w, st->h, st->image_prev->frame);
+	st->native_stale = false;
+
+	return true;
+}
+
+
+/** Space needed for output and temporary file names */
+#define FILE_NAME_LEN(path_len) ((path_len) + 64)
+
+
+/** Get the name of the temporary file for a different frame */
+static void tmp_file_name(char *file_name, const char *output_path,
+		int path_len, int64_t pts)
+{
+	sprintf(file_name, "%.*stmp-%"PRId64".png", path_len,
+			output_path, pts);
+}
+
+
+/** Save the last different frame to its temporary file */
+static bool tmp_file_write(struct excise_state *st, const char *output_path,
+		int path_len, int64_t pts)
+{
+	char file_name[FILE_NAME_LEN(path_len)];
+	uint64_t t;
+	bool ok;
+
+	if (!image_prev_rgb(st))
+		return false;
+
+	t = stats_start();
+	tmp_file_name(file_name, output_path, path_len, pts);
+	ok = image_write_png(file_name, st->image_prev->frame,
+			st->w, st->h, options.png);
+	stats_end(STATS_WRITE, t);
+	if (!ok) {
+		LOG(LOG_ERROR, "Could not write %s\n", file_name);
+		st->failed = true;
+		return false;
+	}
+
+	return true;
+}
+
+
+/** Note whether a chunk's frame differed, saving it if it did */
+static bool chunk_add(struct chunk *c, struct excise_state *st,
+		int64_t pts, bool different)
+{
+	if (c->count == c->size) {
+		int size = c->size ? c->size * 2 : 1024;
+		int64_t *p = realloc(c->pts, size * sizeof(*p));
+		bool *d;
+
+		if (p == NULL)
+			goto error;
+		c->pts = p;
+
+		d = realloc(c->different, size * sizeof(*d));
+		if (d == NULL)
+			goto error;
+		c->different = d;
+
+		c->size = size;
+	}
+
+	c->pts[c->count] = pts;
+	c->different[c->count] = different;
+	c->count++;
+	st->frames++;
+
+	if (different && c->write)
+		return tmp_file_write(st, c->output_path, c->path_len, pts);
+
+	return true;
+
+error:
+	LOG(LOG_ERROR, "Could not allocate chunk frame list\n");
+	st->failed = true;
+	return false;
+}
+
+
+/** Note that a frame differed, so kept frames now show it */
+static void stitch_set(struct stitch *s, int64_t pts)
+{
+	tmp_file_name(s->file, s->output_path, s->path_len, pts);
+	s->moved = false;
+}
+
+
+/**
+ * Output the last different frame as a kept frame
+ *
+ * The first time, its temporary file is renamed.  After that, outputs are
+ * linked to the first.
+ */
+static bool stitch_write(struct stitch *s, int index)
+{
+	char file_name[FILE_NAME_LEN(s->path_len)];
+
+	sprintf(file_name, "%.*s%.08i.png", s->path_len, s->output_path,
+			index);
+
+	if (s->moved) {
+		if (link(s->file, file_name) < 0) {
+			LOG(LOG_ERROR, "Could not link %s to %s\n",
+					s->file, file_name);
+			return false;
+		}
+	} else {
+		if (rename(s->file, file_name) < 0) {
+			LOG(LOG_ERROR, "Could not rename %s to %s\n",
+					s->file, file_name);
+			return false;
+		}
+		strcpy(s->file, file_name);
+		s->moved = true;
+	}
+
+	return true;
+}
+
+
+/** Find the time a frame is shown, from its timestamp if it has one */
+static double frame_time(const struct excise_state *st, int64_t pts)
+{
+	if (pts == AV_NOPTS_VALUE)
+		return st->frames * av_q2d(av_inv_q(st->fps));
+
+	return pts * av_q2d(st->time_base);
+}
+
+
+/**
+ * Send the kept frame waiting for its copies, if any, to the writer
+ *
+ * \return true on success, or false if the writer wouldn't take it
+ */
+static bool writer_flush(struct excise_state *st)
+{
+	bool ok;
+
+	if (st->pending.image == NULL)
+		return true;
+
+	if (st->pending.out != NULL)
+		png_output_count(st->pending.out, 1);
+	ok = stage_send_cost(st->writer, &st->pending, st->image_size);
+	if (!ok) {
+		LOG(LOG_ERROR, "Could not pass frame to writer\n");
+		image_unref(st->pending.image);
+		if (st->pending.out != NULL)
+			png_output_count(st->pending.out, -1);
+		st->failed = true;
+	}
+	st->pending.image = NULL;
+
+	return ok;
+}
+
+
+/**
+ * Save a checkpoint at a different frame, if one is due
+ *
+ * Everything sent to the writer is written first, so a run carrying on
+ * from the checkpoint has all the frames before it.
+ *
+ * \param st   Compare stage state, with nothing pending for the writer
+ * \param pts  Different frame's timestamp, in stream time base
+ */
+static void checkpoint_take(struct excise_state *st, int64_t pts)
+{
+	struct checkpoint cp;
+	uint64_t now;
+
+	if (st->resume == NULL || st->resume->file_name == NULL ||
+			pts == AV_NOPTS_VALUE)
+		return;
+
+	now = stats_now();
+	if (now < st->checkpoint_next)
+		return;
+	st->checkpoint_next = now + st->resume->interval;
+
+	stage_drain(st->writer);
+	cp.pts = pts;
+	cp.frames = st->frames;
+	cp.out_frames = st->out_frames;
+	if (!checkpoint_save(&cp, st->resume->file_name, st->resume->key)) {
+		LOG(LOG_WARNING, "Warning: can't save checkpoint: '%s'\n",
+				st->resume->file_name);
+	} else {
+		LOG(LOG_DEBUG, "Checkpoint at frame %i\n", st->frames);
+	}
+}
+
+
+/**
+ * Decide whether to keep a frame, and pass it on if we do
+ *
+ * \param st         Compare stage state
+ * \param different  Whether the frame differs from the last different one
+ * \param pts        Frame's timestamp, in stream time base
+ * \return true on success, else false
+ */
+static bool decide_frame(struct excise_state *st, bool different,
+		int64_t pts)
+{
+	int s1, s2, m1, m2, h1, h2;
+	bool write_frame;
+
+	/* Note what the comparison found, for later runs */
+	if (st->cache != NULL && !cache_add(st->cache, different, pts)) {
+		LOG(LOG_ERROR, "Could not allocate difference cache\n");
+		st->failed = true;
+		return false;
+	}
+
+	if (different) {
+		/* This frame has something new */
+		LOG(LOG_DEBUG, "%i: Different\n", st->frames);
+
+		if (st->skip > st->slack) {
+			/* Log which frames got skipped */
+			int f1 = st->frames - (st->skip - st->slack);
+			int f2 = st->frames;
+
+			get_times(f1, f2, &st->fps,
+					&s1, &m1, &h1, &s2, &m2, &h2);
+			LOG(LOG_INFO, "Skip frames %i to %i ", f1, f2);
+			LOG(LOG_INFO, "(%.2i:%.2i:%.2i - %.2i:%.2i:%.2i)\n",
+					h1, m1, s1, h2, m2, s2);
+		}
+
+	} else {
+		/* Frames are the same */
+		LOG(LOG_DEBUG, "%i: Same\n", st->frames);
+	}
+
+	/* Frames are kept until they've been the same for the slack, the
+	 * same way the library decides */
+	write_frame = ebb_slack_keep(&st->skip, st->slack, different);
+
+	/* When analysing, nothing is written; we just note the decision */
+	if (st->analyze) {
+		if (!edl_add(&st->edl, write_frame, st->frames, pts,
+				frame_time(st, pts))) {
+			LOG(LOG_ERROR, "Could not allocate edit decision "
+					"list\n");
+			st->failed = true;
+			return false;
+		}
+		if (write_frame)
+			st->out_frames++;
+
+	/* When putting chunks together, kept frames are already saved */
+	} else if (st->stitch != NULL) {
+		if (write_frame) {
+			if (!stitch_write(st->stitch, st->out_frames)) {
+				st->failed = true;
+				return false;
+			}
+			st->out_frames++;
+		}
+
+	/* Raw frames are cheap to write, so go straight out, in the
+	 * decoder's format */
+	} else if (st->raw != NULL) {
+		if (write_frame) {
+			uint64_t t = stats_start();
+			bool ok = raw_write(st->raw, st->frame_native);
+
+			stats_end(STATS_WRITE, t);
+			if (!ok) {
+				st->failed = true;
+				return false;
+			}
+			st->out_frames++;
+		}
+
+	/* When remuxing, nothing is written here; we just note what to
+	 * leave out */
+	} else if (st->writer == NULL) {
+		if (!write_frame && !drop_add(st, pts)) {
+			LOG(LOG_ERROR, "Could not allocate drop list\n");
+			st->failed = true;
+			return false;
+		}
+		if (write_frame)
+			st->out_frames++;
+
+	/* A kept frame the same as the last one goes with it, so it can
+	 * share its file rather than be compressed again */
+	} else if (write_frame && !different && st->pending.image != NULL) {
+		st->pending.copies++;
+		st->out_frames++;
+
+	/* Otherwise pass the last different frame to the writer, if we've
+	 * decided to keep it, once we know how many copies it needs */
+	} else {
+		if (!writer_flush(st))
+			return false;
+		if (different)
+			checkpoint_take(st, pts);
+		if (write_frame) {
+			if (!image_prev_rgb(st))
+				return false;
+
+			st->pending.image = image_ref(st->image_prev);
+			st->pending.index = st->out_frames;
+			st->pending.copies = 0;
+			st->out_frames++;
+		}
+	}
+
+	st->frames++;
+	if (write_frame)
+		stats_count(&stats.frames_out, 1);
+
+	return true;
+}
+
+
+/**
+ * Find a frame's number from its timestamp
+ *
+ * \return the frame number, or the current frame count if the frame has
+ *         no timestamp
+ */
+static int frame_index(struct excise_state *st, int64_t pts)
+{
+	if (pts == AV_NOPTS_VALUE)
+		return st->frames;
+
+	if (st->start_pts == AV_NOPTS_VALUE)
+		st->start_pts = pts;
+
+	return av_rescale_q(pts - st->start_pts, st->time_base,
+			av_inv_q(st->fps));
+}
+
+
+/**
+ * Compare a frame with the last different one
+ *
+ * If it differs, it becomes the new last different frame.  The comparison
+ * itself is shared with libebb.
+ *
+ * \param st     Compare stage state
+ * \param frame  Frame in the decoder's pixel format
+ * \param force  Whether to treat the frame as different regardless
+ * \return 1 if the frame differs, 0 if not, or -1 on error
+ */
+static int compare_frame(struct excise_state *st, AVFrame *frame, bool force)
+{
+	const bool rgb = compare_in_rgb(&st->cmp);
+	struct image *image_tmp;
+
+	/* The writer may still hold the last image we converted into */
+	if (rgb && !image_make_writable(&st->image_curr, &st->pool)) {
+		LOG(LOG_ERROR, "Could not allocate frame for "
+				"rgb conversion\n");
+		st->failed = true;
+		return -1;
+	}
+
+	/* In RGB24, there's only a native copy for raw output, which
+	 * needs the decoder's format */
+	if (!compare_next(&st->cmp, &st->img_convert_ctx, frame,
+			st->frame_native, st->image_prev->frame,
+			st->image_curr->frame, force))
+		return 0;
+
+	/* Natively, the last different frame is only converted to RGB
+	 * when it's written */
+	if (rgb) {
+		image_tmp = st->image_prev;
+		st->image_prev = st->image_curr;
+		st->image_curr = image_tmp;
+	} else {
+		st->native_stale = true;
+	}
+
+	return 1;
+}
+
+
+/**
+ * Find whether a frame differs from the last different one, without it
+ * becoming the last different frame
+ *
+ * \param st     Compare stage state
+ * \param frame  Frame in the decoder's pixel format
+ * \return 1 if the frame differs, 0 if not, or -1 on error
+ */
+static int compare_frame_peek(struct excise_state *st, AVFrame *frame)
+{
+	if (st->cmp.scale > 1)
+		return compare_scaled_peek(&st->cmp, frame);
+
+	if (st->cmp.native)
+		return compare_peek(&st->cmp, st->frame_native, frame);
+
+	if (!image_make_writable(&st->image_curr, &st->pool)) {
+		LOG(LOG_ERROR, "Could not allocate frame for "
+				"rgb conversion\n");
+		st->failed = true;
+		return -1;
+	}
+	frame_to_rgb(&st->img_convert_ctx, frame, st->pix_fmt,
+			st->w, st->h, st->image_curr->frame);
+
+	return compare_peek(&st->cmp, st->image_prev->frame,
+			st->image_curr->frame);
+}
+
+
+/** Let go of the frames held back for sparse comparison */
+static void sparse_release(struct excise_state *st)
+{
+	int i;
+
+	for (i = 0; i < st->n_held; i++)
+		image_unref(st->held[i].image);
+	st->n_held = 0;
+}
+
+
+/**
+ * Decide on the frames held back while comparing sparsely
+ *
+ * The last held frame is compared first.  If it's the same as the last
+ * different frame, so are the ones before it.  Otherwise the first one
+ * that differs is found by bisection, which assumes that once a change
+ * appears it stays until the next comparison.  That frame becomes the last
+ * different frame, and the frames after it are dealt with in the same way.
+ *
+ * \param st  Compare stage state
+ * \return true on success, else false
+ */
+static bool sparse_resolve(struct excise_state *st)
+{
+	int first = 0;
+	int lo, hi, mid, i, d;
+
+	while (first < st->n_held && !st->failed) {
+		/* Find the first frame that differs, or n_held if none do */
+		lo = first;
+		hi = st->n_held - 1;
+		d = compare_frame_peek(st, st->held[hi].frame);
+		if (d < 0)
+			break;
+		if (d == 0)
+			lo = hi = st->n_held;
+		while (lo < hi) {
+			mid = lo + (hi - lo) / 2;
+			d = compare_frame_peek(st, st->held[mid].frame);
+			if (d < 0)
+				break;
+			if (d)
+				hi = mid;
+			else
+				lo = mid + 1;
+		}
+		if (d < 0)
+			break;
+
+		for (i = first; i < lo; i++) {
+			if (!decide_frame(st, false, st->held[i].pts))
+				break;
+		}
+		if (lo == st->n_held || st->failed)
+			break;
+
+		LOG(LOG_DEBUG, "%i: Found by bisection\n", st->frames);
+		if (compare_frame(st, st->held[lo].frame, true) < 0 ||
+				!decide_frame(st, true, st->held[lo].pts))
+			break;
+		first = lo + 1;
+	}
+
+	sparse_release(st);
+	return !st->failed;
+}
+
+
+/**
+ * Hold a frame back to compare later, if frames are being compared
+ * sparsely
+ *
+ * Once enough frames in a row have been the same, only every st->sparse
+ * frame is compared, and the frames in between are decided on with it.
+ *
+ * \param st  Compare stage state
+ * \param df  Decoded frame, which must be a copy
+ * \return true if the frame was held, or false to compare it now
+ */
+static bool sparse_hold(struct excise_state *st,
+		const struct decoded_frame *df)
+{
+	if (st->sparse < 2 || df->image == NULL ||
+			(st->n_held == 0 && st->skip < SPARSE_IDLE))
+		return false;
+
+	st->held[st->n_held] = *df;
+	st->held[st->n_held].image = image_ref(df->image);
+	st->n_held++;
+	if (st->n_held == st->sparse)
+		sparse_resolve(st);
+
+	return true;
+}
+
+
+/**
+ * Find whether a frame's packet shows it has no changes, so needn't be
+ * compared
+ *
+ * The first few static looking frames are compared anyway, and then
+ * every so often, and any that turn out to differ lower the size that's
+ * taken as static.
+ *
+ * \param st  Compare stage state
+ * \param df  Decoded frame
+ * \return true to skip comparison, or false to compare the frame
+ */
+static bool packet_is_static(struct excise_state *st,
+		const struct decoded_frame *df)
+{
+	if (options.detect != DETECT_PACKETS || df->pkt_size < 0 ||
+			df->pkt_key || df->pkt_size > st->static_bytes ||
+			st->frames == 0)
+		return false;
+
+	st->static_seen++;
+	return st->static_seen > STATIC_CHECK_FRAMES &&
+			st->static_seen % STATIC_VERIFY_INTERVAL != 0;
+}
+
+
+/** Learn from a small packet's frame that differed after all */
+static void packet_differed(struct excise_state *st,
+		const struct decoded_frame *df)
+{
+	if (options.detect != DETECT_PACKETS || df->pkt_size < 0 ||
+			df->pkt_key || df->pkt_size > st->static_bytes)
+		return;
+
+	st->static_bytes = df->pkt_size - 1;
+	LOG(LOG_DEBUG, "Static packets are now up to %i bytes\n",
+			st->static_bytes);
+}
+
+
+/** Compare stage: decide whether to keep a decoded frame */
+static void compare_stage_process(void *ctx, void *item)
+{
+	struct excise_state *st = ctx;
+	struct decoded_frame *df = item;
+	AVFrame *frame = df->frame;
+	bool force = st->frames == 0;
+	int different;
+
+	if (st->failed)
+		goto done;
+	if (st->key_skip && st->start_pts == AV_NOPTS_VALUE)
+		st->start_pts = df->pts;
+
+	/* When carrying on from a checkpoint, the frames before it are
+	 * done, and it's taken as different, like a first frame */
+	if (st->resume_pts != AV_NOPTS_VALUE) {
+		if (df->pts == AV_NOPTS_VALUE || df->pts < st->resume_pts)
+			goto done;
+		st->resume_pts = AV_NOPTS_VALUE;
+		force = true;
+	}
+
+	/* A keyframe skipped to in a long pause either shows that nothing
+	 * changed, so the frames skipped didn't either, or sends the
+	 * decoder back to decode them */
+	if (df->probe) {
+		different = compare_frame_peek(st, frame);
+		if (different < 0)
+			goto done;
+		if (different) {
+			LOG(LOG_DEBUG, "%i: Keyframe differs\n", st->frames);
+			st->rewind = true;
+			goto done;
+		}
+
+		while (st->frames < frame_index(st, df->pts)) {
+			if (!decide_frame(st, false, AV_NOPTS_VALUE))
+				goto done;
+		}
+		decide_frame(st, false, df->pts);
+		goto done;
+	}
+
+	/* After a long pause, frames can be compared a few at a time */
+	if (!force && sparse_hold(st, df))
+		goto done;
+
+	/* Only keyframes are decoded, so take the frames since the last
+	 * one to be the same as it */
+	if (st->keyframes) {
+		int index = frame_index(st, df->pts);
+
+		while (st->frames < index) {
+			if (!decide_frame(st, false, AV_NOPTS_VALUE))
+				goto done;
+		}
+	}
+
+	if (!force && packet_is_static(st, df)) {
+		different = 0;
+	} else {
+		different = compare_frame(st, frame, force);
+		if (different < 0)
+			goto done;
+		if (different && st->frames > 0)
+			packet_differed(st, df);
+	}
+
+	/* Chunk workers just note what they found, as what to keep
+	 * depends on what came before the chunk */
+	if (st->chunk != NULL) {
+		chunk_add(st->chunk, st, df->pts, different);
+		goto done;
+	}
+
+	decide_frame(st, different, df->pts);
+
+done:
+	if (st->key_skip)
+		__sync_lock_test_and_set(&st->idle, st->skip >= SPARSE_IDLE);
+	image_unref(df->image);
+}
+
+
+/**
+ * Make a map of the pixels to compare, at the comparison size
+ *
+ * Pixels are compared if they're in any include rectangle, or there are
+ * none, and in no exclude rectangle, and if they're light in the mask
+ * image, if there is one.  Rectangles are in full size pixels, and the
+ * mask is scaled to fit.
+ *
+ * \return newly allocated map, or NULL on failure
+ */
+static uint8_t *roi_map(int w, int h, int scale)
+{
+	struct image *mask = NULL;
+	bool includes = false;
+	uint8_t *map;
+	int x, y, i;
+
+	map = malloc(w * h);
+	if (map == NULL) {
+		LOG(LOG_ERROR, "Could not allocate region of interest\n");
+		return NULL;
+	}
+
+	if (options.mask != NULL) {
+		mask = image_read_png(options.mask, w, h);
+		if (mask == NULL) {
+			LOG(LOG_ERROR, "Could not read mask: '%s'\n",
+					options.mask);
+			free(map);
+			return NULL;
+		}
+	}
+
+	for (i = 0; i < options.n_rects; i++)
+		includes |= options.rects[i].include;
+
+	for (y = 0; y < h; y++) {
+		const int fy = y * scale + scale / 2;
+
+		for (x = 0; x < w; x++) {
+			const int fx = x * scale + scale / 2;
+			bool in = !includes;
+			bool out = false;
+
+			for (i = 0; i < options.n_rects; i++) {
+				const struct roi_rect *r = &options.rects[i];
+
+				if (fx < r->x || fx >= r->x + r->w ||
+						fy < r->y || fy >= r->y + r->h)
+					continue;
+				if (r->include)
+					in = true;
+				else
+					out = true;
+			}
+
+			if (in && !out && mask != NULL) {
+				const uint8_t *p = mask->frame->data[0] +
+						y * mask->frame->linesize[0] +
+						x * 3;
+
+				in = p[0] + p[1] + p[2] > 3 * 127;
+			}
+
+			map[y * w + x] = in && !out;
+		}
+	}
+
+	image_unref(mask);
+	return map;
+}
+
+
+/**
+ * Find the largest packet to take as a frame with no changes
+ *
+ * An encoder codes a macroblock with no changes in a fraction of a bit, so
+ * a frame with no changes is mostly its headers.  The default allows about
+ * a byte per hundred macroblocks, on top of headers.
+ */
+static int static_packet_bytes(int w, int h)
+{
+	int mbs = ((w + 15) / 16) * ((h + 15) / 16);
+
+	if (options.static_packet > 0)
+		return options.static_packet;
+
+	return 24 + mbs / 128;
+}
+
+
+/**
+ * Set up the state for comparing the frames of a video stream
+ *
+ * On failure, what was set up must still be freed with excise_state_fini().
+ *
+ * \param st       State to set up
+ * \param dec_ctx  Decoder of the stream
+ * \param pix_fmt  Pixel format frames are compared in
+ * \param vs       Video stream
+ * \return true on success, else false
+ */
+static bool excise_state_init(struct excise_state *st,
+		AVCodecContext *dec_ctx, enum PixelFormat pix_fmt, AVStream *vs)
+{
+	const struct compare_settings settings = {
+		options.compare, options.tolerance, options.size,
+		options.votes, options.border, options.compare_scale
+	};
+
+	memset(st, 0, sizeof(*st));
+	st->pix_fmt = pix_fmt;
+	st->w = dec_ctx->width;
+	st->h = dec_ctx->height;
+	st->fps = vs->avg_frame_rate;
+	st->time_base = vs->time_base;
+	st->start_pts = AV_NOPTS_VALUE;
+	st->resume_pts = AV_NOPTS_VALUE;
+	st->keyframes = options.keyframes;
+	st->analyze = options.analyze;
+	st->static_bytes = static_packet_bytes(st->w, st->h);
+	st->sparse = options.sparse;
+	st->key_skip = options.sparse_key;
+	edl_init(&st->edl, av_q2d(av_inv_q(st->fps)));
+	st->slack = ebb_slack_frames(options.slack, vs->avg_frame_rate);
+
+	/* Set up the comparison, natively and downscaled if they were
+	 * asked for and are possible */
+	if (!compare_init(&st->cmp, &settings, st->pix_fmt, st->w, st->h)) {
+		LOG(LOG_ERROR, "Could not allocate frame comparison\n");
+		return false;
+	}
+	if (options.compare_scale > 1 && st->cmp.scale == 1) {
+		LOG(LOG_WARNING, "Warning: frames too small to compare "
+				"downscaled\n");
+	}
+
+	/* Kept frames can be written with 16 bits per channel, unless
+	 * every frame has to be converted to RGB24 to compare it */
+	st->rgb_fmt = PIX_FMT_RGB24;
+	if (options.png_depth == 16 && (st->cmp.native || st->cmp.scale > 1))
+		st->rgb_fmt = PIX_FMT_RGB48BE;
+	st->image_size = avpicture_get_size(st->rgb_fmt, st->w, st->h);
+
+	/* Allocate current and previous rgb frames */
+	image_pool_init(&st->pool, st->rgb_fmt, st->w, st->h);
+	st->pool_ready = true;
+	st->image_curr = image_pool_get(&st->pool);
+	st->image_prev = image_pool_get(&st->pool);
+	if (st->image_curr == NULL || st->image_prev == NULL) {
+		LOG(LOG_ERROR, "Could not allocate frame for rgb conversion\n");
+		return false;
+	}
+
+	/* Work out which neighbourhoods to check, if not all of them */
+	if (options.n_rects > 0 || options.mask != NULL) {
+		uint8_t *map = roi_map(st->cmp.cw, st->cmp.ch, st->cmp.scale);
+
+		if (map == NULL)
+			return false;
+		if (!compare_set_roi(&st->cmp, map)) {
+			LOG(LOG_ERROR, "Could not allocate region of "
+					"interest\n");
+			free(map);
+			return false;
+		}
+		free(map);
+	}
+
+	/* Allocate a copy of the last different frame, in decoder format */
+	if (st->cmp.native || st->cmp.scale > 1 || options.raw) {
+		st->frame_native = frame_alloc(st->pix_fmt, st->w, st->h);
+		if (st->frame_native == NULL) {
+			LOG(LOG_ERROR, "Could not allocate frame for "
+					"native comparison\n");
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+/** Free the state for comparing frames */
+static void excise_state_fini(struct excise_state *st)
+{
+	image_unref(st->image_curr);
+	image_unref(st->image_prev);
+	image_unref(st->pending.image);
+	if (st->pool_ready)
+		image_pool_fini(&st->pool);
+	frame_free(st->frame_native);
+	compare_fini(&st->cmp);
+	free(st->drop);
+	edl_fini(&st->edl);
+	if (st->img_convert_ctx != NULL) {
+		sws_freeContext(st->img_convert_ctx);
+	}
+}
+
+
+/** Length of an output path, without any ".png" */
+static int output_path_len(const char *output_path)
+{
+	int path_len = strlen(output_path);
+
+	if (path_len > 4 && strcmp(output_path + path_len - 4,
+			".png") == 0)
+		path_len -= 4;
+
+	return path_len;
+}
+
+
+/** Whether kept frames are written out, rather than just decided on */
+static bool writes_frames(void)
+{
+	return !options.remux && !options.analyze;
+}
+
+
+/**
+ * Flush the file system the output is on to disc
+ *
+ * One sync of the whole file system costs much less than syncing each of
+ * thousands of PNGs.
+ *
+ * \return true on success, else false
+ */
+static bool sync_output(const char *output_path)
+{
+	char *copy = strdup(output_path);
+	int fd = -1;
+	bool ok = false;
+
+	if (copy == NULL)
+		goto free;
+
+	fd = open(dirname(copy), O_RDONLY);
+	if (fd < 0 || syncfs(fd) < 0)
+		goto free;
+
+	ok = true;
+free:
+	if (!ok)
+		LOG(LOG_ERROR, "Could not flush output to disc: '%s'\n",
+				output_path);
+	if (fd >= 0)
+		close(fd);
+	free(copy);
+	return ok;
+}
+
+
+/**
+ * Produce the output for modes that only needed the keep or skip decisions
+ *
+ * When remuxing, the input is copied, leaving out the GOPs we don't need.
+ * When analysing, the decisions are written out.  Otherwise, the frames
+ * have already been written, and there's nothing to do.
+ *
+ * \return true on success, else false
+ */
+static bool finish_decisions(const struct input *in, struct excise_state *st,
+		int stream_id)
+{
+	if (options.remux) {
+		uint64_t t = stats_start();
+		bool ok;
+
+		qsort(st->drop, st->n_drop, sizeof(*st->drop), pts_cmp);
+		ok = remux(in->input_path, in->output_path,
+				stream_id, st->drop, st->n_drop);
+		stats_end(STATS_WRITE, t);
+		return ok;
+	}
+
+	if (options.analyze)
+		return edl_write(&st->edl, in->output_path,
+				options.edl_format);
+
+	return true;
+}
+
+
+/**
+ * Report how many frames were kept
+ *
+ * In batch mode the input is named, all in one line, so results of
+ * inputs finishing together don't get mixed up.
+ */
+static void log_result(const struct input *in, struct excise_state *st)
+{
+	const bool batch = options.batch != NULL || options.manifest != NULL;
+	int s1, s2, m1, m2, h1, h2;
+
+	get_times(st->frames, st->out_frames, &st->fps,
+			&s1, &m1, &h1, &s2, &m2, &h2);
+	LOG(LOG_RESULT, "%s%sFrames %i --> %i "
+			"(%.2i:%.2i:%.2i --> %.2i:%.2i:%.2i)\n",
+			batch ? in->input_path : "", batch ? ": " : "",
+			st->frames, st->out_frames, h1, m1, s1, h2, m2, s2);
+}
+
+
+/** Read the next packet of the input, counting the time it takes */
+static bool read_packet(AVFormatContext *fmt_ctx, AVPacket *pkt)
+{
+	uint64_t t = stats_start();
+	bool ok = av_read_frame(fmt_ctx, pkt) >= 0;
+
+	stats_end(STATS_DEMUX, t);
+	return ok;
+}
+
+
+/**
+ * Skipping to keyframes during long pauses
+ *
+ * Once the compare stage has found enough frames in a row the same, the
+ * decoder only decodes keyframes.  Each is compared as it comes.  If one
+ * differs, the decoder goes back to the last frame decided on and
+ * decodes every frame from there, to find where the change started.
+ */
+struct key_skip {
+	bool skipping;		/**< Whether only keyframes are decoded */
+	bool probed;		/**< Whether a keyframe skipped to was sent */
+	int64_t last_pts;	/**< Timestamp of last frame decided on */
+	int64_t probe_pts;	/**< Timestamp of keyframe skipped to */
+	int64_t replay_pts;	/**< Frames up to here were decided on, or
+				 *   AV_NOPTS_VALUE */
+	int64_t hold_pts;	/**< Keyframe that differed, which must be
+				 *   passed before skipping again */
+};
+
+
+/** Set up skipping to keyframes */
+static void key_skip_init(struct key_skip *ks)
+{
+	ks->skipping = false;
+	ks->probed = false;
+	ks->last_pts = AV_NOPTS_VALUE;
+	ks->probe_pts = AV_NOPTS_VALUE;
+	ks->replay_pts = AV_NOPTS_VALUE;
+	ks->hold_pts = AV_NOPTS_VALUE;
+}
+
+
+/**
+ * Start or stop skipping to keyframes, once a frame has been decoded
+ *
+ * A keyframe that was skipped to is waited on, and if it differed, the
+ * input is seeked back to the last frame decided on.
+ *
+ * \param ks       Keyframe skipping state
+ * \param st       Compare stage state
+ * \param compare  Compare stage
+ * \return true if the input was seeked back, else false
+ */
+static bool key_skip_update(struct key_skip *ks, struct excise_state *st,
+		AVFormatContext *fmt_ctx, AVCodecContext *dec_ctx,
+		int stream_id, struct stage *compare)
+{
+	bool skip;
+
+	if (ks->probed) {
+		ks->probed = false;
+		stage_drain(compare);
+		if (!st->rewind) {
+			ks->last_pts = ks->probe_pts;
+		} else {
+			st->rewind = false;
+			LOG(LOG_DEBUG, "Going back to decode every frame\n");
+			if (av_seek_frame(fmt_ctx, stream_id, ks->last_pts,
+					AVSEEK_FLAG_BACKWARD) < 0) {
+				LOG(LOG_ERROR, "Could not seek back to "
+						"a change\n");
+				st->failed = true;
+				return false;
+			}
+			avcodec_flush_buffers(dec_ctx);
+			ks->replay_pts = ks->last_pts;
+			ks->hold_pts = ks->probe_pts;
+			ks->skipping = false;
+			dec_ctx->skip_frame = AVDISCARD_DEFAULT;
+			return true;
+		}
+	}
+
+	skip = __sync_fetch_and_add(&st->idle, 0) &&
+			ks->last_pts != AV_NOPTS_VALUE &&
+			(ks->hold_pts == AV_NOPTS_VALUE ||
+			ks->last_pts >= ks->hold_pts);
+	if (skip != ks->skipping) {
+		LOG(LOG_DEBUG, "%s\n", skip ? "Skipping to keyframes" :
+				"Decoding every frame");
+		ks->skipping = skip;
+		dec_ctx->skip_frame = skip ? AVDISCARD_NONKEY :
+				AVDISCARD_DEFAULT;
+	}
+
+	return false;
+}
+
+
+/**
+ * Decode a packet, and send any frame it completes to the compare stage
+ *
+ * \param sizes  Where to note packet sizes, or NULL
+ * \param ks     Keyframe skipping state, or NULL
+ * \return 1 if a frame was decoded, 0 if not, or negative on error,
+ *         which is AVERROR(EPIPE) if the compare stage wouldn't take it
+ */
+static int decode_packet(const struct input *in, AVCodecContext *dec_ctx,
+		AVFrame *frame, AVPacket *pkt, struct stage *compare,
+		struct image_pool *pool, struct packet_log *sizes,
+		struct key_skip *ks)
+{
+	struct decoded_frame df;
+	uint64_t t = stats_start();
+	int got_frame = 0;
+	int ret;
+
+	if (sizes != NULL)
+		packet_log_add(sizes, pkt);
+
+	ret = avcodec_decode_video2(dec_ctx, frame, &got_frame, pkt);
+	if (ret < 0) {
+		LOG(LOG_WARNING, "Warning: could not decode frame\n");
+		return ret;
+	}
+
+	if (!got_frame) {
+		stats_end(STATS_DECODE, t);
+		return 0;
+	}
+
+	/* After going back over a change, the frames already decided on
+	 * are decoded again, but not sent */
+	if (ks != NULL && ks->replay_pts != AV_NOPTS_VALUE) {
+		if (frame->pkt_pts != AV_NOPTS_VALUE &&
+				frame->pkt_pts <= ks->replay_pts) {
+			stats_end(STATS_DECODE, t);
+			return 1;
+		}
+		ks->replay_pts = AV_NOPTS_VALUE;
+	}
+	stats_count(&stats.frames_in, 1);
+
+	/* The decoder reuses its frames, so a threaded compare stage
+	 * needs its own copy, as do frames held back to compare sparsely.
+	 * Frames decoded on the GPU always need downloading to one. */
+	df.frame = frame;
+	df.image = NULL;
+	df.pts = frame->pkt_pts;
+	df.pkt_size = -1;
+	df.probe = false;
+	if (sizes != NULL)
+		packet_log_find(sizes, &df);
+	if (ks != NULL && ks->skipping && frame->key_frame &&
+			df.pts != AV_NOPTS_VALUE) {
+		df.probe = true;
+		ks->probed = true;
+		ks->probe_pts = df.pts;
+	} else if (ks != NULL && df.pts != AV_NOPTS_VALUE) {
+		ks->last_pts = df.pts;
+	}
+	if (compare->threaded || options.sparse > 1 || in->hwaccel != NULL) {
+		df.image = image_pool_get(pool);
+		if (df.image == NULL) {
+			LOG(LOG_ERROR, "Could not allocate decoded frame\n");
+			return AVERROR(ENOMEM);
+		}
+		df.frame = df.image->frame;
+	}
+
+	if (in->hwaccel != NULL) {
+		if (!hwaccel_download(dec_ctx, df.frame, frame)) {
+			image_unref(df.image);
+			return AVERROR(EIO);
+		}
+	} else if (df.image != NULL) {
+		av_picture_copy((AVPicture *)df.frame,
+				(const AVPicture *)frame, dec_ctx->pix_fmt,
+				dec_ctx->width, dec_ctx->height);
+	}
+	stats_end(STATS_DECODE, t);
+
+	if (!stage_send(compare, &df)) {
+		LOG(LOG_ERROR, "Could not pass frame to compare\n");
+		image_unref(df.image);
+		return AVERROR(EPIPE);
+	}
+
+	return 1;
+}
+
+
+bool excise_boring_bits(const struct input *in, AVFormatContext *fmt_ctx,
+		AVCodecContext *dec_ctx, int stream_id, AVStream *vs,
+		struct cache *cache, struct resume *resume)
+{
+	AVPacket pkt;
+	AVFrame *frame = NULL;
+	struct excise_state st;
+	struct image_pool decoded;
+	struct stage compare;
+	struct stage writer;
+	struct encoder *encoder = NULL;
+	struct raw_writer *raw = NULL;
+	struct png_output out;
+	struct packet_log packets;
+	struct packet_log *sizes = NULL;
+	struct key_skip skipper;
+	struct key_skip *ks = NULL;
+	bool compare_started = false;
+	bool writer_started = false;
+	const bool threaded = options.threads != 1;
+	bool res = false;
+	bool rewound;
+	int ret;
+	enum PixelFormat pix_fmt = in->hwaccel != NULL ?
+			HWACCEL_PIX_FMT : dec_ctx->pix_fmt;
+
+	/* Copies of decoded frames for the compare stage come from a pool,
+	 * as do its RGB images */
+	png_output_init(&out, in);
+	image_pool_init(&decoded, pix_fmt, dec_ctx->width, dec_ctx->height);
+	if (!excise_state_init(&st, dec_ctx, pix_fmt, vs))
+		goto free;
+	st.writer = writes_frames() && !options.raw ? &writer : NULL;
+	st.cache = cache;
+	st.resume = resume;
+	st.checkpoint_next = resume != NULL ?
+			stats_now() + resume->interval : 0;
+	if ((options.compare == COMPARE_LUMA ||
+			options.compare == COMPARE_YUV) && !st.cmp.native) {
+		LOG(LOG_WARNING, "Warning: can't compare %s frames "
+				"natively, using rgb\n",
+				av_get_pix_fmt_name(st.pix_fmt));
+	}
+	if (options.png_depth == 16 && st.rgb_fmt != PIX_FMT_RGB48BE) {
+		LOG(LOG_WARNING, "Warning: can't write 16-bit PNGs when "
+				"comparing in rgb, writing 8-bit\n");
+	}
+
+	/* Note packet sizes, if they're to tell us what's changed */
+	if (options.detect == DETECT_PACKETS) {
+		packet_log_init(&packets);
+		sizes = &packets;
+	}
+
+	/* Keep track of skipping to keyframes, if we're to */
+	if (options.sparse_key) {
+		key_skip_init(&skipper);
+		ks = &skipper;
+	}
+
+	/* Initialize decode packet */
+	av_init_packet(&pkt);
+	pkt.data = NULL;
+	pkt.size = 0;
+
+	/* Allocate frame for decoding into */
+	frame = avcodec_alloc_frame();
+	if (frame == NULL) {
+		LOG(LOG_ERROR, "Could not allocate frame\n");
+		goto free;
+	}
+
+	/* Start the stages after decoding: convert and compare, and then
+	 * output.  Compare gets a thread, and PNG writing gets a pool of
+	 * them, limited in how much image memory they may hold, unless
+	 * we're limited to one thread.  In batch mode the pool, and the
+	 * memory, are shared by every input being done.  An encoder needs
+	 * frames in order, so only gets one thread.  Remuxing happens once
+	 * we know which frames to drop, and analysing writes no frames, so
+	 * neither needs an output stage, and raw frames are written as
+	 * they're decided on. */
+	if (!writes_frames()) {
+		writer_started = true;
+	} else if (options.raw) {
+		raw = raw_open(in->output_path, options.raw_format,
+				st.pix_fmt, st.w, st.h, vs->avg_frame_rate,
+				dec_ctx->sample_aspect_ratio);
+		if (raw == NULL)
+			goto free;
+		st.raw = raw;
+		writer_started = true;
+	} else if (options.encode != NULL) {
+		encoder = encoder_open(in->output_path, options.format,
+				options.encode, options.crf, st.w, st.h,
+				vs->avg_frame_rate);
+		if (encoder == NULL)
+			goto free;
+
+		if (in->budget != NULL)
+			writer_started = stage_start_shared(&writer,
+					threaded ? 1 : 0, PIPELINE_DEPTH,
+					in->budget, sizeof(struct write_job),
+					encode_stage_process, encoder);
+		else
+			writer_started = stage_start(&writer,
+					threaded ? 1 : 0, PIPELINE_DEPTH,
+					(size_t)options.write_memory *
+					1024 * 1024, sizeof(struct write_job),
+					encode_stage_process, encoder);
+	} else {
+		if (options.pack) {
+			out.pack = pack_open(in->output_path);
+			if (out.pack == NULL)
+				goto free;
+		}
+
+		st.pending.out = &out;
+		if (in->writer != NULL) {
+			st.writer = in->writer;
+			writer_started = true;
+		} else {
+			writer_started = stage_start(&writer,
+					threaded ? options.writers : 0,
+					PIPELINE_DEPTH * options.writers,
+					(size_t)options.write_memory *
+					1024 * 1024, sizeof(struct write_job),
+					write_stage_process, NULL);
+		}
+	}
+	compare_started = writer_started && stage_start(&compare,
+			threaded ? 1 : 0, PIPELINE_DEPTH, SIZE_MAX,
+			sizeof(struct decoded_frame),
+			compare_stage_process, &st);
+	if (!compare_started) {
+		LOG(LOG_ERROR, "Could not start pipeline\n");
+		goto free;
+	}
+
+	/* Carry on from a checkpoint, seeking to the keyframe before it and
+	 * decoding the frames up to it, or else start with any splash title
+	 * screen that is required */
+	st.out_frames = 0;
+	if (resume != NULL && resume->found) {
+		LOG(LOG_INFO, "Resuming from frame %i\n", resume->from.frames);
+		if (av_seek_frame(fmt_ctx, stream_id, resume->from.pts,
+				AVSEEK_FLAG_BACKWARD) < 0) {
+			LOG(LOG_ERROR, "Could not seek to checkpoint\n");
+			goto free;
+		}
+		avcodec_flush_buffers(dec_ctx);
+		st.frames = resume->from.frames;
+		st.out_frames = resume->from.out_frames;
+		st.resume_pts = resume->from.pts;
+	} else if (options.splash_path != NULL &&
+			(!writes_frames() || raw != NULL)) {
+		LOG(LOG_WARNING, "Warning: can't add splash screen "
+				"when remuxing, analysing or writing raw "
+				"frames\n");
+	} else if (options.splash_path != NULL && encoder != NULL) {
+		st.out_frames = encode_splash(options.splash_path, &writer,
+				&vs->avg_frame_rate, st.w, st.h,
+				st.image_size);
+	} else if (options.splash_path != NULL) {
+		st.out_frames = dump_splash(options.splash_path,
+				out.path_len, in->output_path, out.pack,
+				&vs->avg_frame_rate);
+	}
+
+	/* Read the frames from the input file, starting again from where
+	 * we go back to if a keyframe skipped to near the end differs */
+	do {
+		while (read_packet(fmt_ctx, &pkt)) {
+			/* Skip non-video packets */
+			if (pkt.stream_index != stream_id) {
+				LOG(LOG_DEBUG, "Not video stream!\n");
+				av_free_packet(&pkt);
+				continue;
+			}
+
+			/* Try decoding a frame */
+			ret = decode_packet(in, dec_ctx, frame, &pkt,
+					&compare, &decoded, sizes, ks);
+			if (ret > 0 && ks != NULL)
+				key_skip_update(ks, &st, fmt_ctx, dec_ctx,
+						stream_id, &compare);
+			if (ret < 0 || st.failed) {
+				av_free_packet(&pkt);
+				if (ret == AVERROR(EPIPE))
+					goto free;
+				break;
+			}
+
+			av_free_packet(&pkt);
+			stats_queues(stage_depth(&compare),
+					st.writer != NULL ?
+					stage_depth(st.writer) : 0);
+			stats_progress();
+		}
+
+		/* Get any frames the decoder is still holding on to, which
+		 * frame threading delays by a frame per thread */
+		pkt.data = NULL;
+		pkt.size = 0;
+		do {
+			ret = decode_packet(in, dec_ctx, frame, &pkt,
+					&compare, &decoded, sizes, ks);
+			rewound = ret > 0 && ks != NULL &&
+					key_skip_update(ks, &st, fmt_ctx,
+					dec_ctx, stream_id, &compare);
+		} while (!st.failed && ret > 0 && !rewound);
+		if (ret == AVERROR(EPIPE))
+			goto free;
+	} while (rewound && !st.failed);
+
+	res = true;
+free:
+	/* Let the stages finish off everything they've been sent */
+	if (compare_started)
+		stage_finish(&compare);
+
+	/* Decide on any frames still held back to compare sparsely, while
+	 * the pool they came from is still there */
+	if (res && !st.failed)
+		sparse_resolve(&st);
+	sparse_release(&st);
+	image_pool_fini(&decoded);
+
+	/* Account for the frames after the last keyframe, if we know how
+	 * many there are */
+	while (res && !st.failed && (st.keyframes ||
+			(ks != NULL && ks->skipping)) &&
+			st.frames < vs->nb_frames)
+		decide_frame(&st, false, AV_NOPTS_VALUE);
+	if (writer_started && st.writer != NULL) {
+		writer_flush(&st);
+		if (st.writer == &writer)
+			stage_finish(&writer);
+		else
+			png_output_wait(&out);
+	}
+	if (encoder != NULL && !encoder_close(encoder))
+		res = false;
+	if (raw != NULL && !raw_close(raw))
+		res = false;
+	if (out.pack != NULL && !pack_close(out.pack)) {
+		LOG(LOG_ERROR, "Could not write pack: '%s'\n",
+				in->output_path);
+		res = false;
+	}
+
+	/* Remux or write out the decisions, if that's what we're doing */
+	if (res && !st.failed)
+		res = finish_decisions(in, &st, stream_id);
+
+	if (res && !st.failed) {
+		log_result(in, &st);
+	} else {
+		res = false;
+	}
+
+	if (frame != NULL)
+		av_free(frame);
+	excise_state_fini(&st);
+	png_output_fini(&out);
+
+	return res;
+}
+
+
+/** A demuxer and decoder of the input, for working on part of it */
+struct reader {
+	AVFormatContext *fmt_ctx;
+	AVCodecContext *dec_ctx;
+	AVFrame *frame;			/**< Frame decoded into */
+	int stream_id;			/**< Index of video stream */
+	bool flushing;			/**< Whether all packets have been read */
+	bool eof;			/**< Whether decoder has been drained */
+	bool failed;			/**< Whether decoding failed */
+};
+
+
+/** Serialises opening and closing codecs, which isn't thread safe */
+static pthread_mutex_t codec_lock = PTHREAD_MUTEX_INITIALIZER;
+
+
+/** Open the input again, with a single threaded decoder */
+static bool reader_open(struct reader *r, const char *input_path,
+		int stream_id)
+{
+	AVCodec *dec;
+	int ret;
+
+	memset(r, 0, sizeof(*r));
+	r->stream_id = stream_id;
+
+	if (avformat_open_input(&r->fmt_ctx, input_path, NULL, NULL) < 0) {
+		LOG(LOG_ERROR, "Could not open input video: '%s'\n",
+				input_path);
+		return false;
+	}
+	avformat_find_stream_info(r->fmt_ctx, NULL);
+	if (stream_id >= (int)r->fmt_ctx->nb_streams) {
+		LOG(LOG_ERROR, "Could not find video stream in input file: "
+				"'%s'\n", input_path);
+		return false;
+	}
+
+	r->dec_ctx = r->fmt_ctx->streams[stream_id]->codec;
+	r->dec_ctx->thread_count = 1;
+	dec = avcodec_find_decoder(r->dec_ctx->codec_id);
+	pthread_mutex_lock(&codec_lock);
+	ret = dec == NULL ? -1 : avcodec_open2(r->dec_ctx, dec, NULL);
+	pthread_mutex_unlock(&codec_lock);
+	if (ret < 0) {
+		LOG(LOG_ERROR, "Could not open codec for input video\n");
+		return false;
+	}
+
+	r->frame = avcodec_alloc_frame();
+	if (r->frame == NULL) {
+		LOG(LOG_ERROR, "Could not allocate frame\n");
+		return false;
+	}
+
+	return true;
+}
+
+
+/** Close a reader */
+static void reader_close(struct reader *r)
+{
+	if (r->frame != NULL)
+		av_free(r->frame);
+	if (r->dec_ctx != NULL) {
+		pthread_mutex_lock(&codec_lock);
+		avcodec_close(r->dec_ctx);
+		pthread_mutex_unlock(&codec_lock);
+	}
+	if (r->fmt_ctx != NULL)
+		avformat_close_input(&r->fmt_ctx);
+}
+
+
+/** Seek to the keyframe at or before a timestamp */
+static bool reader_seek(struct reader *r, int64_t pts)
+{
+	if (av_seek_frame(r->fmt_ctx, r->stream_id, pts,
+			AVSEEK_FLAG_BACKWARD) < 0) {
+		LOG(LOG_ERROR, "Could not seek in input video\n");
+		return false;
+	}
+	avcodec_flush_buffers(r->dec_ctx);
+	r->flushing = false;
+	r->eof = false;
+
+	return true;
+}
+
+
+/**
+ * Decode the next frame
+ *
+ * \return the frame, or NULL at the end of the input or on error
+ */
+static AVFrame *reader_next(struct reader *r)
+{
+	AVPacket pkt;
+	uint64_t t;
+	int got_frame = 0;
+
+	while (!r->eof && !r->failed) {
+		av_init_packet(&pkt);
+		pkt.data = NULL;
+		pkt.size = 0;
+
+		if (!r->flushing && !read_packet(r->fmt_ctx, &pkt)) {
+			r->flushing = true;
+			pkt.data = NULL;
+			pkt.size = 0;
+		}
+
+		if (!r->flushing && pkt.stream_index != r->stream_id) {
+			av_free_packet(&pkt);
+			continue;
+		}
+
+		t = stats_start();
+		if (avcodec_decode_video2(r->dec_ctx, r->frame, &got_frame,
+				&pkt) < 0) {
+			LOG(LOG_WARNING, "Warning: could not decode frame\n");
+			r->failed = true;
+		} else if (r->flushing && !got_frame) {
+			r->eof = true;
+		}
+		stats_end(STATS_DECODE, t);
+
+		if (!r->flushing)
+			av_free_packet(&pkt);
+
+		if (got_frame && !r->failed) {
+			stats_count(&stats.frames_in, 1);
+			stats_progress();
+			return r->frame;
+		}
+	}
+
+	return NULL;
+}
+
+
+/** Chunk worker thread: compare the frames of one range of the input */
+static void *chunk_thread(void *data)
+{
+	struct chunk *c = data;
+	struct excise_state st;
+	struct reader rd;
+	AVFrame *frame;
+
+	c->failed = true;
+	memset(&st, 0, sizeof(st));
+
+	if (!reader_open(&rd, c->input_path, c->stream_id) ||
+			!excise_state_init(&st,
+			rd.dec_ctx, rd.dec_ctx->pix_fmt,
+			rd.fmt_ctx->streams[c->stream_id]))
+		goto free;
+	st.chunk = c;
+
+	if (c->start != AV_NOPTS_VALUE && !reader_seek(&rd, c->start))
+		goto free;
+
+	while ((frame = reader_next(&rd)) != NULL) {
+		struct decoded_frame df;
+
+		df.frame = frame;
+		df.image = NULL;
+		df.pts = frame->pkt_pts;
+		df.pkt_size = -1;
+		df.probe = false;
+
+		if (df.pts == AV_NOPTS_VALUE) {
+			LOG(LOG_ERROR, "Frames need timestamps to be "
+					"processed in chunks\n");
+			goto free;
+		}
+		if (c->start != AV_NOPTS_VALUE && df.pts < c->start)
+			continue;
+		if (df.pts >= c->end)
+			break;
+
+		compare_stage_process(&st, &df);
+		if (st.failed)
+			goto free;
+	}
+
+	c->failed = rd.failed;
+
+free:
+	excise_state_fini(&st);
+	reader_close(&rd);
+
+	return NULL;
+}
+
+
+/**
+ * Compare the start of a chunk again, against the last different frame
+ * before it
+ *
+ * The chunk's worker compared against the chunk's first frame instead.
+ * Once both find the same frame different, they agree from there on.
+ * Frames only found different now are saved, and those that turn out not
+ * to be have their saved files removed.
+ *
+ * \param st       State to compare with
+ * \param rd       Reader of the input
+ * \param c        Chunk to fix up
+ * \param ref_pts  Timestamp of the last different frame before the chunk
+ * \return true on success, else false
+ */
+static bool chunk_fixup(struct excise_state *st, struct reader *rd,
+		struct chunk *c, int64_t ref_pts)
+{
+	AVFrame *frame;
+	int i = 0;
+
+	if (ref_pts == AV_NOPTS_VALUE)
+		return true;
+
+	/* Get the last different frame before the chunk back */
+	if (!reader_seek(rd, ref_pts))
+		return false;
+	while ((frame = reader_next(rd)) != NULL && frame->pkt_pts < ref_pts)
+		;
+	if (frame == NULL || frame->pkt_pts != ref_pts) {
+		LOG(LOG_ERROR, "Could not find frame at %"PRId64" again\n",
+				ref_pts);
+		return false;
+	}
+	if (compare_frame(st, frame, true) < 0)
+		return false;
+
+	/* Compare the chunk's frames with it, until they agree */
+	if (!reader_seek(rd, c->start))
+		return false;
+	while (i < c->count && (frame = reader_next(rd)) != NULL) {
+		int different;
+
+		if (frame->pkt_pts < c->start)
+			continue;
+		if (frame->pkt_pts != c->pts[i])
+			break;
+
+		different = compare_frame(st, frame, false);
+		if (different < 0)
+			return false;
+		if (different && c->different[i])
+			return true;
+
+		if (c->write && different && !tmp_file_write(st,
+				c->output_path, c->path_len, c->pts[i]))
+			return false;
+		if (c->write && !different && c->different[i]) {
+			char file_name[FILE_NAME_LEN(c->path_len)];
+
+			tmp_file_name(file_name, c->output_path, c->path_len,
+					c->pts[i]);
+			unlink(file_name);
+		}
+
+		c->different[i] = different;
+		i++;
+	}
+
+	if (i < c->count) {
+		LOG(LOG_ERROR, "Could not find frame at %"PRId64" again\n",
+				c->pts[i]);
+		return false;
+	}
+
+	return true;
+}
+
+
+/** Find the first keyframe at or before a timestamp */
+static int64_t find_keyframe(AVFormatContext *fmt_ctx, int stream_id,
+		int64_t ts)
+{
+	int64_t pts = AV_NOPTS_VALUE;
+	AVPacket pkt;
+
+	if (av_seek_frame(fmt_ctx, stream_id, ts, AVSEEK_FLAG_BACKWARD) < 0)
+		return AV_NOPTS_VALUE;
+
+	av_init_packet(&pkt);
+	while (pts == AV_NOPTS_VALUE && av_read_frame(fmt_ctx, &pkt) >= 0) {
+		if (pkt.stream_index == stream_id &&
+				(pkt.flags & AV_PKT_FLAG_KEY))
+			pts = pkt.pts;
+		av_free_packet(&pkt);
+	}
+
+	return pts;
+}
+
+
+/**
+ * Excise the boring bits, working on several ranges of the input at once
+ *
+ * The input is split at keyframes into ranges of about the same length.
+ * Each range is compared in its own thread, with its own demuxer and
+ * decoder, starting from its own first frame.  The start of each range is
+ * then compared again against the last different frame before it, and
+ * the keep or skip decisions are made for every frame in order, so the
+ * result is the same as doing it all in one pass.
+ */
+bool excise_boring_bits_chunked(const struct input *in,
+		AVFormatContext *fmt_ctx, AVCodecContext *dec_ctx,
+		int stream_id, AVStream *vs, struct cache *cache)
+{
+	struct excise_state st;
+	struct stitch stitch;
+	struct chunk *chunks = NULL;
+	struct reader rd;
+	int64_t start, duration;
+	int64_t ref_pts = AV_NOPTS_VALUE;
+	int path_len = in->path_len;
+	int n = 0, started;
+	bool res = false;
+	int i, j;
+
+	memset(&rd, 0, sizeof(rd));
+	stitch.file = NULL;
+
+	if (!excise_state_init(&st, dec_ctx, dec_ctx->pix_fmt, vs))
+		goto free;
+	st.cache = cache;
+	if ((options.compare == COMPARE_LUMA ||
+			options.compare == COMPARE_YUV) && !st.cmp.native) {
+		LOG(LOG_WARNING, "Warning: can't compare %s frames "
+				"natively, using rgb\n",
+				av_get_pix_fmt_name(st.pix_fmt));
+	}
+	if (options.png_depth == 16 && st.rgb_fmt != PIX_FMT_RGB48BE) {
+		LOG(LOG_WARNING, "Warning: can't write 16-bit PNGs when "
+				"comparing in rgb, writing 8-bit\n");
+	}
+
+	/* Kept PNGs come from the files the chunks saved, or when
+	 * remuxing or analysing, only the decisions are needed */
+	if (writes_frames()) {
+		stitch.output_path = in->output_path;
+		stitch.path_len = path_len;
+		stitch.file = malloc(FILE_NAME_LEN(path_len));
+		if (stitch.file == NULL) {
+			LOG(LOG_ERROR, "Could not allocate file name\n");
+			goto free;
+		}
+		st.stitch = &stitch;
+	}
+
+	/* Split the input at keyframes */
+	chunks = calloc(options.chunks, sizeof(*chunks));
+	if (chunks == NULL) {
+		LOG(LOG_ERROR, "Could not allocate chunks\n");
+		goto free;
+	}
+
+	start = vs->start_time != AV_NOPTS_VALUE ? vs->start_time : 0;
+	duration = vs->duration;
+	if (duration == AV_NOPTS_VALUE && fmt_ctx->duration != AV_NOPTS_VALUE)
+		duration = av_rescale_q(fmt_ctx->duration, AV_TIME_BASE_Q,
+				vs->time_base);
+	if (duration == AV_NOPTS_VALUE || duration <= 0) {
+		LOG(LOG_WARNING, "Warning: input length unknown, so not "
+				"splitting it\n");
+		duration = 0;
+	}
+
+	chunks[0].start = AV_NOPTS_VALUE;
+	n = 1;
+	for (i = 1; i < options.chunks && duration > 0; i++) {
+		int64_t pts = find_keyframe(fmt_ctx, stream_id,
+				start + duration * i / options.chunks);
+
+		if (pts == AV_NOPTS_VALUE ||
+				pts <= (n > 1 ? chunks[n - 1].start : start))
+			continue;
+		chunks[n++].start = pts;
+	}
+
+	for (i = 0; i < n; i++) {
+		chunks[i].stream_id = stream_id;
+		chunks[i].end = i + 1 < n ? chunks[i + 1].start : INT64_MAX;
+		chunks[i].write = writes_frames();
+		chunks[i].input_path = in->input_path;
+		chunks[i].output_path = in->output_path;
+		chunks[i].path_len = path_len;
+	}
+	LOG(LOG_DEBUG, "Chunks: %i\n", n);
+
+	/* Compare the chunks in parallel */
+	for (started = 0; started < n; started++) {
+		if (pthread_create(&chunks[started].thread, NULL,
+				chunk_thread, &chunks[started]) != 0) {
+			LOG(LOG_ERROR, "Could not start chunk thread\n");
+			break;
+		}
+	}
+
+	/* Output any splash title screen that is required */
+	if (options.splash_path != NULL && !writes_frames()) {
+		LOG(LOG_WARNING, "Warning: can't add splash screen "
+				"when remuxing or analysing\n");
+	} else if (options.splash_path != NULL) {
+		st.out_frames = dump_splash(options.splash_path,
+				path_len, in->output_path, NULL,
+				&vs->avg_frame_rate);
+	}
+
+	for (i = 0; i < started; i++)
+		pthread_join(chunks[i].thread, NULL);
+	if (started < n)
+		goto free;
+	for (i = 0; i < n; i++) {
+		if (chunks[i].failed)
+			goto free;
+	}
+
+	/* Put the chunks together, in order */
+	if (n > 1 && !reader_open(&rd, in->input_path, stream_id))
+		goto free;
+
+	for (i = 0; i < n; i++) {
+		struct chunk *c = &chunks[i];
+
+		if (i > 0 && !chunk_fixup(&st, &rd, c, ref_pts))
+			goto free;
+
+		for (j = 0; j < c->count; j++) {
+			if (c->different[j]) {
+				ref_pts = c->pts[j];
+				if (st.stitch != NULL)
+					stitch_set(&stitch, ref_pts);
+			}
+			if (!decide_frame(&st, c->different[j], c->pts[j]))
+				goto free;
+		}
+	}
+
+	/* Remux or write out the decisions, if that's what we're doing */
+	res = finish_decisions(in, &st, stream_id);
+	if (res)
+		log_result(in, &st);
+
+free:
+	reader_close(&rd);
+	for (i = 0; i < n; i++) {
+		free(chunks[i].pts);
+		free(chunks[i].different);
+	}
+	free(chunks);
+	free(stitch.file);
+	excise_state_fini(&st);
+
+	return res;
+}
+
+
+/**
+ * Make the keep or skip decisions from cached comparison results
+ *
+ * Nothing is decoded, so this is only for modes that don't write frames.
+ */
+static bool excise_boring_bits_cached(const struct input *in,
+		AVCodecContext *dec_ctx, int stream_id, AVStream *vs,
+		const struct cache *c)
+{
+	struct excise_state st;
+	bool res = false;
+	int i;
+
+	if (!excise_state_init(&st, dec_ctx, dec_ctx->pix_fmt, vs))
+		goto free;
+	if (options.splash_path != NULL) {
+		LOG(LOG_WARNING, "Warning: can't add splash screen "
+				"when remuxing or analysing\n");
+	}
+
+	for (i = 0; i < c->count; i++) {
+		if (!decide_frame(&st, c->different[i], c->pts[i]))
+			goto free;
+	}
+
+	/* Remux or write out the decisions */
+	res = finish_decisions(in, &st, stream_id);
+	if (res)
+		log_result(in, &st);
+
+free:
+	excise_state_fini(&st);
+
+	return res;
+}
+
+
+/**
+ * Make the keep or skip decisions from packet sizes alone
+ *
+ * Nothing is decoded, so the input is read as fast as it can be demuxed.
+ * Keyframes and packets too big to be static are taken as different, and
+ * the results put in presentation order, as B-frames are sent out of it.
+ * This is only for modes that don't write frames.
+ */
+static bool excise_boring_bits_packets(const struct input *in,
+		AVFormatContext *fmt_ctx, AVCodecContext *dec_ctx,
+		int stream_id, AVStream *vs)
+{
+	const int static_bytes = static_packet_bytes(dec_ctx->width,
+			dec_ctx->height);
+	struct cache c;
+	AVPacket pkt;
+	bool res = false;
+
+	cache_init(&c);
+	LOG(LOG_DEBUG, "Static packets are up to %i bytes\n", static_bytes);
+
+	while (read_packet(fmt_ctx, &pkt)) {
+		bool different = (pkt.flags & AV_PKT_FLAG_KEY) ||
+				pkt.size > static_bytes;
+		int64_t pts = pkt.pts != AV_NOPTS_VALUE ? pkt.pts : pkt.dts;
+		bool video = pkt.stream_index == stream_id;
+
+		av_free_packet(&pkt);
+		if (!video)
+			continue;
+
+		stats_count(&stats.frames_in, 1);
+		if (!cache_add(&c, different, pts)) {
+			LOG(LOG_ERROR, "Could not allocate packet results\n");
+			goto free;
+		}
+		stats_progress();
+	}
+
+	if (!cache_sort(&c)) {
+		LOG(LOG_ERROR, "Could not sort packet results\n");
+		goto free;
+	}
+	if (c.count > 0)
+		c.different[0] = true;
+
+	res = excise_boring_bits_cached(in, dec_ctx, stream_id, vs, &c);
+
+free:
+	cache_fini(&c);
+
+	return res;
+}
+
+
+/**
+ * Describe the settings that change which frames differ
+ *
+ * \param settings  Buffer to write the description to
+ * \param len       Size of buffer
+ */
+static void compare_settings_describe(char *settings, size_t len)
+{
+	uint64_t roi = 0;
+	int i;
+
+	for (i = 0; i < options.n_rects; i++) {
+		const struct roi_rect *r = &options.rects[i];
+		int v[5] = { r->x, r->y, r->w, r->h, r->include };
+
+		roi = hash64(v, sizeof(v), roi);
+	}
+	if (options.mask != NULL)
+		roi = hash64(options.mask, strlen(options.mask), roi);
+
+	snprintf(settings, len,
+			"border %i compare %i tolerance %i neighbourhood %i "
+			"votes %i scale %i roi %016" PRIx64 " "
+			"keyframes %i hwaccel %s detect %i static %i",
+			options.border, options.compare, options.tolerance,
+			options.size, options.votes, options.compare_scale,
+			roi, options.keyframes,
+			options.hwaccel != NULL ? options.hwaccel : "none",
+			options.detect, options.static_packet);
+}
+
+
+/**
+ * Find the difference cache for the input, and its key
+ *
+ * The key covers the settings that change which frames differ, so a
+ * change to e.g. the slack can still use the cache, but not one to the
+ * border or tolerance.
+ *
+ * \param key  Updated to the cache key
+ * \return newly allocated cache file name, or NULL if there's no cache
+ */
+static char *cache_file_name(const struct input *in, uint64_t *key)
+{
+	char settings[256];
+	char *file_name;
+
+	compare_settings_describe(settings, sizeof(settings));
+	if (!cache_key(in->input_path, settings, key)) {
+		LOG(LOG_WARNING, "Warning: can't read input to make "
+				"difference cache key\n");
+		return NULL;
+	}
+
+	file_name = malloc(strlen(in->input_path) + sizeof(CACHE_SUFFIX));
+	if (file_name == NULL) {
+		LOG(LOG_ERROR, "Could not allocate file name\n");
+		return NULL;
+	}
+	strcpy(file_name, in->input_path);
+	strcat(file_name, CACHE_SUFFIX);
+
+	return file_name;
+}
+
+
+/**
+ * Find the checkpoint file for the output, and its key
+ *
+ * Unlike the difference cache, the key also covers the settings that
+ * change which frames are kept, since the output so far depends on them.
+ *
+ * \param key  Updated to the checkpoint key
+ * \return newly allocated checkpoint file name, or NULL on error
+ */
+static char *checkpoint_file_name(const struct input *in, uint64_t *key)
+{
+	char compare[256];
+	char settings[512];
+	char *file_name;
+
+	compare_settings_describe(compare, sizeof(compare));
+	snprintf(settings, sizeof(settings), "%s slack %i splash %s %i",
+			compare, options.slack,
+			options.splash_path != NULL ?
+					options.splash_path : "none",
+			options.splash);
+	if (!cache_key(in->input_path, settings, key)) {
+		LOG(LOG_WARNING, "Warning: can't read input to make "
+				"checkpoint key\n");
+		return NULL;
+	}
+
+	file_name = malloc(in->path_len + sizeof(CHECKPOINT_SUFFIX));
+	if (file_name == NULL) {
+		LOG(LOG_ERROR, "Could not allocate file name\n");
+		return NULL;
+	}
+	memcpy(file_name, in->output_path, in->path_len);
+	strcpy(file_name + in->path_len, CHECKPOINT_SUFFIX);
+
+	return file_name;
+}
+
+
+/** Whether a path is a live stream: stdin, a pipe, or a network URL */
+static bool path_is_stream(const char *path)
+{
+	return strcmp(path, "-") == 0 || strncmp(path, "pipe:", 5) == 0 ||
+			(strstr(path, "://") != NULL &&
+			strncmp(path, "file://", 7) != 0);
+}
+
+
+/** Signal handler: stop reading a live stream, and finish the output */
+static void stream_interrupt(int sig)
+{
+	interrupted = 1;
+	signal(sig, SIG_DFL);
+}
+
+
+/** Input interrupt callback: whether to give up waiting for input */
+static int input_interrupted(void *ctx)
+{
+	return interrupted;
+}
+
+
+/**
+ * Excise the boring bits of an input video, and save the remaining to output
+ *
+ * \param in  Input, whose hwaccel is cleared if it's decoded in software
+ * \return true on success, else false
+ */
+bool excise_boring_bits_wrapper(struct input *in)
+{
+	AVFormatContext *fmt_ctx = NULL;
+	AVCodecContext *dec_ctx = NULL;
+	AVCodec *dec = NULL;
+	struct cache cache;
+	char *cache_file = NULL;
+	uint64_t cache_key = 0;
+	struct resume resume = { NULL };
+	int stream_id;
+	AVStream *vs;
+	bool res = false;
+	int ret;
+
+	cache_init(&cache);
+
+	/* A live stream ends when we're asked to stop, so let reads that
+	 * are waiting for it give up */
+	fmt_ctx = avformat_alloc_context();
+	if (fmt_ctx == NULL) {
+		LOG(LOG_ERROR, "Could not allocate input format context\n");
+		goto free;
+	}
+	fmt_ctx->interrupt_callback.callback = input_interrupted;
+
+	/* Open the input file, and allocate it's format context */
+	ret = avformat_open_input(&fmt_ctx, in->input_path, NULL, NULL);
+	if (ret < 0) {
+		LOG(LOG_ERROR, "Could not open input video: '%s'\n",
+				in->input_path);
+		goto free;
+	}
+
+	/* Get info about the stream */
+	ret = avformat_find_stream_info(fmt_ctx, NULL);
+	if (ret < 0) {
+		LOG(LOG_ERROR, "Warning: Couldn't get input stream info\n");
+	}
+
+	/* Find the "best" video stream in the file */
+	ret = av_find_best_stream(fmt_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
+	if (ret < 0) {
+		LOG(LOG_ERROR, "Could not find video stream in input file: "
+				"'%s'\n", in->input_path);
+		goto free;
+	}
+
+	/* Got the stream number of the video, so get its stream */
+	stream_id = ret;
+	vs = fmt_ctx->streams[stream_id];
+
+	/* Live streams often don't say what their average frame rate is */
+	if (vs->avg_frame_rate.num <= 0 || vs->avg_frame_rate.den <= 0)
+		vs->avg_frame_rate = vs->r_frame_rate;
+	if (vs->avg_frame_rate.num <= 0 || vs->avg_frame_rate.den <= 0) {
+		LOG(LOG_WARNING, "Warning: unknown frame rate, assuming "
+				"%i fps\n", DEFAULT_FPS);
+		vs->avg_frame_rate = (AVRational){ DEFAULT_FPS, 1 };
+	}
+
+	/* Get the decoder for the stream */
+	dec_ctx = vs->codec;
+	dec = avcodec_find_decoder(dec_ctx->codec_id);
+	if (!dec) {
+		LOG(LOG_ERROR, "Could not find codec for input video\n");
+		goto free;
+	}
+
+	/* Packet sizes alone can be read without opening the decoder */
+	if (options.detect == DETECT_PACKETS_ONLY) {
+		res = excise_boring_bits_packets(in, fmt_ctx, dec_ctx,
+				stream_id, vs);
+		goto free;
+	}
+
+	/* If all we need are the decisions, and an earlier run saved the
+	 * comparison results, we needn't decode anything */
+	if (options.cache) {
+		cache_file = cache_file_name(in, &cache_key);
+		if (cache_file != NULL && !writes_frames() &&
+				cache_load(&cache, cache_file, cache_key)) {
+			LOG(LOG_INFO, "Using difference cache: '%s'\n",
+					cache_file);
+			res = excise_boring_bits_cached(in, dec_ctx,
+					stream_id, vs, &cache);
+			goto free;
+		}
+	}
+
+	/* Let the decoder use frame and slice threads */
+	dec_ctx->thread_count = in->threads;
+	dec_ctx->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+
+	/* Frame threads hold back a frame each, so for a live stream only
+	 * use slice threads, to keep the output close behind */
+	if (options.stream)
+		dec_ctx->thread_type = FF_THREAD_SLICE;
+
+	/* Decode on the GPU, if asked and it can decode the stream */
+	if (in->hwaccel != NULL && !hwaccel_open(dec_ctx, in->hwaccel))
+		in->hwaccel = NULL;
+
+	/* Have the decoder skip everything but keyframes, if asked */
+	if (options.keyframes)
+		dec_ctx->skip_frame = AVDISCARD_NONKEY;
+	LOG(LOG_DEBUG, "Threads: %i\n", in->threads);
+
+	/* Initialise the decoder, which other inputs may be doing too */
+	pthread_mutex_lock(&codec_lock);
+	ret = avcodec_open2(dec_ctx, dec, NULL);
+	pthread_mutex_unlock(&codec_lock);
+	if (ret < 0) {
+		LOG(LOG_ERROR, "Could not open codec for input video\n");
+		goto free;
+	}
+
+	LOG(LOG_DEBUG, "Frame rate: %i/%i\n",
+			vs->avg_frame_rate.num, vs->avg_frame_rate.den);
+
+	/* Save progress as we go, and carry on from an earlier run's last
+	 * checkpoint, if asked */
+	if (options.checkpoint > 0) {
+		resume.file_name = checkpoint_file_name(in, &resume.key);
+		resume.interval = (uint64_t)options.checkpoint * 1000000000;
+		if (resume.file_name != NULL && options.resume) {
+			resume.found = checkpoint_load(&resume.from,
+					resume.file_name, resume.key);
+			if (!resume.found)
+				LOG(LOG_INFO, "No checkpoint to resume from, "
+						"starting at the beginning\n");
+		}
+	}
+
+	/* Do the excising of boring bits */
+	if (options.chunks > 1)
+		res = excise_boring_bits_chunked(in, fmt_ctx, dec_ctx,
+				stream_id, vs,
+				cache_file != NULL ? &cache : NULL);
+	else
+		res = excise_boring_bits(in, fmt_ctx, dec_ctx, stream_id, vs,
+				cache_file != NULL ? &cache : NULL,
+				resume.file_name != NULL ? &resume : NULL);
+	if (res == false) {
+		goto free;
+	}
+
+	/* Save the comparison results for later runs */
+	if (cache_file != NULL &&
+			!cache_save(&cache, cache_file, cache_key)) {
+		LOG(LOG_WARNING, "Warning: can't save difference cache: "
+				"'%s'\n", cache_file);
+	}
+
+	/* The run is complete, so there's nothing to carry on from */
+	if (resume.file_name != NULL)
+		unlink(resume.file_name);
+
+	/* It all worked! */
+	res = true;
+
+free:
+	if (dec_ctx != NULL) {
+		pthread_mutex_lock(&codec_lock);
+		avcodec_close(dec_ctx);
+		pthread_mutex_unlock(&codec_lock);
+	}
+	if (dec_ctx != NULL && in->hwaccel != NULL)
+		hwaccel_close(dec_ctx);
+	if (fmt_ctx != NULL)
+		avformat_close_input(&fmt_ctx);
+	cache_fini(&cache);
+	free(cache_file);
+	free(resume.file_name);
+
+	/* Make sure the output is on disc, all at once rather than a file
+	 * at a time */
+	if (res && options.fsync && !sync_output(in->output_path))
+		res = false;
+
+	return res;
+}
+
+
+/** A file to process in batch mode */
+struct batch_job {
+	char *input_path;	/**< Video */
+	char *output_path;	/**< Output path */
+};
+
+/** Files to process in batch mode */
+struct batch {
+	struct batch_job *jobs;	/**< Files, in the order given */
+	int count;		/**< Number of files */
+	int size;		/**< Number of files there's space for */
+};
+
+
+/**
+ * Make a batch output path from a pattern
+ *
+ * Each "%s" in the pattern is replaced with the input's file name, without
+ * its directory or extension, and each "%%" with "%".
+ *
+ * \return newly allocated path, or NULL on memory exhaustion
+ */
+static char *batch_output_path(const char *pattern, const char *input_path)
+{
+	const char *name = strrchr(input_path, '/');
+	const char *ext;
+	size_t name_len;
+	size_t len = 0;
+	const char *p;
+	char *out, *o;
+
+	name = (name != NULL) ? name + 1 : input_path;
+	ext = strrchr(name, '.');
+	name_len = (ext != NULL && ext != name) ?
+			(size_t)(ext - name) : strlen(name);
+
+	for (p = pattern; *p != '\0'; p++) {
+		if (p[0] == '%' && p[1] == 's') {
+			len += name_len;
+			p++;
+		} else {
+			if (p[0] == '%' && p[1] == '%')
+				p++;
+			len++;
+		}
+	}
+
+	out = malloc(len + 1);
+	if (out == NULL)
+		return NULL;
+
+	for (p = pattern, o = out; *p != '\0'; p++) {
+		if (p[0] == '%' && p[1] == 's') {
+			memcpy(o, name, name_len);
+			o += name_len;
+			p++;
+		} else {
+			if (p[0] == '%' && p[1] == '%')
+				p++;
+			*o++ = *p;
+		}
+	}
+	*o = '\0';
+
+	return out;
+}
+
+
+/**
+ * Add a file to a batch
+ *
+ * \param b            Batch to add to
+ * \param input_path   Video
+ * \param output_path  Output path, or NULL to make it from the pattern
+ * \return true on success, else false
+ */
+static bool batch_add(struct batch *b, const char *input_path,
+		const char *output_path)
+{
+	struct batch_job *job;
+
+	if (output_path == NULL && options.batch == NULL) {
+		LOG(LOG_ERROR, "No output path for '%s' (use --batch)\n",
+				input_path);
+		return false;
+	}
+
+	if (b->count == b->size) {
+		int size = (b->size == 0) ? 64 : b->size * 2;
+		struct batch_job *jobs = realloc(b->jobs,
+				size * sizeof(*jobs));
+		if (jobs == NULL) {
+			LOG(LOG_ERROR, "Out of memory\n");
+			return false;
+		}
+		b->jobs = jobs;
+		b->size = size;
+	}
+
+	job = &b->jobs[b->count];
+	job->input_path = strdup(input_path);
+	job->output_path = (output_path != NULL) ? strdup(output_path) :
+			batch_output_path(options.batch, input_path);
+	if (job->input_path == NULL || job->output_path == NULL) {
+		free(job->input_path);
+		free(job->output_path);
+		LOG(LOG_ERROR, "Out of memory\n");
+		return false;
+	}
+	b->count++;
+
+	return true;
+}
+
+
+/**
+ * Add the files listed in a manifest to a batch
+ *
+ * Each line of the manifest is an input path, optionally followed by a tab
+ * and its output path.  Empty lines and lines starting with '#' are skipped.
+ *
+ * \return true on success, else false
+ */
+static bool batch_read_manifest(struct batch *b, const char *file_name)
+{
+	char *line = NULL;
+	size_t line_size = 0;
+	ssize_t len;
+	bool res = false;
+	FILE *fp;
+
+	fp = fopen(file_name, "r");
+	if (fp == NULL) {
+		LOG(LOG_ERROR, "Could not open manifest: '%s'\n", file_name);
+		return false;
+	}
+
+	while ((len = getline(&line, &line_size, fp)) != -1) {
+		char *output_path;
+
+		while (len > 0 && (line[len - 1] == '\n' ||
+				line[len - 1] == '\r'))
+			line[--len] = '\0';
+		if (len == 0 || line[0] == '#')
+			continue;
+
+		output_path = strchr(line, '\t');
+		if (output_path != NULL)
+			*output_path++ = '\0';
+
+		if (!batch_add(b, line, output_path))
+			goto free;
+	}
+
+	/* It all worked! */
+	res = true;
+
+free:
+	free(line);
+	fclose(fp);
+
+	return res;
+}
+
+
+/** Free a batch's files */
+static void batch_fini(struct batch *b)
+{
+	int i;
+
+	for (i = 0; i < b->count; i++) {
+		free(b->jobs[i].input_path);
+		free(b->jobs[i].output_path);
+	}
+	free(b->jobs);
+}
+
+
+/** Create the directory a batch output goes in, if it's not there */
+static bool batch_make_dir(const char *output_path)
+{
+	char *copy = strdup(output_path);
+	const char *dir;
+	bool res = true;
+
+	if (copy == NULL) {
+		LOG(LOG_ERROR, "Out of memory\n");
+		return false;
+	}
+
+	dir = dirname(copy);
+	if (mkdir(dir, 0777) != 0 && errno != EEXIST) {
+		LOG(LOG_ERROR, "Could not create directory: '%s'\n", dir);
+		res = false;
+	}
+
+	free(copy);
+	return res;
+}
+
+
+/** Files of a batch being done, and what they share */
+struct batch_run {
+	struct batch *b;		/**< Files to do */
+	int jobs;			/**< Number of files done at once */
+	pthread_mutex_t lock;		/**< Guards next, running and failed */
+	int next;			/**< Index of the next file to start */
+	int running;			/**< Number of files being done */
+	int failed;			/**< Number of files that failed */
+	struct budget budget;		/**< Memory for frames being written */
+	struct stage writer;		/**< PNG writers, for every file */
+	bool writer_started;		/**< Whether writer is running */
+};
+
+
+/**
+ * Do one file of a batch
+ *
+ * The decoder threads are shared out between the files being done, and
+ * those that will be started alongside them.
+ *
+ * \return true on success, else false
+ */
+static bool batch_do(struct batch_run *run, struct batch_job *job,
+		int active)
+{
+	struct input in;
+
+	if (!batch_make_dir(job->output_path))
+		return false;
+
+	in.input_path = job->input_path;
+	in.output_path = job->output_path;
+	in.path_len = output_path_len(job->output_path);
+	in.hwaccel = options.hwaccel;
+	in.threads = (options.threads > active) ?
+			options.threads / active : 1;
+	in.writer = run->writer_started ? &run->writer : NULL;
+	in.budget = &run->budget;
+
+	LOG(LOG_INFO, "%s --> %s\n", job->input_path, job->output_path);
+	return excise_boring_bits_wrapper(&in);
+}
+
+
+/** Batch worker thread: do the next file, until there are none left */
+static void *batch_thread(void *data)
+{
+	struct batch_run *run = data;
+
+	pthread_mutex_lock(&run->lock);
+	while (run->next < run->b->count) {
+		struct batch_job *job = &run->b->jobs[run->next++];
+		int active;
+		bool ok;
+
+		run->running++;
+		active = run->running + run->b->count - run->next;
+		if (active > run->jobs)
+			active = run->jobs;
+		pthread_mutex_unlock(&run->lock);
+
+		ok = batch_do(run, job, active);
+		if (!ok)
+			LOG(LOG_ERROR, "Failed: '%s'\n", job->input_path);
+
+		pthread_mutex_lock(&run->lock);
+		run->running--;
+		if (!ok)
+			run->failed++;
+	}
+	pthread_mutex_unlock(&run->lock);
+
+	return NULL;
+}
+
+
+/**
+ * Process every file in a batch
+ *
+ * Up to options.jobs files are done at once, each by its own thread of
+ * this process, which picks up the next file as soon as it's done with
+ * one, so short files don't wait behind long ones.  Each file is decoded
+ * and compared in its own pipeline, but PNGs are written by one pool of
+ * writers for all of them, and every file's frames being written count
+ * against the one --write-memory limit.
+ *
+ * \return true if every file was done, else false
+ */
+static bool excise_boring_bits_batch(struct batch *b)
+{
+	int cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	struct batch_run run;
+	pthread_t *threads = NULL;
+	int started = 0;
+	bool res = false;
+	int i;
+
+	if (cpus < 1)
+		cpus = 1;
+	run.b = b;
+	run.jobs = options.jobs;
+	if (run.jobs == 0)
+		run.jobs = (cpus + 3) / 4;
+	if (run.jobs > b->count)
+		run.jobs = b->count;
+	pthread_mutex_init(&run.lock, NULL);
+	run.next = 0;
+	run.running = 0;
+	run.failed = 0;
+	budget_init(&run.budget, (size_t)options.write_memory * 1024 * 1024);
+	run.writer_started = false;
+	LOG(LOG_DEBUG, "Batch: %i files, %i at once\n", b->count, run.jobs);
+
+	/* Start the writers every file's PNGs go to */
+	if (writes_frames() && !options.raw && options.encode == NULL) {
+		if (!stage_start_shared(&run.writer,
+				options.threads != 1 ? options.writers : 0,
+				PIPELINE_DEPTH * options.writers, &run.budget,
+				sizeof(struct write_job), write_stage_process,
+				NULL)) {
+			LOG(LOG_ERROR, "Could not start pipeline\n");
+			goto free;
+		}
+		run.writer_started = true;
+	}
+
+	threads = malloc(run.jobs * sizeof(*threads));
+	if (threads == NULL) {
+		LOG(LOG_ERROR, "Out of memory\n");
+		goto free;
+	}
+	for (started = 0; started < run.jobs; started++) {
+		if (pthread_create(&threads[started], NULL, batch_thread,
+				&run) != 0)
+			break;
+	}
+
+	/* Manage with however many threads we got */
+	if (started == 0) {
+		LOG(LOG_ERROR, "Could not start batch threads\n");
+		goto free;
+	}
+	for (i = 0; i < started; i++)
+		pthread_join(threads[i], NULL);
+
+	if (run.failed > 0) {
+		LOG(LOG_ERROR, "%i of %i files failed\n", run.failed,
+				b->count);
+		goto free;
+	}
+
+	/* It all worked! */
+	res = true;
+
+free:
+	if (run.writer_started)
+		stage_finish(&run.writer);
+	free(threads);
+	budget_fini(&run.budget);
+	pthread_mutex_destroy(&run.lock);
+
+	return res;
+}
+
+
+/**
+ * Add a rectangle to compare, or to leave out, to the options
+ *
+ * \param arg      Rectangle, as "x,y,w,h"
+ * \param include  Whether to compare it
+ * \return true on success, or false if the arg is bad
+ */
+static bool roi_rect_add(const char *arg, bool include)
+{
+	struct roi_rect r, *rects;
+	char end;
+
+	if (sscanf(arg, "%i,%i,%i,%i%c", &r.x, &r.y, &r.w, &r.h, &end) != 4 ||
+			r.x < 0 || r.y < 0 || r.w <= 0 || r.h <= 0)
+		return false;
+	r.include = include;
+
+	rects = realloc(options.rects,
+			(options.n_rects + 1) * sizeof(*rects));
+	if (rects == NULL)
+		return false;
+	rects[options.n_rects++] = r;
+	options.rects = rects;
+
+	return true;
+}
+
+
+int main(int argc, char *argv[])
+{
+	struct batch b = { NULL, 0, 0 };
+	const char **paths;
+	int n_paths = 0;
+	bool ok;
+	int a;
 
 	/* Handle less than minumum args */
 	if (argc < 3) {
@@ -619,9 +3665,52 @@ int main(int argc, char *argv[])
 	options.input_path = NULL;
 	options.output_path = NULL;
 	options.splash_path = NULL;
-	options.border = BORDER;
-	options.slack = SLACK_TIME_CS;
+	options.border = COMPARE_BORDER;
+	options.slack = EBB_SLACK_CS;
 	options.splash = SPLASH_TIME_CS;
+	options.compare = COMPARE_AUTO;
+	options.simd = true;
+	options.threads = 0;
+	options.writers = 0;
+	options.write_memory = WRITE_MEMORY_MIB;
+	options.png = PNG_PROFILE_DEFAULT;
+	options.png_depth = 8;
+	options.encode = NULL;
+	options.crf = NULL;
+	options.remux = false;
+	options.keyframes = false;
+	options.chunks = 0;
+	options.hwaccel = NULL;
+	options.batch = NULL;
+	options.manifest = NULL;
+	options.jobs = 0;
+	options.analyze = false;
+	options.raw = false;
+	options.detect = DETECT_DECODE;
+	options.static_packet = 0;
+	options.sparse = 0;
+	options.sparse_key = false;
+	options.cache = false;
+	options.checkpoint = 0;
+	options.resume = false;
+	options.tolerance = COMPARE_TOLERANCE;
+	options.size = COMPARE_SIZE;
+	options.votes = 0;
+	options.compare_scale = 1;
+	options.rects = NULL;
+	options.n_rects = 0;
+	options.mask = NULL;
+	options.stats = false;
+	options.progress = 0;
+	options.format = NULL;
+	options.stream = false;
+
+	/* Non-option args, sorted out once we know if it's a batch */
+	paths = malloc(argc * sizeof(*paths));
+	if (paths == NULL) {
+		LOG(LOG_ERROR, "Out of memory\n");
+		return EXIT_FAILURE;
+	}
 
 	/* Handle whatever args were passed */
 	for (a = 1; a < argc; a++) {
@@ -670,31 +3759,508 @@ int main(int argc, char *argv[])
 					}
 					options.splash = atoi(argv[a]);
 				}
+			} else if (argc >= 3 && (strcmp(argv[a], "-t") == 0 ||
+					strcmp(argv[a], "--threads") == 0)) {
+				if (a + 1 < argc) {
+					a++;
+					if (!isdigit(argv[a][0])) {
+						LOG(LOG_ERROR, "Bad arg\n");
+						return EXIT_FAILURE;
+					}
+					options.threads = atoi(argv[a]);
+				}
+			} else if (argc >= 3 && strcmp(argv[a], "--writers") == 0) {
+				if (a + 1 < argc) {
+					a++;
+					if (!isdigit(argv[a][0])) {
+						LOG(LOG_ERROR, "Bad arg\n");
+						return EXIT_FAILURE;
+					}
+					options.writers = atoi(argv[a]);
+				}
+			} else if (argc >= 3 && strcmp(argv[a],
+					"--write-memory") == 0) {
+				if (a + 1 < argc) {
+					a++;
+					if (!isdigit(argv[a][0])) {
+						LOG(LOG_ERROR, "Bad arg\n");
+						return EXIT_FAILURE;
+					}
+					options.write_memory = atoi(argv[a]);
+				}
+			} else if (argc >= 3 && strcmp(argv[a],
+					"--png-profile") == 0) {
+				if (a + 1 < argc) {
+					const struct png_profile *p;
+
+					a++;
+					for (p = png_profiles; p->name; p++) {
+						if (strcmp(argv[a], p->name) == 0)
+							break;
+					}
+					if (p->name == NULL) {
+						LOG(LOG_ERROR, "Bad arg\n");
+						return EXIT_FAILURE;
+					}
+					options.png = p;
+				}
+			} else if (argc >= 3 &&
+					strcmp(argv[a], "--png-depth") == 0) {
+				if (a + 1 < argc) {
+					a++;
+					if (strcmp(argv[a], "8") != 0 &&
+						strcmp(argv[a], "16") != 0) {
+						LOG(LOG_ERROR, "Bad arg\n");
+						return EXIT_FAILURE;
+					}
+					options.png_depth = atoi(argv[a]);
+				}
+			} else if (argc >= 3 && strcmp(argv[a], "--pack") == 0) {
+				options.pack = true;
+			} else if (argc >= 3 && strcmp(argv[a], "--fsync") == 0) {
+				options.fsync = true;
+			} else if (argc >= 3 && (strcmp(argv[a], "-e") == 0 ||
+					strcmp(argv[a], "--encode") == 0)) {
+				if (a + 1 < argc) {
+					a++;
+					options.encode = argv[a];
+				}
+			} else if (argc >= 3 && strcmp(argv[a], "--crf") == 0) {
+				if (a + 1 < argc) {
+					a++;
+					if (!isdigit(argv[a][0])) {
+						LOG(LOG_ERROR, "Bad arg\n");
+						return EXIT_FAILURE;
+					}
+					options.crf = argv[a];
+				}
+			} else if (argc >= 3 && strcmp(argv[a], "--remux") == 0) {
+				options.remux = true;
+			} else if (argc >= 3 && strcmp(argv[a],
+					"--keyframes") == 0) {
+				options.keyframes = true;
+			} else if (argc >= 3 && strcmp(argv[a], "--hwaccel") == 0) {
+				if (a + 1 < argc) {
+					a++;
+					if (strcmp(argv[a], "vaapi") != 0) {
+						LOG(LOG_ERROR, "Bad arg\n");
+						return EXIT_FAILURE;
+					}
+					if (options.hwaccel == NULL)
+						options.hwaccel = HWACCEL_DEVICE;
+				}
+			} else if (argc >= 3 && strcmp(argv[a],
+					"--hwaccel-device") == 0) {
+				if (a + 1 < argc) {
+					a++;
+					options.hwaccel = argv[a];
+				}
+			} else if (argc >= 3 && strcmp(argv[a], "--chunks") == 0) {
+				if (a + 1 < argc) {
+					a++;
+					if (!isdigit(argv[a][0])) {
+						LOG(LOG_ERROR, "Bad arg\n");
+						return EXIT_FAILURE;
+					}
+					options.chunks = atoi(argv[a]);
+				}
+			} else if (argc >= 3 && strcmp(argv[a], "--batch") == 0) {
+				if (a + 1 < argc) {
+					a++;
+					options.batch = argv[a];
+				}
+			} else if (argc >= 3 &&
+					strcmp(argv[a], "--manifest") == 0) {
+				if (a + 1 < argc) {
+					a++;
+					options.manifest = argv[a];
+				}
+			} else if (argc >= 3 &&
+					strcmp(argv[a], "--analyze-only") == 0) {
+				if (a + 1 < argc) {
+					a++;
+					if (!edl_format_parse(argv[a],
+							&options.edl_format)) {
+						LOG(LOG_ERROR, "Bad arg\n");
+						return EXIT_FAILURE;
+					}
+					options.analyze = true;
+				}
+			} else if (argc >= 3 && strcmp(argv[a], "--detect") == 0) {
+				if (a + 1 < argc) {
+					a++;
+					if (strcmp(argv[a], "decode") == 0) {
+						options.detect = DETECT_DECODE;
+					} else if (strcmp(argv[a],
+							"packets") == 0) {
+						options.detect = DETECT_PACKETS;
+					} else if (strcmp(argv[a],
+							"packets-only") == 0) {
+						options.detect =
+							DETECT_PACKETS_ONLY;
+					} else {
+						LOG(LOG_ERROR, "Bad arg\n");
+						return EXIT_FAILURE;
+					}
+				}
+			} else if (argc >= 3 &&
+					strcmp(argv[a], "--static-packet") == 0) {
+				if (a + 1 < argc) {
+					a++;
+					if (!isdigit(argv[a][0])) {
+						LOG(LOG_ERROR, "Bad arg\n");
+						return EXIT_FAILURE;
+					}
+					options.static_packet = atoi(argv[a]);
+				}
+			} else if (argc >= 3 &&
+					strcmp(argv[a], "--sparse") == 0) {
+				if (a + 1 < argc) {
+					a++;
+					if (strcmp(argv[a], "key") == 0) {
+						options.sparse_key = true;
+					} else if (!isdigit(argv[a][0])) {
+						LOG(LOG_ERROR, "Bad arg\n");
+						return EXIT_FAILURE;
+					} else {
+						options.sparse = atoi(argv[a]);
+					}
+				}
+			} else if (argc >= 3 && strcmp(argv[a], "--raw") == 0) {
+				if (a + 1 < argc) {
+					a++;
+					if (!raw_format_parse(argv[a],
+							&options.raw_format)) {
+						LOG(LOG_ERROR, "Bad arg\n");
+						return EXIT_FAILURE;
+					}
+					options.raw = true;
+				}
+			} else if (argc >= 3 &&
+					strcmp(argv[a], "--tolerance") == 0) {
+				if (a + 1 < argc) {
+					a++;
+					if (!isdigit(argv[a][0])) {
+						LOG(LOG_ERROR, "Bad arg\n");
+						return EXIT_FAILURE;
+					}
+					options.tolerance = atoi(argv[a]);
+				}
+			} else if (argc >= 3 &&
+					strcmp(argv[a], "--neighbourhood") == 0) {
+				if (a + 1 < argc) {
+					a++;
+					if (!isdigit(argv[a][0])) {
+						LOG(LOG_ERROR, "Bad arg\n");
+						return EXIT_FAILURE;
+					}
+					options.size = atoi(argv[a]);
+				}
+			} else if (argc >= 3 &&
+					strcmp(argv[a], "--compare-scale") == 0) {
+				if (a + 1 < argc) {
+					a++;
+					if (!isdigit(argv[a][0]) ||
+							atoi(argv[a]) < 1) {
+						LOG(LOG_ERROR, "Bad arg\n");
+						return EXIT_FAILURE;
+					}
+					options.compare_scale = atoi(argv[a]);
+				}
+			} else if (argc >= 3 &&
+					(strcmp(argv[a], "--include") == 0 ||
+					strcmp(argv[a], "--exclude") == 0)) {
+				bool include = argv[a][2] == 'i';
+
+				if (a + 1 < argc) {
+					a++;
+					if (!roi_rect_add(argv[a], include)) {
+						LOG(LOG_ERROR, "Bad arg\n");
+						return EXIT_FAILURE;
+					}
+				}
+			} else if (argc >= 3 && strcmp(argv[a], "--mask") == 0) {
+				if (a + 1 < argc) {
+					a++;
+					options.mask = argv[a];
+				}
+			} else if (argc >= 3 && strcmp(argv[a], "--votes") == 0) {
+				if (a + 1 < argc) {
+					a++;
+					if (!isdigit(argv[a][0])) {
+						LOG(LOG_ERROR, "Bad arg\n");
+						return EXIT_FAILURE;
+					}
+					options.votes = atoi(argv[a]);
+				}
+			} else if (argc >= 3 && strcmp(argv[a], "--cache") == 0) {
+				options.cache = true;
+			} else if (argc >= 3 &&
+					strcmp(argv[a], "--checkpoint") == 0) {
+				if (a + 1 < argc) {
+					a++;
+					if (!isdigit(argv[a][0])) {
+						LOG(LOG_ERROR, "Bad arg\n");
+						return EXIT_FAILURE;
+					}
+					options.checkpoint = atoi(argv[a]);
+				}
+			} else if (argc >= 3 && strcmp(argv[a], "--resume") == 0) {
+				options.resume = true;
+			} else if (argc >= 3 && strcmp(argv[a], "--format") == 0) {
+				if (a + 1 < argc) {
+					a++;
+					options.format = argv[a];
+				}
+			} else if (argc >= 3 && strcmp(argv[a], "--stats") == 0) {
+				options.stats = true;
+			} else if (argc >= 3 &&
+					strcmp(argv[a], "--progress") == 0) {
+				if (a + 1 < argc) {
+					a++;
+					if (!isdigit(argv[a][0])) {
+						LOG(LOG_ERROR, "Bad arg\n");
+						return EXIT_FAILURE;
+					}
+					options.progress = atoi(argv[a]);
+				}
+			} else if (argc >= 3 && strcmp(argv[a], "--jobs") == 0) {
+				if (a + 1 < argc) {
+					a++;
+					if (!isdigit(argv[a][0])) {
+						LOG(LOG_ERROR, "Bad arg\n");
+						return EXIT_FAILURE;
+					}
+					options.jobs = atoi(argv[a]);
+				}
+			} else if (argc >= 3 && strcmp(argv[a], "--no-simd") == 0) {
+				options.simd = false;
+			} else if (argc >= 3 && (strcmp(argv[a], "-c") == 0 ||
+					strcmp(argv[a], "--compare") == 0)) {
+				if (a + 1 < argc) {
+					a++;
+					if (strcmp(argv[a], "auto") == 0) {
+						options.compare = COMPARE_AUTO;
+					} else if (strcmp(argv[a], "rgb") == 0) {
+						options.compare = COMPARE_RGB;
+					} else if (strcmp(argv[a], "luma") == 0) {
+						options.compare = COMPARE_LUMA;
+					} else if (strcmp(argv[a], "yuv") == 0) {
+						options.compare = COMPARE_YUV;
+					} else {
+						LOG(LOG_ERROR, "Bad arg\n");
+						return EXIT_FAILURE;
+					}
+				}
 			}
 			continue;
 
-		} else if (options.input_path == NULL) {
-			options.input_path = arg;
-
-		} else if (options.output_path == NULL) {
-			options.output_path = arg;
+		}
 
-		} else if (options.splash_path == NULL) {
-			options.splash_path = arg;
+		paths[n_paths++] = arg;
+	}
 
-		} else {
-			/* We've got input and output path, and
-			 * this isn't an option */
+	if (options.batch != NULL || options.manifest != NULL) {
+		/* Every non-option arg is an input */
+		for (a = 0; a < n_paths; a++) {
+			if (!batch_add(&b, paths[a], NULL))
+				return EXIT_FAILURE;
+		}
+		if (options.manifest != NULL &&
+				!batch_read_manifest(&b, options.manifest))
+			return EXIT_FAILURE;
+		if (b.count == 0) {
 			show_usage(argv[0]);
 			return EXIT_FAILURE;
 		}
+
+	} else if (n_paths >= 2 && n_paths <= 3) {
+		options.input_path = paths[0];
+		options.output_path = paths[1];
+		options.splash_path = (n_paths == 3) ? paths[2] : NULL;
+
+	} else {
+		/* We need input and output path, and maybe splash */
+		show_usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+	free(paths);
+
+	if (options.remux && options.encode != NULL) {
+		LOG(LOG_ERROR, "Can't use --remux with --encode\n");
+		return EXIT_FAILURE;
+	}
+	if (options.tolerance > 100 || options.size < 1 ||
+			options.size > DIFF_MAX_SIZE ||
+			options.votes > options.size * options.size) {
+		LOG(LOG_ERROR, "Bad arg\n");
+		return EXIT_FAILURE;
+	}
+	if (options.votes == 0)
+		options.votes = options.size * options.size;
+
+	if (options.analyze && (options.remux || options.encode != NULL)) {
+		LOG(LOG_ERROR, "Can't use --analyze-only with --remux "
+				"or --encode\n");
+		return EXIT_FAILURE;
+	}
+	if (options.raw && (options.remux || options.analyze ||
+			options.encode != NULL)) {
+		LOG(LOG_ERROR, "Can't use --raw with --remux, --analyze-only "
+				"or --encode\n");
+		return EXIT_FAILURE;
+	}
+	if (options.detect == DETECT_PACKETS_ONLY && (!(options.analyze ||
+			options.remux) || options.cache)) {
+		LOG(LOG_ERROR, "Can only use --detect packets-only with "
+				"--analyze-only or --remux, and not --cache\n");
+		return EXIT_FAILURE;
+	}
+	if (options.detect != DETECT_DECODE && (options.keyframes ||
+			options.chunks > 1)) {
+		LOG(LOG_ERROR, "Can't use --detect packets with --keyframes "
+				"or --chunks\n");
+		return EXIT_FAILURE;
+	}
+	if (options.remux && options.keyframes) {
+		LOG(LOG_ERROR, "Can't use --remux with --keyframes\n");
+		return EXIT_FAILURE;
+	}
+	if (options.pack && (options.remux || options.analyze ||
+			options.encode != NULL || options.raw ||
+			options.chunks > 1)) {
+		LOG(LOG_ERROR, "Can't use --pack with --remux, --analyze-only, "
+				"--encode, --raw or --chunks\n");
+		return EXIT_FAILURE;
+	}
+	if (options.png_depth == 16 && (options.remux || options.analyze ||
+			options.encode != NULL || options.raw)) {
+		LOG(LOG_ERROR, "Can't use --png-depth 16 with --remux, "
+				"--analyze-only, --encode or --raw\n");
+		return EXIT_FAILURE;
+	}
+	if (options.sparse > SPARSE_MAX) {
+		LOG(LOG_ERROR, "Can't use --sparse with more than %i frames\n",
+				SPARSE_MAX);
+		return EXIT_FAILURE;
+	}
+	if ((options.sparse > 1 || options.sparse_key) &&
+			(options.detect != DETECT_DECODE ||
+			options.keyframes || options.chunks > 1 ||
+			options.cache)) {
+		LOG(LOG_ERROR, "Can't use --sparse with --detect, "
+				"--keyframes, --chunks or --cache\n");
+		return EXIT_FAILURE;
+	}
+	if (options.chunks > 1 && (options.encode != NULL || options.raw ||
+			options.keyframes || options.hwaccel != NULL)) {
+		LOG(LOG_ERROR, "Can't use --chunks with --encode, --raw, "
+				"--keyframes or --hwaccel\n");
+		return EXIT_FAILURE;
+	}
+
+	/* Only a series of PNGs can be picked up part way through */
+	if (options.resume && options.checkpoint == 0)
+		options.checkpoint = CHECKPOINT_INTERVAL;
+	if (options.checkpoint > 0 && (options.remux || options.analyze ||
+			options.encode != NULL || options.raw ||
+			options.pack || options.chunks > 1 ||
+			options.keyframes || options.cache)) {
+		LOG(LOG_ERROR, "Can't use --checkpoint or --resume with "
+				"--remux, --analyze-only, --encode, --raw, "
+				"--pack, --chunks, --keyframes or --cache\n");
+		return EXIT_FAILURE;
+	}
+
+	/* A live stream can only be read once, from start to end */
+	options.stream = b.count == 0 && path_is_stream(options.input_path);
+	if (options.stream && (options.remux || options.chunks > 1 ||
+			options.cache || options.checkpoint > 0)) {
+		LOG(LOG_ERROR, "Can't use --remux, --chunks, --cache or "
+				"--checkpoint with a live stream\n");
+		return EXIT_FAILURE;
+	}
+	if (options.sparse_key && (options.stream || options.remux ||
+			options.checkpoint > 0)) {
+		LOG(LOG_ERROR, "Can't use --sparse key with --remux, "
+				"--checkpoint or a live stream\n");
+		return EXIT_FAILURE;
+	}
+	if (options.stream && strcmp(options.input_path, "-") == 0)
+		options.input_path = "pipe:0";
+
+	/* Video and decisions can go to stdout, with our own output going
+	 * to stderr instead */
+	if (b.count == 0 && strcmp(options.output_path, "-") == 0) {
+		static char stdout_path[32];
+		int fd;
+
+		if (options.encode == NULL && !options.analyze &&
+				!options.raw && !options.pack) {
+			LOG(LOG_ERROR, "Can only write to stdout with "
+					"--encode, --raw, --pack or "
+					"--analyze-only\n");
+			return EXIT_FAILURE;
+		}
+		fd = dup(STDOUT_FILENO);
+		if (fd < 0 || dup2(STDERR_FILENO, STDOUT_FILENO) < 0) {
+			LOG(LOG_ERROR, "Could not redirect output\n");
+			return EXIT_FAILURE;
+		}
+		sprintf(stdout_path, "/dev/fd/%i", fd);
+		options.output_path = stdout_path;
+		if (options.format == NULL)
+			options.format = "matroska";
+	}
+
+	/* If whatever reads raw frames goes away, fail the write rather
+	 * than dying */
+	if (options.raw)
+		signal(SIGPIPE, SIG_IGN);
+
+	/* Finish off the output if a live stream is stopped */
+	if (options.stream) {
+		signal(SIGINT, stream_interrupt);
+		signal(SIGTERM, stream_interrupt);
+	}
+
+	/* Pick the frame difference kernels for this CPU */
+	diff_init(options.simd);
+	LOG(LOG_DEBUG, "Difference kernels: %s\n", diff.name);
+
+	/* Register all the formats and codecs supported by ffmpeg.
+	 * We don't know what format the input file is, and this is
+	 * quicker than actually testing. */
+	av_register_all();
+	avformat_network_init();
+
+	/* Use a thread per CPU, unless told otherwise */
+	if (options.threads == 0) {
+		options.threads = sysconf(_SC_NPROCESSORS_ONLN);
+		if (options.threads < 1)
+			options.threads = 1;
 	}
+	if (options.writers == 0)
+		options.writers = options.threads;
 
 	/* Do the video stuff! */
-	ok = excise_boring_bits_wrapper();
+	stats_init(options.stats, options.progress);
+	if (b.count > 0) {
+		ok = excise_boring_bits_batch(&b);
+		batch_fini(&b);
+	} else {
+		struct input in = {
+			options.input_path, options.output_path,
+			output_path_len(options.output_path), options.hwaccel,
+			options.threads, NULL, NULL
+		};
+
+		ok = excise_boring_bits_wrapper(&in);
+	}
 	if (!ok) {
 		return EXIT_FAILURE;
 	}
+	stats_report();
 
 	return EXIT_SUCCESS;
 }
@@ -0,0 +1,238 @@
+/*
+ * Copyright (c) 2014 Codethink Ltd. (http://www.codethink.co.uk)
+ *
+ * This file is part of ebb
+ *
+ * ebb is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * ebb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "edl.h"
+#include "log.h"
+
+
+/* Exported function, documented in edl.h */
+bool edl_format_parse(const char *name, enum edl_format *format)
+{
+	if (strcmp(name, "json") == 0) {
+		*format = EDL_JSON;
+	} else if (strcmp(name, "edl") == 0) {
+		*format = EDL_MPLAYER;
+	} else if (strcmp(name, "ffmpeg") == 0) {
+		*format = EDL_FFMPEG;
+	} else {
+		return false;
+	}
+
+	return true;
+}
+
+
+/* Exported function, documented in edl.h */
+void edl_init(struct edl *edl, double frame_time)
+{
+	edl->spans = NULL;
+	edl->count = 0;
+	edl->size = 0;
+	edl->frame_time = frame_time;
+}
+
+
+/* Exported function, documented in edl.h */
+void edl_fini(struct edl *edl)
+{
+	free(edl->spans);
+	edl->spans = NULL;
+	edl->count = 0;
+	edl->size = 0;
+}
+
+
+/* Exported function, documented in edl.h */
+bool edl_add(struct edl *edl, bool keep, int frame, int64_t pts, double time)
+{
+	struct edl_span *span = NULL;
+
+	if (edl->count > 0)
+		span = &edl->spans[edl->count - 1];
+
+	/* Start a new span if the decision has changed */
+	if (span == NULL || span->keep != keep) {
+		if (edl->count == edl->size) {
+			int size = edl->size ? edl->size * 2 : 64;
+			struct edl_span *spans = realloc(edl->spans,
+					size * sizeof(*spans));
+
+			if (spans == NULL)
+				return false;
+			edl->spans = spans;
+			edl->size = size;
+		}
+
+		span = &edl->spans[edl->count++];
+		span->keep = keep;
+		span->first = frame;
+		span->first_pts = pts;
+		span->start = time;
+	}
+
+	span->last = frame;
+	span->last_pts = pts;
+	span->end = time + edl->frame_time;
+
+	return true;
+}
+
+
+/** Write a time as hours, minutes and seconds, to the millisecond */
+static void write_timecode(FILE *fp, double time)
+{
+	int64_t ms = (int64_t)(time * 1000 + 0.5);
+
+	if (ms < 0)
+		ms = 0;
+	fprintf(fp, "%.2" PRIi64 ":%.2i:%.2i.%.3i", ms / 3600000,
+			(int)(ms / 60000 % 60), (int)(ms / 1000 % 60),
+			(int)(ms % 1000));
+}
+
+
+/** Write a timestamp for JSON */
+static void write_pts(FILE *fp, int64_t pts)
+{
+	if (pts == EDL_NO_PTS)
+		fprintf(fp, "null");
+	else
+		fprintf(fp, "%" PRIi64, pts);
+}
+
+
+/** Write every span as JSON */
+static void write_json(FILE *fp, const struct edl *edl)
+{
+	int frames = 0, kept = 0;
+	int i;
+
+	for (i = 0; i < edl->count; i++) {
+		const struct edl_span *span = &edl->spans[i];
+		int n = span->last - span->first + 1;
+
+		frames += n;
+		if (span->keep)
+			kept += n;
+	}
+
+	fprintf(fp, "{\n\t\"frames\": %i,\n\t\"kept_frames\": %i,\n"
+			"\t\"spans\": [", frames, kept);
+
+	for (i = 0; i < edl->count; i++) {
+		const struct edl_span *span = &edl->spans[i];
+
+		fprintf(fp, "%s\n\t\t{ \"keep\": %s, ", i ? "," : "",
+				span->keep ? "true" : "false");
+		fprintf(fp, "\"first_frame\": %i, \"last_frame\": %i, ",
+				span->first, span->last);
+		fprintf(fp, "\"first_pts\": ");
+		write_pts(fp, span->first_pts);
+		fprintf(fp, ", \"last_pts\": ");
+		write_pts(fp, span->last_pts);
+		fprintf(fp, ", \"start\": %.3f, \"end\": %.3f, ",
+				span->start, span->end);
+		fprintf(fp, "\"start_time\": \"");
+		write_timecode(fp, span->start);
+		fprintf(fp, "\", \"end_time\": \"");
+		write_timecode(fp, span->end);
+		fprintf(fp, "\" }");
+	}
+
+	fprintf(fp, "\n\t]\n}\n");
+}
+
+
+/** Write the skipped spans as an MPlayer EDL, where action 0 is skip */
+static void write_mplayer(FILE *fp, const struct edl *edl)
+{
+	int i;
+
+	for (i = 0; i < edl->count; i++) {
+		const struct edl_span *span = &edl->spans[i];
+
+		if (!span->keep)
+			fprintf(fp, "%.3f %.3f 0\n", span->start, span->end);
+	}
+}
+
+
+/**
+ * Write an ffmpeg filter script that keeps the kept spans
+ *
+ * Frames are selected by number, and given new timestamps so the output
+ * has no gaps.  Use it with e.g. "ffmpeg -i in -filter_script:v file out".
+ */
+static void write_ffmpeg(FILE *fp, const struct edl *edl)
+{
+	bool any = false;
+	int i;
+
+	fprintf(fp, "select='");
+	for (i = 0; i < edl->count; i++) {
+		const struct edl_span *span = &edl->spans[i];
+
+		if (!span->keep)
+			continue;
+		fprintf(fp, "%sbetween(n,%i,%i)", any ? "+" : "",
+				span->first, span->last);
+		any = true;
+	}
+	fprintf(fp, "%s',setpts=N/FRAME_RATE/TB\n", any ? "" : "0");
+}
+
+
+/* Exported function, documented in edl.h */
+bool edl_write(const struct edl *edl, const char *file_name,
+		enum edl_format format)
+{
+	FILE *fp;
+	bool res;
+
+	fp = fopen(file_name, "w");
+	if (fp == NULL) {
+		LOG(LOG_ERROR, "Could not open file for writing: '%s'\n",
+				file_name);
+		return false;
+	}
+
+	switch (format) {
+	case EDL_JSON:
+		write_json(fp, edl);
+		break;
+	case EDL_MPLAYER:
+		write_mplayer(fp, edl);
+		break;
+	case EDL_FFMPEG:
+		write_ffmpeg(fp, edl);
+		break;
+	}
+
+	res = !ferror(fp);
+	if (fclose(fp) != 0)
+		res = false;
+	if (!res)
+		LOG(LOG_ERROR, "Could not write file: '%s'\n", file_name);
+
+	return res;
+}
@@ -0,0 +1,105 @@
+/*
+ * Copyright (c) 2014 Codethink Ltd. (http://www.codethink.co.uk)
+ *
+ * This file is part of ebb
+ *
+ * ebb is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * ebb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Edit decision lists
+ *
+ * Records which frames are kept and which are skipped, as spans of
+ * consecutive frames with the same decision, and writes them out for other
+ * tools to cut the input with.
+ */
+
+#ifndef EBB_EDL_H
+#define EBB_EDL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/** Timestamp of a frame without one, the same as libav's AV_NOPTS_VALUE */
+#define EDL_NO_PTS INT64_MIN
+
+/** Ways of writing out an edit decision list */
+enum edl_format {
+	EDL_JSON,	/**< JSON, with every span */
+	EDL_MPLAYER,	/**< MPlayer/mpv EDL, with the skipped spans */
+	EDL_FFMPEG	/**< ffmpeg filter script selecting the kept frames */
+};
+
+/** Consecutive frames with the same decision */
+struct edl_span {
+	bool keep;		/**< Whether the frames are kept */
+	int first;		/**< Number of first frame */
+	int last;		/**< Number of last frame */
+	int64_t first_pts;	/**< Timestamp of first frame, or EDL_NO_PTS */
+	int64_t last_pts;	/**< Timestamp of last frame, or EDL_NO_PTS */
+	double start;		/**< Time first frame is shown (s) */
+	double end;		/**< Time last frame stops being shown (s) */
+};
+
+/** An edit decision list */
+struct edl {
+	struct edl_span *spans;	/**< Spans, in order */
+	int count;		/**< Number of spans */
+	int size;		/**< Space for spans */
+	double frame_time;	/**< Time each frame is shown (s) */
+};
+
+/**
+ * Find an edit decision list format from its name
+ *
+ * \param name    "json", "edl" or "ffmpeg"
+ * \param format  Updated to the format
+ * \return true on success, or false if the name is unknown
+ */
+bool edl_format_parse(const char *name, enum edl_format *format);
+
+/**
+ * Initialise an empty edit decision list
+ *
+ * \param edl         List to initialise
+ * \param frame_time  Time each frame is shown (s)
+ */
+void edl_init(struct edl *edl, double frame_time);
+
+/** Free an edit decision list's resources */
+void edl_fini(struct edl *edl);
+
+/**
+ * Add the decision on the next frame to an edit decision list
+ *
+ * \param edl    List to add to
+ * \param keep   Whether the frame is kept
+ * \param frame  Number of the frame
+ * \param pts    Timestamp of the frame, or EDL_NO_PTS
+ * \param time   Time the frame is shown (s)
+ * \return true on success, or false on memory exhaustion
+ */
+bool edl_add(struct edl *edl, bool keep, int frame, int64_t pts, double time);
+
+/**
+ * Write out an edit decision list
+ *
+ * \param edl        List to write
+ * \param file_name  File to write to
+ * \param format     How to write it
+ * \return true on success, else false
+ */
+bool edl_write(const struct edl *edl, const char *file_name,
+		enum edl_format format);
+
+#endif
@@ -0,0 +1,271 @@
+/*
+ * Copyright (c) 2014 Codethink Ltd. (http://www.codethink.co.uk)
+ *
+ * This file is part of ebb
+ *
+ * ebb is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * ebb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/avutil.h>
+#include <libavutil/pixfmt.h>
+#include <libswscale/swscale.h>
+
+#include "encode.h"
+#include "log.h"
+#include "stats.h"
+
+struct encoder {
+	AVFormatContext *fmt_ctx;	/**< Output file */
+	AVStream *st;			/**< Video stream in output file */
+	AVCodecContext *enc_ctx;	/**< Encoder */
+	struct SwsContext *sws_ctx;	/**< RGB to encoder format scaler */
+	AVFrame *frame;			/**< Frame in encoder's format */
+	int w, h;			/**< Frame dimensions */
+	bool header_written;		/**< Whether file header was written */
+	bool ok;			/**< Whether everything has worked */
+};
+
+
+/** Pick the pixel format to encode in */
+static enum PixelFormat encoder_pix_fmt(const AVCodec *codec)
+{
+	const enum PixelFormat *fmt;
+
+	if (codec->pix_fmts == NULL)
+		return PIX_FMT_YUV420P;
+
+	/* Prefer what players expect, if the codec can do it */
+	for (fmt = codec->pix_fmts; *fmt != PIX_FMT_NONE; fmt++) {
+		if (*fmt == PIX_FMT_YUV420P)
+			return *fmt;
+	}
+
+	return codec->pix_fmts[0];
+}
+
+
+/**
+ * Write any packet the encoder gives back to the file
+ *
+ * \param enc    Encoder
+ * \param frame  Frame to encode, or NULL to flush the encoder
+ * \return 1 if a packet was written, 0 if not, or negative on error
+ */
+static int encoder_encode(struct encoder *enc, const AVFrame *frame)
+{
+	AVPacket pkt;
+	int got_packet = 0;
+	int ret;
+
+	av_init_packet(&pkt);
+	pkt.data = NULL;
+	pkt.size = 0;
+
+	ret = avcodec_encode_video2(enc->enc_ctx, &pkt, frame, &got_packet);
+	if (ret < 0) {
+		LOG(LOG_ERROR, "Could not encode frame\n");
+		return ret;
+	}
+
+	if (!got_packet)
+		return 0;
+
+	/* Timestamps are in frames, but the muxer may want otherwise */
+	if (pkt.pts != AV_NOPTS_VALUE)
+		pkt.pts = av_rescale_q(pkt.pts, enc->enc_ctx->time_base,
+				enc->st->time_base);
+	if (pkt.dts != AV_NOPTS_VALUE)
+		pkt.dts = av_rescale_q(pkt.dts, enc->enc_ctx->time_base,
+				enc->st->time_base);
+	pkt.stream_index = enc->st->index;
+
+	stats_count(&stats.bytes, pkt.size);
+	ret = av_interleaved_write_frame(enc->fmt_ctx, &pkt);
+	if (ret < 0) {
+		LOG(LOG_ERROR, "Could not write packet to output video\n");
+		return ret;
+	}
+
+	return 1;
+}
+
+
+/* Exported function, documented in encode.h */
+struct encoder *encoder_open(const char *file_name, const char *format,
+		const char *codec, const char *crf, int w, int h,
+		AVRational fps)
+{
+	struct encoder *enc;
+	AVDictionary *opts = NULL;
+	AVCodec *c;
+	int ret;
+
+	enc = calloc(1, sizeof(*enc));
+	if (enc == NULL)
+		return NULL;
+	enc->w = w;
+	enc->h = h;
+	enc->ok = true;
+
+	c = avcodec_find_encoder_by_name(codec);
+	if (c == NULL) {
+		LOG(LOG_ERROR, "Could not find encoder: '%s'\n", codec);
+		goto error;
+	}
+
+	ret = avformat_alloc_output_context2(&enc->fmt_ctx, NULL, format,
+			file_name);
+	if (ret < 0 || enc->fmt_ctx == NULL) {
+		LOG(LOG_ERROR, "Could not find output format for: '%s'\n",
+				file_name);
+		goto error;
+	}
+
+	enc->st = avformat_new_stream(enc->fmt_ctx, c);
+	if (enc->st == NULL) {
+		LOG(LOG_ERROR, "Could not create output video stream\n");
+		goto error;
+	}
+
+	/* Frame timestamps count output frames */
+	enc->enc_ctx = enc->st->codec;
+	enc->enc_ctx->width = w;
+	enc->enc_ctx->height = h;
+	enc->enc_ctx->pix_fmt = encoder_pix_fmt(c);
+	enc->enc_ctx->time_base = av_inv_q(fps);
+	enc->st->time_base = enc->enc_ctx->time_base;
+	if (enc->fmt_ctx->oformat->flags & AVFMT_GLOBALHEADER)
+		enc->enc_ctx->flags |= CODEC_FLAG_GLOBAL_HEADER;
+
+	if (crf != NULL)
+		av_dict_set(&opts, "crf", crf, 0);
+	ret = avcodec_open2(enc->enc_ctx, c, &opts);
+	av_dict_free(&opts);
+	if (ret < 0) {
+		LOG(LOG_ERROR, "Could not open encoder: '%s'\n", codec);
+		goto error;
+	}
+
+	enc->frame = avcodec_alloc_frame();
+	if (enc->frame == NULL || avpicture_alloc((AVPicture *)enc->frame,
+			enc->enc_ctx->pix_fmt, w, h) < 0) {
+		LOG(LOG_ERROR, "Could not allocate frame for encoding\n");
+		goto error;
+	}
+	enc->frame->width = w;
+	enc->frame->height = h;
+	enc->frame->format = enc->enc_ctx->pix_fmt;
+
+	if (!(enc->fmt_ctx->oformat->flags & AVFMT_NOFILE)) {
+		ret = avio_open(&enc->fmt_ctx->pb, file_name, AVIO_FLAG_WRITE);
+		if (ret < 0) {
+			LOG(LOG_ERROR, "Could not open output video: '%s'\n",
+					file_name);
+			goto error;
+		}
+	}
+
+	ret = avformat_write_header(enc->fmt_ctx, NULL);
+	if (ret < 0) {
+		LOG(LOG_ERROR, "Could not write output video header\n");
+		goto error;
+	}
+	enc->header_written = true;
+
+	return enc;
+
+error:
+	enc->ok = false;
+	encoder_close(enc);
+	return NULL;
+}
+
+
+/* Exported function, documented in encode.h */
+bool encoder_write(struct encoder *enc, const AVFrame *frame, int index)
+{
+	if (!enc->ok)
+		return false;
+
+	enc->sws_ctx = sws_getCachedContext(enc->sws_ctx,
+			enc->w, enc->h, PIX_FMT_RGB24,
+			enc->w, enc->h, enc->enc_ctx->pix_fmt,
+			SWS_BICUBIC, NULL, NULL, NULL);
+	if (enc->sws_ctx == NULL) {
+		LOG(LOG_ERROR, "Could not convert frame for encoding\n");
+		enc->ok = false;
+		return false;
+	}
+	sws_scale(enc->sws_ctx, (const uint8_t * const*)
+			((const AVPicture *)frame)->data,
+			((const AVPicture *)frame)->linesize, 0, enc->h,
+			((AVPicture *)enc->frame)->data,
+			((AVPicture *)enc->frame)->linesize);
+
+	enc->frame->pts = index;
+	if (encoder_encode(enc, enc->frame) < 0)
+		enc->ok = false;
+
+	return enc->ok;
+}
+
+
+/* Exported function, documented in encode.h */
+bool encoder_close(struct encoder *enc)
+{
+	bool ok;
+
+	if (enc == NULL)
+		return false;
+
+	if (enc->header_written) {
+		/* Get any frames the encoder is still holding on to */
+		if (enc->ok && (enc->enc_ctx->codec->capabilities &
+				CODEC_CAP_DELAY)) {
+			int ret;
+
+			do {
+				ret = encoder_encode(enc, NULL);
+			} while (ret > 0);
+			if (ret < 0)
+				enc->ok = false;
+		}
+
+		if (av_write_trailer(enc->fmt_ctx) < 0)
+			enc->ok = false;
+	}
+
+	if (enc->enc_ctx != NULL && enc->enc_ctx->codec != NULL)
+		avcodec_close(enc->enc_ctx);
+	if (enc->fmt_ctx != NULL) {
+		if (enc->fmt_ctx->pb != NULL &&
+				!(enc->fmt_ctx->oformat->flags & AVFMT_NOFILE))
+			avio_close(enc->fmt_ctx->pb);
+		avformat_free_context(enc->fmt_ctx);
+	}
+	if (enc->frame != NULL) {
+		avpicture_free((AVPicture *)enc->frame);
+		av_free(enc->frame);
+	}
+	if (enc->sws_ctx != NULL)
+		sws_freeContext(enc->sws_ctx);
+
+	ok = enc->ok;
+	free(enc);
+
+	return ok;
+}
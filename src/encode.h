@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) 2014 Codethink Ltd. (http://www.codethink.co.uk)
+ *
+ * This file is part of ebb
+ *
+ * ebb is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * ebb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Video output
+ *
+ * Encodes kept frames straight into a video file, instead of writing a
+ * PNG series for ffmpeg to encode afterwards.
+ */
+
+#ifndef EBB_ENCODE_H
+#define EBB_ENCODE_H
+
+#include <stdbool.h>
+
+#include <libavcodec/avcodec.h>
+#include <libavutil/avutil.h>
+
+struct encoder;
+
+/**
+ * Open a video file for output
+ *
+ * Unless it's given, the container format is chosen from the file name.
+ *
+ * \param file_name  Path to file to write
+ * \param format     Name of container format, e.g. "matroska", or NULL
+ * \param codec      Name of encoder to use, e.g. "libx264"
+ * \param crf        Constant rate factor for the encoder, or NULL
+ * \param w          Frame width
+ * \param h          Frame height
+ * \param fps        Frame rate
+ * \return new encoder, or NULL on failure
+ */
+struct encoder *encoder_open(const char *file_name, const char *format,
+		const char *codec, const char *crf, int w, int h,
+		AVRational fps);
+
+/**
+ * Encode an RGB24 frame
+ *
+ * Frames must be given in order.
+ *
+ * \param enc    Encoder to use
+ * \param frame  RGB24 frame to encode
+ * \param index  Output frame number, which sets the frame's timestamp
+ * \return true on success, else false
+ */
+bool encoder_write(struct encoder *enc, const AVFrame *frame, int index);
+
+/**
+ * Finish and close a video file
+ *
+ * \param enc  Encoder to close
+ * \return true if the whole file was written successfully, else false
+ */
+bool encoder_close(struct encoder *enc);
+
+#endif
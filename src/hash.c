@@ -0,0 +1,130 @@
+/*
+ * Copyright (c) 2014 Codethink Ltd. (http://www.codethink.co.uk)
+ *
+ * This file is part of ebb
+ *
+ * ebb is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * ebb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include "hash.h"
+
+#define PRIME1 11400714785074694791ULL
+#define PRIME2 14029467366897019727ULL
+#define PRIME3 1609587929392839161ULL
+#define PRIME4 9650029242287828579ULL
+#define PRIME5 2870177450012600261ULL
+
+
+static inline uint64_t rotl64(uint64_t x, int r)
+{
+	return (x << r) | (x >> (64 - r));
+}
+
+
+static inline uint64_t read64(const uint8_t *p)
+{
+	uint64_t v;
+
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+
+static inline uint32_t read32(const uint8_t *p)
+{
+	uint32_t v;
+
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+
+/** Mix a word into an accumulator */
+static inline uint64_t round64(uint64_t acc, uint64_t input)
+{
+	acc += input * PRIME2;
+	acc = rotl64(acc, 31);
+	return acc * PRIME1;
+}
+
+
+/** Merge an accumulator into the final hash */
+static inline uint64_t merge64(uint64_t h, uint64_t acc)
+{
+	h ^= round64(0, acc);
+	return h * PRIME1 + PRIME4;
+}
+
+
+/* Exported function, documented in hash.h */
+uint64_t hash64(const void *data, size_t len, uint64_t seed)
+{
+	const uint8_t *p = data;
+	const uint8_t *end = p + len;
+	uint64_t h;
+
+	if (len >= 32) {
+		const uint8_t *limit = end - 32;
+		uint64_t v1 = seed + PRIME1 + PRIME2;
+		uint64_t v2 = seed + PRIME2;
+		uint64_t v3 = seed;
+		uint64_t v4 = seed - PRIME1;
+
+		do {
+			v1 = round64(v1, read64(p));
+			v2 = round64(v2, read64(p + 8));
+			v3 = round64(v3, read64(p + 16));
+			v4 = round64(v4, read64(p + 24));
+			p += 32;
+		} while (p <= limit);
+
+		h = rotl64(v1, 1) + rotl64(v2, 7) +
+				rotl64(v3, 12) + rotl64(v4, 18);
+		h = merge64(h, v1);
+		h = merge64(h, v2);
+		h = merge64(h, v3);
+		h = merge64(h, v4);
+	} else {
+		h = seed + PRIME5;
+	}
+
+	h += len;
+
+	/* Finish off what's left */
+	while (p + 8 <= end) {
+		h ^= round64(0, read64(p));
+		h = rotl64(h, 27) * PRIME1 + PRIME4;
+		p += 8;
+	}
+	if (p + 4 <= end) {
+		h ^= (uint64_t)read32(p) * PRIME1;
+		h = rotl64(h, 23) * PRIME2 + PRIME3;
+		p += 4;
+	}
+	while (p < end) {
+		h ^= *p * PRIME5;
+		h = rotl64(h, 11) * PRIME1;
+		p++;
+	}
+
+	/* Avalanche */
+	h ^= h >> 33;
+	h *= PRIME2;
+	h ^= h >> 29;
+	h *= PRIME3;
+	h ^= h >> 32;
+
+	return h;
+}
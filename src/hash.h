@@ -0,0 +1,45 @@
+/*
+ * Copyright (c) 2014 Codethink Ltd. (http://www.codethink.co.uk)
+ *
+ * This file is part of ebb
+ *
+ * ebb is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * ebb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Fast non-cryptographic hashing
+ *
+ * An implementation of xxHash64, for telling whether image data has
+ * changed without comparing it against a copy.  Words are read in the
+ * CPU's byte order, so hashes are only comparable on the same machine.
+ */
+
+#ifndef EBB_HASH_H
+#define EBB_HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Hash a block of data
+ *
+ * Blocks can be chained by passing one's hash as the seed of the next.
+ *
+ * \param data  Data to hash
+ * \param len   Length of data in bytes
+ * \param seed  Starting value
+ * \return the hash
+ */
+uint64_t hash64(const void *data, size_t len, uint64_t seed);
+
+#endif
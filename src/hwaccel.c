@@ -0,0 +1,444 @@
+/*
+ * Copyright (c) 2014 Codethink Ltd. (http://www.codethink.co.uk)
+ *
+ * This file is part of ebb
+ *
+ * ebb is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * ebb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "hwaccel.h"
+#include "log.h"
+
+#ifdef EBB_VAAPI
+
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <libavcodec/vaapi.h>
+#include <libavutil/imgutils.h>
+#include <libswscale/swscale.h>
+#include <va/va.h>
+#include <va/va_drm.h>
+
+/**
+ * Number of surfaces to decode into
+ *
+ * H.264 may refer back to 16 frames, and needs one to decode into, with
+ * a couple spare for frames the decoder hasn't released yet.
+ */
+#define HWACCEL_SURFACES 20
+
+/** A decoder's VA-API device */
+struct hwaccel {
+	int fd;				/**< DRM render node */
+	VADisplay display;
+	bool initialised;		/**< Whether display is initialised */
+	VAConfigID config;
+	VAContextID context;
+	VASurfaceID surfaces[HWACCEL_SURFACES];
+	bool used[HWACCEL_SURFACES];	/**< Surfaces the decoder has */
+	int n_surfaces;			/**< Surfaces created */
+	VAImage image;			/**< NV12 image to download into */
+	struct vaapi_context va;	/**< Decoder's hwaccel_context */
+	int w, h;			/**< Frame dimensions */
+	struct SwsContext *sws;		/**< For frames decoded in software */
+	bool warned;			/**< Whether software decode was noted */
+};
+
+/** VA-API profiles of the codecs the decoder can use it for */
+static const struct {
+	enum CodecID codec_id;
+	VAProfile profile;
+} hwaccel_profiles[] = {
+	{ CODEC_ID_H264, VAProfileH264High },
+	{ CODEC_ID_MPEG2VIDEO, VAProfileMPEG2Main },
+	{ CODEC_ID_MPEG4, VAProfileMPEG4AdvancedSimple },
+	{ CODEC_ID_H263, VAProfileMPEG4AdvancedSimple },
+	{ CODEC_ID_VC1, VAProfileVC1Advanced },
+	{ CODEC_ID_WMV3, VAProfileVC1Main },
+	{ CODEC_ID_NONE, VAProfileNone }
+};
+
+
+/** Free a device and everything made on it */
+static void hwaccel_free(struct hwaccel *hw)
+{
+	if (hw->sws != NULL)
+		sws_freeContext(hw->sws);
+	if (hw->image.image_id != VA_INVALID_ID)
+		vaDestroyImage(hw->display, hw->image.image_id);
+	if (hw->context != VA_INVALID_ID)
+		vaDestroyContext(hw->display, hw->context);
+	if (hw->n_surfaces > 0)
+		vaDestroySurfaces(hw->display, hw->surfaces, hw->n_surfaces);
+	if (hw->config != VA_INVALID_ID)
+		vaDestroyConfig(hw->display, hw->config);
+	if (hw->initialised)
+		vaTerminate(hw->display);
+	if (hw->fd >= 0)
+		close(hw->fd);
+	free(hw);
+}
+
+
+/** Find whether the device can decode a profile */
+static bool hwaccel_has_profile(struct hwaccel *hw, VAProfile profile)
+{
+	int n = vaMaxNumProfiles(hw->display);
+	VAProfile *profiles = malloc(n * sizeof(*profiles));
+	bool found = false;
+	int i;
+
+	if (profiles == NULL)
+		return false;
+
+	if (vaQueryConfigProfiles(hw->display, profiles, &n) ==
+			VA_STATUS_SUCCESS) {
+		for (i = 0; i < n; i++)
+			found |= profiles[i] == profile;
+	}
+
+	free(profiles);
+	return found;
+}
+
+
+/** Create an NV12 image of the frame size, to download surfaces into */
+static bool hwaccel_image_init(struct hwaccel *hw)
+{
+	int n = vaMaxNumImageFormats(hw->display);
+	VAImageFormat *formats = malloc(n * sizeof(*formats));
+	bool ok = false;
+	int i;
+
+	if (formats == NULL)
+		return false;
+
+	if (vaQueryImageFormats(hw->display, formats, &n) ==
+			VA_STATUS_SUCCESS) {
+		for (i = 0; i < n && !ok; i++) {
+			if (formats[i].fourcc != VA_FOURCC_NV12)
+				continue;
+			ok = vaCreateImage(hw->display, &formats[i],
+					hw->w, hw->h, &hw->image) ==
+					VA_STATUS_SUCCESS;
+		}
+	}
+
+	free(formats);
+	return ok;
+}
+
+
+/**
+ * Set up decoding of a profile on the device
+ *
+ * Surfaces are rounded up to whole macroblocks, as the decoder writes.
+ */
+static bool hwaccel_init(struct hwaccel *hw, VAProfile profile)
+{
+	VAConfigAttrib attrib = { VAConfigAttribRTFormat, 0 };
+	const int sw = (hw->w + 15) & ~15;
+	const int sh = (hw->h + 15) & ~15;
+	int major, minor;
+
+	if (vaInitialize(hw->display, &major, &minor) != VA_STATUS_SUCCESS)
+		return false;
+	hw->initialised = true;
+	LOG(LOG_DEBUG, "VA-API %i.%i: %s\n", major, minor,
+			vaQueryVendorString(hw->display));
+
+	if (!hwaccel_has_profile(hw, profile)) {
+		LOG(LOG_WARNING, "Warning: device can't decode this codec\n");
+		return false;
+	}
+
+	if (vaGetConfigAttributes(hw->display, profile, VAEntrypointVLD,
+			&attrib, 1) != VA_STATUS_SUCCESS ||
+			!(attrib.value & VA_RT_FORMAT_YUV420))
+		return false;
+	attrib.value = VA_RT_FORMAT_YUV420;
+	if (vaCreateConfig(hw->display, profile, VAEntrypointVLD,
+			&attrib, 1, &hw->config) != VA_STATUS_SUCCESS)
+		return false;
+
+#if VA_CHECK_VERSION(0, 34, 0)
+	if (vaCreateSurfaces(hw->display, VA_RT_FORMAT_YUV420, sw, sh,
+			hw->surfaces, HWACCEL_SURFACES, NULL, 0) !=
+			VA_STATUS_SUCCESS)
+		return false;
+#else
+	if (vaCreateSurfaces(hw->display, sw, sh, VA_RT_FORMAT_YUV420,
+			HWACCEL_SURFACES, hw->surfaces) != VA_STATUS_SUCCESS)
+		return false;
+#endif
+	hw->n_surfaces = HWACCEL_SURFACES;
+
+	if (vaCreateContext(hw->display, hw->config, sw, sh, VA_PROGRESSIVE,
+			hw->surfaces, hw->n_surfaces, &hw->context) !=
+			VA_STATUS_SUCCESS)
+		return false;
+
+	if (!hwaccel_image_init(hw))
+		return false;
+
+	memset(&hw->va, 0, sizeof(hw->va));
+	hw->va.display = hw->display;
+	hw->va.config_id = hw->config;
+	hw->va.context_id = hw->context;
+
+	return true;
+}
+
+
+/**
+ * Decoder callback to pick a pixel format
+ *
+ * The device is used if the decoder offers it, and the stream is still
+ * the size the device was set up for.
+ */
+static enum PixelFormat hwaccel_get_format(AVCodecContext *dec_ctx,
+		const enum PixelFormat *fmt)
+{
+	struct hwaccel *hw = dec_ctx->opaque;
+	int i;
+
+	for (i = 0; fmt[i] != PIX_FMT_NONE; i++) {
+		if (fmt[i] == PIX_FMT_VAAPI_VLD &&
+				dec_ctx->width == hw->w &&
+				dec_ctx->height == hw->h) {
+			dec_ctx->hwaccel_context = &hw->va;
+			return fmt[i];
+		}
+	}
+
+	if (!hw->warned) {
+		LOG(LOG_WARNING, "Warning: decoder can't use the device for "
+				"this stream, decoding in software\n");
+		hw->warned = true;
+	}
+	dec_ctx->hwaccel_context = NULL;
+	return avcodec_default_get_format(dec_ctx, fmt);
+}
+
+
+/**
+ * Decoder callback to get a frame to decode into
+ *
+ * Frames on the device are a surface, whose ID goes in data[3], and in
+ * data[0] so the decoder sees a frame there.
+ */
+static int hwaccel_get_buffer(AVCodecContext *dec_ctx, AVFrame *frame)
+{
+	struct hwaccel *hw = dec_ctx->opaque;
+	int i;
+
+	if (dec_ctx->pix_fmt != PIX_FMT_VAAPI_VLD)
+		return avcodec_default_get_buffer(dec_ctx, frame);
+
+	for (i = 0; i < hw->n_surfaces && hw->used[i]; i++)
+		;
+	if (i == hw->n_surfaces) {
+		LOG(LOG_ERROR, "Ran out of device surfaces\n");
+		return -1;
+	}
+	hw->used[i] = true;
+
+	memset(frame->data, 0, sizeof(frame->data));
+	memset(frame->linesize, 0, sizeof(frame->linesize));
+	frame->data[0] = (uint8_t *)(uintptr_t)hw->surfaces[i];
+	frame->data[3] = frame->data[0];
+	frame->type = FF_BUFFER_TYPE_USER;
+	frame->age = INT_MAX;
+	frame->reordered_opaque = dec_ctx->reordered_opaque;
+	frame->pkt_pts = dec_ctx->pkt != NULL ?
+			dec_ctx->pkt->pts : AV_NOPTS_VALUE;
+
+	return 0;
+}
+
+
+/** Decoder callback to give back a frame from hwaccel_get_buffer() */
+static void hwaccel_release_buffer(AVCodecContext *dec_ctx, AVFrame *frame)
+{
+	struct hwaccel *hw = dec_ctx->opaque;
+	VASurfaceID surface = (VASurfaceID)(uintptr_t)frame->data[3];
+	int i;
+
+	if (frame->type != FF_BUFFER_TYPE_USER) {
+		avcodec_default_release_buffer(dec_ctx, frame);
+		return;
+	}
+
+	for (i = 0; i < hw->n_surfaces; i++) {
+		if (hw->surfaces[i] == surface)
+			hw->used[i] = false;
+	}
+	memset(frame->data, 0, sizeof(frame->data));
+}
+
+
+/* Exported function, documented in hwaccel.h */
+bool hwaccel_open(AVCodecContext *dec_ctx, const char *device)
+{
+	VAProfile profile = VAProfileNone;
+	struct hwaccel *hw;
+	int i;
+
+	for (i = 0; hwaccel_profiles[i].codec_id != CODEC_ID_NONE; i++) {
+		if (hwaccel_profiles[i].codec_id == dec_ctx->codec_id)
+			profile = hwaccel_profiles[i].profile;
+	}
+	if (profile == VAProfileNone || (dec_ctx->pix_fmt != PIX_FMT_YUV420P &&
+			dec_ctx->pix_fmt != PIX_FMT_YUVJ420P)) {
+		LOG(LOG_WARNING, "Warning: can't decode this stream on the "
+				"device, decoding in software\n");
+		return false;
+	}
+
+	hw = calloc(1, sizeof(*hw));
+	if (hw == NULL)
+		return false;
+	hw->config = VA_INVALID_ID;
+	hw->context = VA_INVALID_ID;
+	hw->image.image_id = VA_INVALID_ID;
+	hw->w = dec_ctx->width;
+	hw->h = dec_ctx->height;
+
+	hw->fd = open(device, O_RDWR);
+	if (hw->fd < 0) {
+		LOG(LOG_WARNING, "Warning: could not open device: '%s', "
+				"decoding in software\n", device);
+		hwaccel_free(hw);
+		return false;
+	}
+	hw->display = vaGetDisplayDRM(hw->fd);
+	if (hw->display == NULL || !hwaccel_init(hw, profile)) {
+		LOG(LOG_WARNING, "Warning: could not set up VA-API on "
+				"device: '%s', decoding in software\n", device);
+		hwaccel_free(hw);
+		return false;
+	}
+
+	dec_ctx->opaque = hw;
+	dec_ctx->get_format = hwaccel_get_format;
+	dec_ctx->get_buffer = hwaccel_get_buffer;
+	dec_ctx->release_buffer = hwaccel_release_buffer;
+	dec_ctx->thread_type &= ~FF_THREAD_FRAME;
+
+	LOG(LOG_INFO, "Decoding with VA-API on '%s'\n", device);
+	return true;
+}
+
+
+/* Exported function, documented in hwaccel.h */
+void hwaccel_close(AVCodecContext *dec_ctx)
+{
+	if (dec_ctx->opaque == NULL)
+		return;
+
+	hwaccel_free(dec_ctx->opaque);
+	dec_ctx->opaque = NULL;
+	dec_ctx->hwaccel_context = NULL;
+}
+
+
+/** Copy a surface's picture into a frame in system memory */
+static bool hwaccel_download_surface(struct hwaccel *hw, AVFrame *dst,
+		VASurfaceID surface)
+{
+	uint8_t *buf;
+
+	if (vaSyncSurface(hw->display, surface) != VA_STATUS_SUCCESS ||
+			vaGetImage(hw->display, surface, 0, 0, hw->w, hw->h,
+			hw->image.image_id) != VA_STATUS_SUCCESS ||
+			vaMapBuffer(hw->display, hw->image.buf,
+			(void **)&buf) != VA_STATUS_SUCCESS) {
+		LOG(LOG_ERROR, "Could not download frame from device\n");
+		return false;
+	}
+
+	av_image_copy_plane(dst->data[0], dst->linesize[0],
+			buf + hw->image.offsets[0], hw->image.pitches[0],
+			hw->w, hw->h);
+	av_image_copy_plane(dst->data[1], dst->linesize[1],
+			buf + hw->image.offsets[1], hw->image.pitches[1],
+			(hw->w + 1) & ~1, (hw->h + 1) / 2);
+
+	vaUnmapBuffer(hw->display, hw->image.buf);
+	return true;
+}
+
+
+/* Exported function, documented in hwaccel.h */
+bool hwaccel_download(AVCodecContext *dec_ctx, AVFrame *dst,
+		const AVFrame *src)
+{
+	struct hwaccel *hw = dec_ctx->opaque;
+
+	if (dec_ctx->pix_fmt == PIX_FMT_VAAPI_VLD)
+		return hwaccel_download_surface(hw, dst,
+				(VASurfaceID)(uintptr_t)src->data[3]);
+
+	/* The decoder fell back to software, so make its frames look like
+	 * those from the device */
+	hw->sws = sws_getCachedContext(hw->sws, hw->w, hw->h,
+			dec_ctx->pix_fmt, hw->w, hw->h, HWACCEL_PIX_FMT,
+			SWS_POINT, NULL, NULL, NULL);
+	if (hw->sws == NULL) {
+		LOG(LOG_ERROR, "Could not convert decoded frame\n");
+		return false;
+	}
+	sws_scale(hw->sws, (const uint8_t * const*)src->data, src->linesize,
+			0, hw->h, dst->data, dst->linesize);
+	return true;
+}
+
+#else
+
+
+/* Exported function, documented in hwaccel.h */
+bool hwaccel_open(AVCodecContext *dec_ctx, const char *device)
+{
+	(void)dec_ctx;
+	(void)device;
+
+	LOG(LOG_WARNING, "Warning: ebb was built without VA-API, decoding in "
+			"software\n");
+	return false;
+}
+
+
+/* Exported function, documented in hwaccel.h */
+void hwaccel_close(AVCodecContext *dec_ctx)
+{
+	(void)dec_ctx;
+}
+
+
+/* Exported function, documented in hwaccel.h */
+bool hwaccel_download(AVCodecContext *dec_ctx, AVFrame *dst,
+		const AVFrame *src)
+{
+	(void)dec_ctx;
+	(void)dst;
+	(void)src;
+
+	return false;
+}
+
+#endif
@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) 2014 Codethink Ltd. (http://www.codethink.co.uk)
+ *
+ * This file is part of ebb
+ *
+ * ebb is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * ebb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Hardware decoding
+ *
+ * Decodes on a VA-API device, through the decoder's get_format() and
+ * get_buffer() hooks and a vaapi_context as its hwaccel_context.  Frames
+ * are decoded into surfaces on the device, and downloaded as NV12 to be
+ * compared and converted like any other frames.  If the decoder won't use
+ * the device for a stream after all, its frames are converted to NV12
+ * instead, so they come out the same either way.
+ *
+ * This needs libva, so is only built with "make VAAPI=1".  Otherwise
+ * hwaccel_open() always fails, and decoding stays in software.
+ */
+
+#ifndef EBB_HWACCEL_H
+#define EBB_HWACCEL_H
+
+#include <stdbool.h>
+
+#include <libavcodec/avcodec.h>
+
+/** Pixel format frames are downloaded from the device in */
+#define HWACCEL_PIX_FMT PIX_FMT_NV12
+
+/** DRM render node to open, if none is given */
+#define HWACCEL_DEVICE "/dev/dri/renderD128"
+
+/**
+ * Set a decoder up to decode on a VA-API device
+ *
+ * Must be called before the decoder is opened, once its dimensions are
+ * known.  Only 8-bit 4:2:0 streams of codecs VA-API can decode are taken.
+ * Frame threading is turned off, since the decoder's hardware support
+ * doesn't work with it.
+ *
+ * \param dec_ctx  Decoder context, whose opaque pointer this takes
+ * \param device   DRM render node of the device
+ * \return true on success, or false if the stream will be decoded in
+ *         software
+ */
+bool hwaccel_open(AVCodecContext *dec_ctx, const char *device);
+
+/** Free a decoder's hardware device, after the decoder is closed */
+void hwaccel_close(AVCodecContext *dec_ctx);
+
+/**
+ * Download a decoded frame into system memory
+ *
+ * \param dec_ctx  Decoder set up by hwaccel_open()
+ * \param dst      Frame to copy into, allocated in HWACCEL_PIX_FMT
+ * \param src      Frame the decoder returned
+ * \return true on success, else false
+ */
+bool hwaccel_download(AVCodecContext *dec_ctx, AVFrame *dst,
+		const AVFrame *src);
+
+#endif
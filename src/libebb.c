@@ -0,0 +1,213 @@
+/*
+ * Copyright (c) 2014 Codethink Ltd. (http://www.codethink.co.uk)
+ *
+ * This file is part of ebb
+ *
+ * ebb is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * ebb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libebb.h"
+
+/** Boring bit excision context */
+struct ebb {
+	struct compare cmp;		/**< How frames are compared */
+	enum PixelFormat pix_fmt;	/**< Pixel format of frames */
+	int w, h;			/**< Frame dimensions */
+	int slack;			/**< Slack time in frames */
+	AVFrame *frame_prev;		/**< Last different frame */
+	AVFrame *rgb_prev;		/**< It in RGB24, if comparing that */
+	AVFrame *rgb_curr;		/**< Current frame in RGB24, likewise */
+	struct SwsContext *img_convert_ctx;
+
+	ebb_decision_fn decided;	/**< Callback for decisions */
+	void *ctx;			/**< Context for callback */
+
+	int frames;			/**< Frames pushed */
+	int kept;			/**< Frames kept */
+	int skip;			/**< Frames the same in a row */
+};
+
+/** Makes sure the difference kernels are only chosen once */
+static pthread_once_t kernels_once = PTHREAD_ONCE_INIT;
+
+
+/** Choose the best difference kernels the CPU has */
+static void kernels_init(void)
+{
+	diff_init(true);
+}
+
+
+/* Exported function, documented in libebb.h */
+void ebb_settings_init(struct ebb_settings *s)
+{
+	s->compare.mode = COMPARE_AUTO;
+	s->compare.tolerance = COMPARE_TOLERANCE;
+	s->compare.size = COMPARE_SIZE;
+	s->compare.votes = COMPARE_SIZE * COMPARE_SIZE;
+	s->compare.border = COMPARE_BORDER;
+	s->compare.scale = 1;
+	s->slack = EBB_SLACK_CS;
+	s->roi = NULL;
+}
+
+
+/** Set the region of interest, from a map of the full size frame */
+static bool ebb_set_roi(struct ebb *e, const uint8_t *roi)
+{
+	const int scale = e->cmp.scale;
+	uint8_t *map;
+	bool ok;
+	int x, y;
+
+	map = malloc(e->cmp.cw * e->cmp.ch);
+	if (map == NULL)
+		return false;
+
+	/* Downscaled pixels are in the region if their middles are */
+	for (y = 0; y < e->cmp.ch; y++) {
+		const int fy = y * scale + scale / 2;
+
+		for (x = 0; x < e->cmp.cw; x++) {
+			const int fx = x * scale + scale / 2;
+
+			map[y * e->cmp.cw + x] = roi[fy * e->w + fx] != 0;
+		}
+	}
+
+	ok = compare_set_roi(&e->cmp, map);
+	free(map);
+	return ok;
+}
+
+
+/* Exported function, documented in libebb.h */
+struct ebb *ebb_open(const struct ebb_settings *s, enum PixelFormat pix_fmt,
+		int w, int h, AVRational fps, ebb_decision_fn decided,
+		void *ctx)
+{
+	struct ebb *e;
+
+	pthread_once(&kernels_once, kernels_init);
+
+	e = calloc(1, sizeof(*e));
+	if (e == NULL)
+		return NULL;
+	e->pix_fmt = pix_fmt;
+	e->w = w;
+	e->h = h;
+	e->slack = ebb_slack_frames(s->slack, fps);
+	e->decided = decided;
+	e->ctx = ctx;
+
+	if (!compare_init(&e->cmp, &s->compare, pix_fmt, w, h))
+		goto error;
+	if (s->roi != NULL && !ebb_set_roi(e, s->roi))
+		goto error;
+
+	/* The last different frame is kept as it was pushed, to pass to
+	 * the callback, and in RGB24 too if that's what's compared */
+	e->frame_prev = frame_alloc(pix_fmt, w, h);
+	if (e->frame_prev == NULL)
+		goto error;
+	if (!e->cmp.native && e->cmp.scale == 1) {
+		e->rgb_prev = frame_alloc(PIX_FMT_RGB24, w, h);
+		e->rgb_curr = frame_alloc(PIX_FMT_RGB24, w, h);
+		if (e->rgb_prev == NULL || e->rgb_curr == NULL)
+			goto error;
+	}
+
+	return e;
+
+error:
+	ebb_close(e);
+	return NULL;
+}
+
+
+/**
+ * Compare a frame with the last different one
+ *
+ * If it differs, it becomes the new last different frame.
+ *
+ * \return true if the frame differs, else false
+ */
+static bool ebb_compare(struct ebb *e, const AVFrame *frame)
+{
+	AVFrame *frame_tmp;
+
+	if (!compare_next(&e->cmp, &e->img_convert_ctx, frame, e->frame_prev,
+			e->rgb_prev, e->rgb_curr, e->frames == 0))
+		return false;
+
+	if (compare_in_rgb(&e->cmp)) {
+		frame_tmp = e->rgb_prev;
+		e->rgb_prev = e->rgb_curr;
+		e->rgb_curr = frame_tmp;
+	}
+
+	return true;
+}
+
+
+/* Exported function, documented in libebb.h */
+bool ebb_push(struct ebb *e, const AVFrame *frame, int64_t pts)
+{
+	struct ebb_decision d;
+
+	if ((frame->format >= 0 && frame->format != e->pix_fmt) ||
+			(frame->width > 0 && frame->width != e->w) ||
+			(frame->height > 0 && frame->height != e->h))
+		return false;
+
+	d.index = e->frames;
+	d.pts = pts;
+	d.different = ebb_compare(e, frame);
+
+	d.keep = ebb_slack_keep(&e->skip, e->slack, d.different);
+	d.frame = d.keep ? e->frame_prev : NULL;
+
+	e->frames++;
+	if (d.keep)
+		e->kept++;
+
+	e->decided(e->ctx, &d);
+	return true;
+}
+
+
+/* Exported function, documented in libebb.h */
+int ebb_kept(const struct ebb *e)
+{
+	return e->kept;
+}
+
+
+/* Exported function, documented in libebb.h */
+void ebb_close(struct ebb *e)
+{
+	if (e == NULL)
+		return;
+
+	compare_fini(&e->cmp);
+	frame_free(e->frame_prev);
+	frame_free(e->rgb_prev);
+	frame_free(e->rgb_curr);
+	if (e->img_convert_ctx != NULL)
+		sws_freeContext(e->img_convert_ctx);
+	free(e);
+}
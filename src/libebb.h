@@ -0,0 +1,149 @@
+/*
+ * Copyright (c) 2014 Codethink Ltd. (http://www.codethink.co.uk)
+ *
+ * This file is part of ebb
+ *
+ * ebb is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * ebb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Boring bit excision library
+ *
+ * Finds the boring bits of frames pushed in by the caller, so that a
+ * program can decide what to keep without writing anything to disc.  Each
+ * frame is compared with the last different one, and once frames have
+ * been the same for longer than the slack, they're dropped until one
+ * differs again.  Every frame's decision is passed to a callback as soon
+ * as the frame is pushed.
+ *
+ * All state is held in a context, so any number of contexts can be used
+ * at once, from different threads, though each context must only be used
+ * from one thread at a time.  The library prints nothing, and counts no
+ * statistics, so it has no global state to share.
+ */
+
+#ifndef EBB_LIBEBB_H
+#define EBB_LIBEBB_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <libavcodec/avcodec.h>
+#include <libavutil/pixfmt.h>
+#include <libavutil/rational.h>
+
+#include "compare.h"
+
+/** Default unchanging time to keep (cs) */
+#define EBB_SLACK_CS 80
+
+/** Centiseconds in a second, which the slack is given in */
+#define EBB_SECOND_IN_CS 100
+
+/** What makes a frame boring */
+struct ebb_settings {
+	struct compare_settings compare;	/**< What makes frames differ */
+	int slack;				/**< Unchanging time to keep (cs) */
+	const uint8_t *roi;			/**< Pixels to compare, or NULL */
+};
+
+/**
+ * What was decided about a frame
+ *
+ * A kept frame shows the last frame that was different, which is itself
+ * if it's different, so frame is always set for them.
+ */
+struct ebb_decision {
+	int index;		/**< Frame number, counting from 0 */
+	int64_t pts;		/**< Timestamp the frame was pushed with */
+	bool different;		/**< Whether it has changed */
+	bool keep;		/**< Whether to keep the frame */
+	const AVFrame *frame;	/**< What a kept frame shows, or NULL */
+};
+
+/**
+ * Function called with each frame's decision
+ *
+ * A decision's frame is only valid until the function returns.
+ *
+ * \param ctx  Context given to ebb_open()
+ * \param d    The decision
+ */
+typedef void (*ebb_decision_fn)(void *ctx, const struct ebb_decision *d);
+
+struct ebb;
+
+/** Convert an unchanging time to keep (cs) to frames, at a frame rate */
+static inline int ebb_slack_frames(int slack_cs, AVRational fps)
+{
+	return slack_cs * fps.num / (EBB_SECOND_IN_CS * fps.den);
+}
+
+/**
+ * Count a frame in the run of frames that are the same, and find whether
+ * to keep it
+ *
+ * Frames are kept until they've been the same for longer than the slack.
+ *
+ * \param skip       Frames the same in a row, updated for this frame
+ * \param slack      Frames the same in a row to keep
+ * \param different  Whether the frame has changed
+ * \return true to keep the frame, else false
+ */
+static inline bool ebb_slack_keep(int *skip, int slack, bool different)
+{
+	*skip = different ? 0 : *skip + 1;
+	return *skip <= slack;
+}
+
+/** Fill in the settings the ebb program uses by default */
+void ebb_settings_init(struct ebb_settings *s);
+
+/**
+ * Start finding the boring bits of a video
+ *
+ * \param s        What makes a frame boring; the region of interest, if
+ *                 any, has one entry per pixel, w by h, non-zero for the
+ *                 pixels to compare, and is copied
+ * \param pix_fmt  Pixel format of the frames that will be pushed
+ * \param w        Frame width
+ * \param h        Frame height
+ * \param fps      Frame rate, which converts the slack to frames
+ * \param decided  Function to call with each frame's decision
+ * \param ctx      Context to pass to decided
+ * \return new context, or NULL on failure
+ */
+struct ebb *ebb_open(const struct ebb_settings *s, enum PixelFormat pix_fmt,
+		int w, int h, AVRational fps, ebb_decision_fn decided,
+		void *ctx);
+
+/**
+ * Decide whether to keep the next frame
+ *
+ * The decision is passed to the callback before this returns.  The frame
+ * isn't held on to, so may be reused by the caller straight away.
+ *
+ * \param e      Context
+ * \param frame  Frame, of the pixel format and size given to ebb_open()
+ * \param pts    Frame's timestamp, which is passed back in its decision
+ * \return true on success, or false if the frame doesn't match
+ */
+bool ebb_push(struct ebb *e, const AVFrame *frame, int64_t pts);
+
+/** Number of frames kept so far */
+int ebb_kept(const struct ebb *e);
+
+/** Free a context */
+void ebb_close(struct ebb *e);
+
+#endif
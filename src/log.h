@@ -0,0 +1,42 @@
+/*
+ * Copyright (c) 2014 Codethink Ltd. (http://www.codethink.co.uk)
+ *
+ * This file is part of ebb
+ *
+ * ebb is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * ebb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Terminal output
+ */
+
+#ifndef EBB_LOG_H
+#define EBB_LOG_H
+
+#include <stdio.h>
+
+enum log_level {
+	LOG_DEBUG,
+	LOG_INFO,
+	LOG_RESULT,
+	LOG_WARNING,
+	LOG_ERROR
+};
+
+extern enum log_level level;
+
+#define LOG(lev, fmt, ...)				\
+	if (lev >= level)				\
+		printf(fmt, ##__VA_ARGS__);
+
+#endif
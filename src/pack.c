@@ -0,0 +1,264 @@
+/*
+ * Copyright (c) 2014 Codethink Ltd. (http://www.codethink.co.uk)
+ *
+ * This file is part of ebb
+ *
+ * ebb is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * ebb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "log.h"
+#include "pack.h"
+#include "stats.h"
+
+/** Size of the output buffer, so entries go out in big writes */
+#define PACK_BUFFER_SIZE (4 * 1024 * 1024)
+
+/** Tar files are made of blocks of this many bytes */
+#define PACK_BLOCK 512
+
+/** POSIX ustar header, which fills a block */
+struct pack_header {
+	char name[100];
+	char mode[8];
+	char uid[8];
+	char gid[8];
+	char size[12];
+	char mtime[12];
+	char checksum[8];
+	char type;
+	char link_name[100];
+	char magic[6];
+	char version[2];
+	char user[32];
+	char group[32];
+	char dev_major[8];
+	char dev_minor[8];
+	char prefix[155];
+	char pad[12];
+};
+
+/** A pack of PNGs */
+struct pack {
+	FILE *fp;
+	pthread_mutex_t lock;	/**< Keeps each entry's blocks together */
+	long long mtime;	/**< Modification time given to entries */
+	char *buffer;		/**< Output buffer */
+	bool ok;		/**< Whether everything has been written */
+};
+
+
+/* Exported function, documented in pack.h */
+struct pack *pack_open(const char *file_name)
+{
+	struct pack *p;
+
+	p = calloc(1, sizeof(*p));
+	if (p == NULL)
+		return NULL;
+	pthread_mutex_init(&p->lock, NULL);
+	p->mtime = time(NULL);
+	p->ok = true;
+
+	p->fp = fopen(file_name, "wb");
+	p->buffer = malloc(PACK_BUFFER_SIZE);
+	if (p->fp == NULL || p->buffer == NULL) {
+		LOG(LOG_ERROR, "Could not open pack: '%s'\n", file_name);
+		p->ok = false;
+		pack_close(p);
+		return NULL;
+	}
+	setvbuf(p->fp, p->buffer, _IOFBF, PACK_BUFFER_SIZE);
+
+	return p;
+}
+
+
+/**
+ * Put an entry's name in a header
+ *
+ * A name too long for the name field is split at a '/' between it and the
+ * prefix field.  Neither needs a terminating NUL if it's full.
+ *
+ * \return true on success, or false if the name can't fit
+ */
+static bool pack_set_name(struct pack_header *h, const char *name)
+{
+	size_t len = strlen(name);
+	const char *slash;
+
+	if (len <= sizeof(h->name)) {
+		memcpy(h->name, name, len);
+		return true;
+	}
+
+	/* The '/' the prefix is joined on with isn't in either field */
+	for (slash = strchr(name, '/'); slash != NULL &&
+			(size_t)(slash - name) <= sizeof(h->prefix);
+			slash = strchr(slash + 1, '/')) {
+		size_t rest = len - (slash - name) - 1;
+
+		if (rest > 0 && rest <= sizeof(h->name)) {
+			memcpy(h->prefix, name, slash - name);
+			memcpy(h->name, slash + 1, rest);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+/**
+ * Write the header for an entry, with the pack locked
+ *
+ * \return true on success, or false if a name is too long for a tar
+ */
+static bool pack_header(struct pack *p, const char *name, size_t len,
+		char type, const char *link_name)
+{
+	struct pack_header h;
+	const unsigned char *bytes = (const unsigned char *)&h;
+	unsigned sum = 0;
+	size_t i;
+
+	memset(&h, 0, sizeof(h));
+	if (!pack_set_name(&h, name) || (link_name != NULL &&
+			strlen(link_name) > sizeof(h.link_name))) {
+		LOG(LOG_ERROR, "Name too long for pack: '%s'\n",
+				link_name != NULL ? link_name : name);
+		return false;
+	}
+	strcpy(h.mode, "0000644");
+	strcpy(h.uid, "0000000");
+	strcpy(h.gid, "0000000");
+	snprintf(h.size, sizeof(h.size), "%011llo", (unsigned long long)len);
+	snprintf(h.mtime, sizeof(h.mtime), "%011llo", p->mtime);
+	h.type = type;
+	if (link_name != NULL)
+		memcpy(h.link_name, link_name, strlen(link_name));
+	memcpy(h.magic, "ustar", 6);
+	memcpy(h.version, "00", 2);
+
+	/* The checksum is worked out as if its own field were spaces */
+	memset(h.checksum, ' ', sizeof(h.checksum));
+	for (i = 0; i < sizeof(h); i++)
+		sum += bytes[i];
+	snprintf(h.checksum, sizeof(h.checksum), "%06o", sum);
+
+	fwrite(&h, sizeof(h), 1, p->fp);
+	return true;
+}
+
+
+/** Check whether the entry just written made it out */
+static bool pack_check(struct pack *p)
+{
+	if (p->ok && ferror(p->fp)) {
+		LOG(LOG_ERROR, "Could not write to pack\n");
+		p->ok = false;
+	}
+
+	return p->ok;
+}
+
+
+/* Exported function, documented in pack.h */
+bool pack_add(struct pack *p, const char *name, const void *data, size_t len)
+{
+	static const char zeros[PACK_BLOCK];
+	bool ok;
+
+	pthread_mutex_lock(&p->lock);
+	ok = pack_header(p, name, len, '0', NULL);
+	if (ok) {
+		fwrite(data, 1, len, p->fp);
+		if (len % PACK_BLOCK != 0)
+			fwrite(zeros, 1, PACK_BLOCK - len % PACK_BLOCK,
+					p->fp);
+		ok = pack_check(p);
+	}
+	pthread_mutex_unlock(&p->lock);
+
+	if (ok)
+		stats_count(&stats.bytes, len);
+	return ok;
+}
+
+
+/* Exported function, documented in pack.h */
+bool pack_add_file(struct pack *p, const char *name, const char *file_name)
+{
+	FILE *fp;
+	char *data = NULL;
+	long len;
+	bool ok = false;
+
+	fp = fopen(file_name, "rb");
+	if (fp == NULL)
+		return false;
+
+	if (fseek(fp, 0, SEEK_END) != 0 || (len = ftell(fp)) < 0 ||
+			fseek(fp, 0, SEEK_SET) != 0)
+		goto free;
+
+	data = malloc(len > 0 ? len : 1);
+	if (data == NULL || fread(data, 1, len, fp) != (size_t)len)
+		goto free;
+
+	ok = pack_add(p, name, data, len);
+free:
+	free(data);
+	fclose(fp);
+	return ok;
+}
+
+
+/* Exported function, documented in pack.h */
+bool pack_link(struct pack *p, const char *name, const char *target)
+{
+	bool ok;
+
+	pthread_mutex_lock(&p->lock);
+	ok = pack_header(p, name, 0, '1', target) && pack_check(p);
+	pthread_mutex_unlock(&p->lock);
+
+	return ok;
+}
+
+
+/* Exported function, documented in pack.h */
+bool pack_close(struct pack *p)
+{
+	static const char zeros[2 * PACK_BLOCK];
+	bool ok = p->ok;
+
+	/* A tar file ends with two empty blocks */
+	if (p->fp != NULL) {
+		if (ok && fwrite(zeros, sizeof(zeros), 1, p->fp) != 1)
+			ok = false;
+		if (fclose(p->fp) != 0)
+			ok = false;
+	}
+	pthread_mutex_destroy(&p->lock);
+	free(p->buffer);
+	free(p);
+
+	return ok;
+}
@@ -0,0 +1,88 @@
+/*
+ * Copyright (c) 2014 Codethink Ltd. (http://www.codethink.co.uk)
+ *
+ * This file is part of ebb
+ *
+ * ebb is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * ebb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Packed PNG output
+ *
+ * Puts the kept frames' PNGs into a single tar file, rather than a file
+ * each, for storage where creating files costs more than writing them.
+ * Frames that are the same as the one before are stored as hard links,
+ * so take no more space than their headers.  Entries go through one big
+ * buffer, and may be added from several threads.
+ *
+ * Entry names longer than the 100 bytes a ustar name holds are split at a
+ * '/' into its prefix field.  Entries whose names still don't fit, or
+ * links whose targets are longer than 100 bytes, are refused.
+ */
+
+#ifndef EBB_PACK_H
+#define EBB_PACK_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+struct pack;
+
+/**
+ * Open a file or pipe to pack PNGs into
+ *
+ * \param file_name  Path to write to
+ * \return new pack, or NULL on failure
+ */
+struct pack *pack_open(const char *file_name);
+
+/**
+ * Add a file to a pack
+ *
+ * \param p     Pack to add to
+ * \param name  Name of the file in the pack
+ * \param data  Contents of the file
+ * \param len   Length of data in bytes
+ * \return true on success, else false
+ */
+bool pack_add(struct pack *p, const char *name, const void *data, size_t len);
+
+/**
+ * Add a copy of a file on disc to a pack
+ *
+ * \param p          Pack to add to
+ * \param name       Name of the file in the pack
+ * \param file_name  Path of the file to copy
+ * \return true on success, else false
+ */
+bool pack_add_file(struct pack *p, const char *name, const char *file_name);
+
+/**
+ * Add a hard link to a file already in a pack
+ *
+ * \param p       Pack to add to
+ * \param name    Name of the link in the pack
+ * \param target  Name of the file in the pack it links to
+ * \return true on success, else false
+ */
+bool pack_link(struct pack *p, const char *name, const char *target);
+
+/**
+ * Finish and close a pack
+ *
+ * \param p  Pack to close
+ * \return true if everything was written, else false
+ */
+bool pack_close(struct pack *p);
+
+#endif
@@ -0,0 +1,367 @@
+/*
+ * Copyright (c) 2014 Codethink Ltd. (http://www.codethink.co.uk)
+ *
+ * This file is part of ebb
+ *
+ * ebb is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * ebb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "pipeline.h"
+
+
+/* Exported function, documented in pipeline.h */
+void budget_init(struct budget *b, size_t size)
+{
+	pthread_mutex_init(&b->lock, NULL);
+	pthread_cond_init(&b->freed, NULL);
+	b->size = size;
+	b->used = 0;
+}
+
+
+/* Exported function, documented in pipeline.h */
+void budget_fini(struct budget *b)
+{
+	pthread_cond_destroy(&b->freed);
+	pthread_mutex_destroy(&b->lock);
+}
+
+
+/* Exported function, documented in pipeline.h */
+bool queue_init_shared(struct queue *q, int size, size_t item_size,
+		struct budget *budget)
+{
+	q->items = malloc(size * item_size);
+	q->costs = malloc(size * sizeof(*q->costs));
+	if (q->items == NULL || q->costs == NULL) {
+		free(q->items);
+		free(q->costs);
+		return false;
+	}
+
+	pthread_mutex_init(&q->lock, NULL);
+	pthread_cond_init(&q->not_empty, NULL);
+	pthread_cond_init(&q->not_full, NULL);
+	pthread_cond_init(&q->idle, NULL);
+	budget_init(&q->own, 0);
+	q->item_size = item_size;
+	q->size = size;
+	q->head = 0;
+	q->count = 0;
+	q->budget = budget;
+	q->unfinished = 0;
+	q->closed = false;
+
+	return true;
+}
+
+
+/* Exported function, documented in pipeline.h */
+bool queue_init(struct queue *q, int size, size_t item_size, size_t budget)
+{
+	if (!queue_init_shared(q, size, item_size, &q->own))
+		return false;
+
+	q->own.size = budget;
+	return true;
+}
+
+
+/* Exported function, documented in pipeline.h */
+void queue_fini(struct queue *q)
+{
+	pthread_cond_destroy(&q->idle);
+	pthread_cond_destroy(&q->not_full);
+	pthread_cond_destroy(&q->not_empty);
+	pthread_mutex_destroy(&q->lock);
+	budget_fini(&q->own);
+	free(q->items);
+	free(q->costs);
+	q->items = NULL;
+	q->costs = NULL;
+}
+
+
+/* Exported function, documented in pipeline.h */
+bool queue_push(struct queue *q, const void *item, size_t cost)
+{
+	struct budget *b = q->budget;
+	int tail;
+
+	/* Take the item's cost from the budget first, without holding the
+	 * queue, so its items can still be taken while we wait.  Closing
+	 * the queue holds both locks, so either is enough to check it. */
+	pthread_mutex_lock(&b->lock);
+	while (b->used > 0 && (b->used >= b->size ||
+			cost > b->size - b->used) && !q->closed)
+		pthread_cond_wait(&b->freed, &b->lock);
+	if (q->closed) {
+		pthread_mutex_unlock(&b->lock);
+		return false;
+	}
+	b->used += cost;
+	pthread_mutex_unlock(&b->lock);
+
+	pthread_mutex_lock(&q->lock);
+	while (q->count == q->size && !q->closed)
+		pthread_cond_wait(&q->not_full, &q->lock);
+
+	if (q->closed) {
+		pthread_mutex_unlock(&q->lock);
+		queue_release(q, cost);
+		return false;
+	}
+
+	tail = (q->head + q->count) % q->size;
+	memcpy(q->items + tail * q->item_size, item, q->item_size);
+	q->costs[tail] = cost;
+	q->count++;
+	q->unfinished++;
+
+	pthread_cond_signal(&q->not_empty);
+	pthread_mutex_unlock(&q->lock);
+
+	return true;
+}
+
+
+/* Exported function, documented in pipeline.h */
+bool queue_pop(struct queue *q, void *item, size_t *cost)
+{
+	pthread_mutex_lock(&q->lock);
+	while (q->count == 0 && !q->closed)
+		pthread_cond_wait(&q->not_empty, &q->lock);
+
+	if (q->count == 0) {
+		pthread_mutex_unlock(&q->lock);
+		return false;
+	}
+
+	memcpy(item, q->items + q->head * q->item_size, q->item_size);
+	*cost = q->costs[q->head];
+	q->head = (q->head + 1) % q->size;
+	q->count--;
+
+	pthread_cond_signal(&q->not_full);
+	pthread_mutex_unlock(&q->lock);
+
+	return true;
+}
+
+
+/* Exported function, documented in pipeline.h */
+void queue_release(struct queue *q, size_t cost)
+{
+	struct budget *b = q->budget;
+
+	if (cost == 0)
+		return;
+
+	pthread_mutex_lock(&b->lock);
+	b->used -= cost;
+	pthread_cond_broadcast(&b->freed);
+	pthread_mutex_unlock(&b->lock);
+}
+
+
+/* Exported function, documented in pipeline.h */
+void queue_done(struct queue *q)
+{
+	pthread_mutex_lock(&q->lock);
+	q->unfinished--;
+	if (q->unfinished == 0)
+		pthread_cond_broadcast(&q->idle);
+	pthread_mutex_unlock(&q->lock);
+}
+
+
+/* Exported function, documented in pipeline.h */
+void queue_wait_idle(struct queue *q)
+{
+	pthread_mutex_lock(&q->lock);
+	while (q->unfinished > 0)
+		pthread_cond_wait(&q->idle, &q->lock);
+	pthread_mutex_unlock(&q->lock);
+}
+
+
+/* Exported function, documented in pipeline.h */
+void queue_close(struct queue *q)
+{
+	pthread_mutex_lock(&q->lock);
+	pthread_mutex_lock(&q->budget->lock);
+	q->closed = true;
+	pthread_cond_broadcast(&q->not_empty);
+	pthread_cond_broadcast(&q->not_full);
+	pthread_cond_broadcast(&q->budget->freed);
+	pthread_mutex_unlock(&q->budget->lock);
+	pthread_mutex_unlock(&q->lock);
+}
+
+
+/* Exported function, documented in pipeline.h */
+int queue_depth(struct queue *q)
+{
+	int count;
+
+	pthread_mutex_lock(&q->lock);
+	count = q->count;
+	pthread_mutex_unlock(&q->lock);
+
+	return count;
+}
+
+
+/** Thread main loop for threaded stages */
+static void *stage_thread(void *data)
+{
+	struct stage *s = data;
+	void *item = malloc(s->queue.item_size);
+	size_t cost;
+
+	if (item == NULL) {
+		/* Can't take items, so make sure senders don't block */
+		queue_close(&s->queue);
+		return NULL;
+	}
+
+	while (queue_pop(&s->queue, item, &cost)) {
+		s->process(s->ctx, item);
+		queue_release(&s->queue, cost);
+		queue_done(&s->queue);
+	}
+
+	free(item);
+	return NULL;
+}
+
+
+/** Start a stage's threads, once its queue is set up */
+static bool stage_spawn(struct stage *s, int threads)
+{
+	s->threads = malloc(threads * sizeof(*s->threads));
+	if (s->threads == NULL) {
+		queue_fini(&s->queue);
+		return false;
+	}
+
+	for (s->n_threads = 0; s->n_threads < threads; s->n_threads++) {
+		if (pthread_create(&s->threads[s->n_threads], NULL,
+				stage_thread, s) != 0)
+			break;
+	}
+
+	/* Manage with however many threads we got */
+	if (s->n_threads == 0) {
+		free(s->threads);
+		queue_fini(&s->queue);
+		return false;
+	}
+
+	return true;
+}
+
+
+/** Set up the parts of a stage that don't depend on its budget */
+static void stage_setup(struct stage *s, int threads,
+		stage_process_fn process, void *ctx)
+{
+	s->threaded = threads > 0;
+	s->process = process;
+	s->ctx = ctx;
+	s->threads = NULL;
+	s->n_threads = 0;
+}
+
+
+/* Exported function, documented in pipeline.h */
+bool stage_start(struct stage *s, int threads, int depth, size_t budget,
+		size_t item_size, stage_process_fn process, void *ctx)
+{
+	stage_setup(s, threads, process, ctx);
+	if (!s->threaded)
+		return true;
+
+	if (!queue_init(&s->queue, depth, item_size, budget))
+		return false;
+
+	return stage_spawn(s, threads);
+}
+
+
+/* Exported function, documented in pipeline.h */
+bool stage_start_shared(struct stage *s, int threads, int depth,
+		struct budget *budget, size_t item_size,
+		stage_process_fn process, void *ctx)
+{
+	stage_setup(s, threads, process, ctx);
+	if (!s->threaded)
+		return true;
+
+	if (!queue_init_shared(&s->queue, depth, item_size, budget))
+		return false;
+
+	return stage_spawn(s, threads);
+}
+
+
+/* Exported function, documented in pipeline.h */
+bool stage_send(struct stage *s, const void *item)
+{
+	return stage_send_cost(s, item, 0);
+}
+
+
+/* Exported function, documented in pipeline.h */
+bool stage_send_cost(struct stage *s, const void *item, size_t cost)
+{
+	if (s->threaded)
+		return queue_push(&s->queue, item, cost);
+
+	s->process(s->ctx, (void *)item);
+	return true;
+}
+
+
+/* Exported function, documented in pipeline.h */
+int stage_depth(struct stage *s)
+{
+	return s->threaded ? queue_depth(&s->queue) : 0;
+}
+
+
+/* Exported function, documented in pipeline.h */
+void stage_drain(struct stage *s)
+{
+	if (s->threaded)
+		queue_wait_idle(&s->queue);
+}
+
+
+/* Exported function, documented in pipeline.h */
+void stage_finish(struct stage *s)
+{
+	int i;
+
+	if (!s->threaded)
+		return;
+
+	queue_close(&s->queue);
+	for (i = 0; i < s->n_threads; i++)
+		pthread_join(s->threads[i], NULL);
+	free(s->threads);
+	queue_fini(&s->queue);
+}
@@ -0,0 +1,203 @@
+/*
+ * Copyright (c) 2014 Codethink Ltd. (http://www.codethink.co.uk)
+ *
+ * This file is part of ebb
+ *
+ * ebb is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * ebb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Pipeline stages
+ *
+ * A stage processes items sent to it.  A threaded stage runs in its own
+ * threads, fed through a bounded queue, so a fast producer blocks until
+ * the stage catches up.  With one thread, items are processed in order;
+ * with more they may finish in any order.  An unthreaded stage processes
+ * each item immediately, in the sender's thread.
+ *
+ * Items may have a cost, such as the memory they hold on to, and a queue
+ * may have a budget.  Items count against the budget from being queued
+ * until they've been processed, and senders block while it's used up.
+ * Several queues may share a budget, so between them they hold no more.
+ */
+
+#ifndef EBB_PIPELINE_H
+#define EBB_PIPELINE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <pthread.h>
+
+/** Limit on the total cost of items, which queues may share */
+struct budget {
+	pthread_mutex_t lock;
+	pthread_cond_t freed;
+	size_t size;		/**< Maximum total cost of items */
+	size_t used;		/**< Cost of items not yet released */
+};
+
+/** Bounded queue of fixed size items */
+struct queue {
+	pthread_mutex_t lock;
+	pthread_cond_t not_empty;
+	pthread_cond_t not_full;
+	pthread_cond_t idle;
+	unsigned char *items;	/**< Ring buffer of items */
+	size_t *costs;		/**< Cost of each item in ring buffer */
+	size_t item_size;	/**< Size of each item in bytes */
+	int size;		/**< Maximum number of items */
+	int head;		/**< Index of oldest item */
+	int count;		/**< Number of items in queue */
+	struct budget own;	/**< Budget, unless it shares another */
+	struct budget *budget;	/**< Budget items count against */
+	int unfinished;		/**< Number of items not yet done */
+	bool closed;		/**< Whether more items may be pushed */
+};
+
+/**
+ * Initialise a budget
+ *
+ * \param b     Budget to initialise
+ * \param size  Maximum total cost of unreleased items
+ */
+void budget_init(struct budget *b, size_t size);
+
+/** Free a budget's resources, once no queue is using it */
+void budget_fini(struct budget *b);
+
+/**
+ * Initialise a queue
+ *
+ * \param q          Queue to initialise
+ * \param size       Maximum number of items
+ * \param item_size  Size of each item in bytes
+ * \param budget     Maximum total cost of unreleased items
+ * \return true on success, else false
+ */
+bool queue_init(struct queue *q, int size, size_t item_size, size_t budget);
+
+/**
+ * Initialise a queue whose items count against a shared budget
+ *
+ * \param q          Queue to initialise
+ * \param size       Maximum number of items
+ * \param item_size  Size of each item in bytes
+ * \param budget     Budget to share, which must outlive the queue
+ * eturn true on success, else false
+ */
+bool queue_init_shared(struct queue *q, int size, size_t item_size,
+		struct budget *budget);
+
+/** Free a queue's resources */
+void queue_fini(struct queue *q);
+
+/**
+ * Add a copy of an item to a queue, waiting for space if it is full
+ *
+ * An item that costs more than the whole budget is only let in when
+ * nothing else is using the budget.
+ *
+ * \return true on success, or false if the queue has been closed
+ */
+bool queue_push(struct queue *q, const void *item, size_t cost);
+
+/**
+ * Take the oldest item from a queue, waiting for one if it is empty
+ *
+ * The item's cost stays counted against the budget until it's released.
+ *
+ * \return true on success, or false if the queue is closed and empty
+ */
+bool queue_pop(struct queue *q, void *item, size_t *cost);
+
+/** Release the cost of an item that was popped from a queue */
+void queue_release(struct queue *q, size_t cost);
+
+/** Note that an item that was popped from a queue has been dealt with */
+void queue_done(struct queue *q);
+
+/** Wait until every item pushed to a queue has been dealt with */
+void queue_wait_idle(struct queue *q);
+
+/** Close a queue, so nothing more can be pushed */
+void queue_close(struct queue *q);
+
+/** Number of items waiting in a queue */
+int queue_depth(struct queue *q);
+
+
+/** Function to process an item sent to a stage */
+typedef void (*stage_process_fn)(void *ctx, void *item);
+
+/** A pipeline stage */
+struct stage {
+	struct queue queue;		/**< Items waiting, if threaded */
+	pthread_t *threads;		/**< Worker threads, if threaded */
+	int n_threads;			/**< Number of threads started */
+	bool threaded;			/**< Whether stage has its own threads */
+	stage_process_fn process;	/**< Item handler */
+	void *ctx;			/**< Context passed to process */
+};
+
+/**
+ * Start a pipeline stage
+ *
+ * \param s          Stage to start
+ * \param threads    Number of threads to give the stage, or 0 for none
+ * \param depth      Number of items that may wait, if threaded
+ * \param budget     Maximum total cost of items in flight, if threaded
+ * \param item_size  Size of items sent to the stage
+ * \param process    Item handler, which must be thread safe if the
+ *                   stage has more than one thread
+ * \param ctx        Context passed to process
+ * \return true on success, else false
+ */
+bool stage_start(struct stage *s, int threads, int depth, size_t budget,
+		size_t item_size, stage_process_fn process, void *ctx);
+
+/**
+ * Start a pipeline stage whose items count against a shared budget
+ *
+ * As stage_start(), but items in flight count against a budget that
+ * other stages may share, which must outlive the stage.
+ */
+bool stage_start_shared(struct stage *s, int threads, int depth,
+		struct budget *budget, size_t item_size,
+		stage_process_fn process, void *ctx);
+
+/**
+ * Send an item to a stage, which gets its own copy of it
+ *
+ * \return true on success, or false if the stage has been closed and
+ *         the item was not taken
+ */
+bool stage_send(struct stage *s, const void *item);
+
+/**
+ * Send an item with a cost to a stage, which gets its own copy of it
+ *
+ * \return true on success, or false if the stage has been closed and
+ *         the item was not taken
+ */
+bool stage_send_cost(struct stage *s, const void *item, size_t cost);
+
+/** Number of items waiting for a stage, which is 0 if it isn't threaded */
+int stage_depth(struct stage *s);
+
+/** Wait for a stage to process everything sent to it so far */
+void stage_drain(struct stage *s);
+
+/** Wait for a stage to process everything sent to it, and free it */
+void stage_finish(struct stage *s);
+
+#endif
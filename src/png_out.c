@@ -0,0 +1,213 @@
+/*
+ * Copyright (c) 2014 Codethink Ltd. (http://www.codethink.co.uk)
+ *
+ * This file is part of ebb
+ *
+ * ebb is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * ebb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <png.h>
+#include <zlib.h>
+
+#include "png_out.h"
+#include "stats.h"
+
+
+/**
+ * Available PNG profiles
+ *
+ * Screencasts are mostly flat colour, which the sub filter turns into runs
+ * of zeros, so even the fast profile compresses them well.  The output is
+ * usually only fed back into ffmpeg, so only the interlaced profile, which
+ * writes PNGs as ebb did before there were profiles, interlaces.
+ */
+const struct png_profile png_profiles[] = {
+	{ "fast", PNG_INTERLACE_NONE, 1, PNG_FILTER_SUB, Z_RLE },
+	{ "balanced", PNG_INTERLACE_NONE, 6, PNG_FILTER_SUB | PNG_FILTER_UP,
+			Z_FILTERED },
+	{ "small", PNG_INTERLACE_NONE, 9, PNG_ALL_FILTERS,
+			Z_DEFAULT_STRATEGY },
+	{ "interlaced", PNG_INTERLACE_ADAM7, Z_DEFAULT_COMPRESSION,
+			PNG_ALL_FILTERS, Z_FILTERED },
+	{ NULL, 0, 0, 0, 0 }
+};
+
+
+/** Space to start a buffer with, which grows to fit if need be */
+#define PNG_BUF_INITIAL (256 * 1024)
+
+
+/** libpng write callback, appending to a PNG buffer */
+static void png_buf_write(png_structp png_ptr, png_bytep data, png_size_t len)
+{
+	struct png_buf *buf = png_get_io_ptr(png_ptr);
+
+	if (buf->len + len > buf->size) {
+		size_t size = buf->size > 0 ? buf->size : PNG_BUF_INITIAL;
+		unsigned char *grown;
+
+		while (size < buf->len + len)
+			size *= 2;
+		grown = realloc(buf->data, size);
+		if (grown == NULL)
+			png_error(png_ptr, "out of memory");
+		buf->data = grown;
+		buf->size = size;
+	}
+
+	memcpy(buf->data + buf->len, data, len);
+	buf->len += len;
+}
+
+
+/** libpng flush callback, which has nothing to do */
+static void png_buf_flush(png_structp png_ptr)
+{
+	(void)png_ptr;
+}
+
+
+/* Exported function, documented in png_out.h */
+bool image_encode_png(struct png_buf *buf, const AVFrame *frame, int w, int h,
+		const struct png_profile *profile)
+{
+	png_structp png_ptr;
+	png_infop info_ptr;
+	int colour_type;
+	int bit_depth;
+	int passes, pass;
+	int y;
+
+	/* RGB48BE samples are already in PNG's byte order */
+	colour_type = PNG_COLOR_TYPE_RGB;
+	bit_depth = (frame->format == PIX_FMT_RGB48BE) ? 16 : 8;
+	buf->len = 0;
+
+	/* Create and initialize the png_struct */
+	png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING,
+			NULL, NULL, NULL);
+
+	if (png_ptr == NULL)
+		return false;
+
+	/* Allocate/initialize the image information data. */
+	info_ptr = png_create_info_struct(png_ptr);
+	if (info_ptr == NULL) {
+		png_destroy_write_struct(&png_ptr, NULL);
+		return false;
+	}
+	/* Set error handling, needed because I gave NULLs to
+	 * png_create_write_struct. */
+	if (setjmp(png_jmpbuf(png_ptr))) {
+		/* If we get here, we had a problem encoding the image */
+		png_destroy_write_struct(&png_ptr, &info_ptr);
+		return false;
+	}
+
+	/* set up the output control */
+	png_set_write_fn(png_ptr, buf, png_buf_write, png_buf_flush);
+
+	/* set up the compression */
+	png_set_filter(png_ptr, PNG_FILTER_TYPE_BASE, profile->filters);
+	png_set_compression_level(png_ptr, profile->level);
+	png_set_compression_strategy(png_ptr, profile->strategy);
+
+	/* Set the image information. */
+	png_set_IHDR(png_ptr, info_ptr, w, h, bit_depth,
+			colour_type, profile->interlace,
+			PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+
+	/* Write the file header information. */
+	png_write_info(png_ptr, info_ptr);
+
+	/* pack pixels into bytes */
+	png_set_packing(png_ptr);
+
+	/* write the png a row at a time, straight from the frame, so
+	 * there's no array of row pointers to allocate */
+	passes = png_set_interlace_handling(png_ptr);
+	for (pass = 0; pass < passes; pass++) {
+		for (y = 0; y < h; y++)
+			png_write_row(png_ptr,
+					frame->data[0] + y * frame->linesize[0]);
+	}
+
+	/* finish writing the rest of the file */
+	png_write_end(png_ptr, info_ptr);
+
+	/* clean up after the write, and free any memory allocated */
+	png_destroy_write_struct(&png_ptr, &info_ptr);
+
+	return true;
+}
+
+
+/* Exported function, documented in png_out.h */
+bool png_buf_save(const struct png_buf *buf, const char *file_name)
+{
+	size_t done = 0;
+	ssize_t n;
+	int fd;
+
+	fd = open(file_name, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	if (fd < 0)
+		return false;
+
+	while (done < buf->len) {
+		n = write(fd, buf->data + done, buf->len - done);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0) {
+			close(fd);
+			return false;
+		}
+		done += n;
+	}
+
+	if (close(fd) < 0)
+		return false;
+
+	stats_count(&stats.bytes, buf->len);
+	return true;
+}
+
+
+/* Exported function, documented in png_out.h */
+void png_buf_free(struct png_buf *buf)
+{
+	free(buf->data);
+	buf->data = NULL;
+	buf->len = 0;
+	buf->size = 0;
+}
+
+
+/* Exported function, documented in png_out.h */
+bool image_write_png(const char *file_name, const AVFrame *frame, int w, int h,
+		const struct png_profile *profile)
+{
+	struct png_buf buf = { NULL, 0, 0 };
+	bool ok;
+
+	ok = image_encode_png(&buf, frame, w, h, profile) &&
+			png_buf_save(&buf, file_name);
+	png_buf_free(&buf);
+
+	return ok;
+}
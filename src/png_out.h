@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) 2014 Codethink Ltd. (http://www.codethink.co.uk)
+ *
+ * This file is part of ebb
+ *
+ * ebb is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * ebb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * PNG output
+ *
+ * Writes kept frames as PNGs, with a choice of how much effort goes into
+ * compressing them.  PNGs are encoded in memory, so they can be written
+ * out in one go, or more than once, or put in a pack.
+ */
+
+#ifndef EBB_PNG_OUT_H
+#define EBB_PNG_OUT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <libavcodec/avcodec.h>
+
+/** PNG encoding settings */
+struct png_profile {
+	const char *name;	/**< Name to select profile with */
+	int interlace;		/**< PNG interlace type */
+	int level;		/**< zlib compression level */
+	int filters;		/**< PNG row filters to try */
+	int strategy;		/**< zlib compression strategy */
+};
+
+/** Available PNG profiles, ending with one with a NULL name */
+extern const struct png_profile png_profiles[];
+
+#define PNG_PROFILE_DEFAULT (&png_profiles[1])
+
+/** A PNG encoded in memory, which may be reused for more PNGs */
+struct png_buf {
+	unsigned char *data;	/**< Encoded PNG */
+	size_t len;		/**< Bytes of data used */
+	size_t size;		/**< Bytes of data allocated */
+};
+
+/**
+ * Encode an RGB24 frame as a PNG in memory
+ *
+ * A frame whose format is RGB48BE is encoded with 16 bits per channel.
+ *
+ * \param buf      Buffer to encode into, replacing what it held
+ * \param frame    Frame to encode
+ * \param w        Frame width
+ * \param h        Frame height
+ * \param profile  How to encode the PNG
+ * \return true on success, else false
+ */
+bool image_encode_png(struct png_buf *buf, const AVFrame *frame, int w, int h,
+		const struct png_profile *profile);
+
+/**
+ * Save an encoded PNG to disc
+ *
+ * The PNG goes out in a single write, rather than through a stdio buffer.
+ *
+ * \param buf        Encoded PNG
+ * \param file_name  Path to file to write
+ * \return true on success, else false
+ */
+bool png_buf_save(const struct png_buf *buf, const char *file_name);
+
+/** Free a PNG buffer's memory */
+void png_buf_free(struct png_buf *buf);
+
+/**
+ * Save an RGB24 or RGB48BE frame to disc as a PNG
+ *
+ * \param file_name  Path to file to write
+ * \param frame      Frame to save
+ * \param w          Frame width
+ * \param h          Frame height
+ * \param profile    How to encode the PNG
+ * \return true on success, else false
+ */
+bool image_write_png(const char *file_name, const AVFrame *frame, int w, int h,
+		const struct png_profile *profile);
+
+#endif
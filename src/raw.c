@@ -0,0 +1,209 @@
+/*
+ * Copyright (c) 2014 Codethink Ltd. (http://www.codethink.co.uk)
+ *
+ * This file is part of ebb
+ *
+ * ebb is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * ebb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
+
+#include "log.h"
+#include "raw.h"
+#include "stats.h"
+
+/** Size of the output buffer, so frames go out in big writes */
+#define RAW_BUFFER_SIZE (1024 * 1024)
+
+/** A raw frame writer */
+struct raw_writer {
+	FILE *fp;
+	enum raw_format format;
+	enum PixelFormat pix_fmt;
+	int w, h;
+	int planes;		/**< Number of planes to write */
+	int bytes[4];		/**< Bytes of each plane's rows */
+	int rows[4];		/**< Rows of each plane */
+	char *buffer;		/**< Output buffer */
+	bool ok;		/**< Whether everything has been written */
+};
+
+/** YUV4MPEG2 colour spaces, by pixel format */
+static const struct {
+	enum PixelFormat pix_fmt;
+	const char *colour;
+} y4m_colours[] = {
+	{ PIX_FMT_YUV420P, "420jpeg" },
+	{ PIX_FMT_YUVJ420P, "420jpeg" },
+	{ PIX_FMT_YUV422P, "422" },
+	{ PIX_FMT_YUVJ422P, "422" },
+	{ PIX_FMT_YUV444P, "444" },
+	{ PIX_FMT_YUVJ444P, "444" },
+	{ PIX_FMT_YUV411P, "411" },
+	{ PIX_FMT_GRAY8, "mono" },
+	{ PIX_FMT_GRAY16LE, "mono16" },
+	{ PIX_FMT_YUV420P10LE, "420p10" },
+	{ PIX_FMT_YUV422P10LE, "422p10" },
+	{ PIX_FMT_YUV444P10LE, "444p10" },
+	{ PIX_FMT_YUV420P16LE, "420p16" },
+	{ PIX_FMT_YUV422P16LE, "422p16" },
+	{ PIX_FMT_YUV444P16LE, "444p16" },
+	{ PIX_FMT_NONE, NULL }
+};
+
+
+/* Exported function, documented in raw.h */
+bool raw_format_parse(const char *name, enum raw_format *format)
+{
+	if (strcmp(name, "y4m") == 0) {
+		*format = RAW_Y4M;
+	} else if (strcmp(name, "rawvideo") == 0) {
+		*format = RAW_VIDEO;
+	} else {
+		return false;
+	}
+
+	return true;
+}
+
+
+/** Find the YUV4MPEG2 colour space of a pixel format, or NULL */
+static const char *y4m_colour(enum PixelFormat pix_fmt)
+{
+	int i;
+
+	for (i = 0; y4m_colours[i].colour != NULL; i++) {
+		if (y4m_colours[i].pix_fmt == pix_fmt)
+			return y4m_colours[i].colour;
+	}
+
+	return NULL;
+}
+
+
+/* Exported function, documented in raw.h */
+struct raw_writer *raw_open(const char *file_name, enum raw_format format,
+		enum PixelFormat pix_fmt, int w, int h, AVRational fps,
+		AVRational sar)
+{
+	const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(pix_fmt);
+	const char *colour = y4m_colour(pix_fmt);
+	struct raw_writer *r;
+	int i, p;
+
+	if (desc == NULL || (desc->flags & (PIX_FMT_PAL | PIX_FMT_HWACCEL))) {
+		LOG(LOG_ERROR, "Can't write %s frames raw\n",
+				av_get_pix_fmt_name(pix_fmt));
+		return NULL;
+	}
+	if (format == RAW_Y4M && colour == NULL) {
+		LOG(LOG_ERROR, "Can't write %s frames as y4m, "
+				"try rawvideo\n",
+				av_get_pix_fmt_name(pix_fmt));
+		return NULL;
+	}
+
+	r = calloc(1, sizeof(*r));
+	if (r == NULL)
+		return NULL;
+	r->format = format;
+	r->pix_fmt = pix_fmt;
+	r->w = w;
+	r->h = h;
+	r->ok = true;
+
+	/* Rows of each plane, as tightly packed as they go */
+	for (i = 0; i < desc->nb_components; i++)
+		r->planes = FFMAX(r->planes, desc->comp[i].plane + 1);
+	for (p = 0; p < r->planes; p++) {
+		r->bytes[p] = av_image_get_linesize(pix_fmt, w, p);
+		r->rows[p] = h;
+		if (p == 1 || p == 2)
+			r->rows[p] = (h + (1 << desc->log2_chroma_h) - 1) >>
+					desc->log2_chroma_h;
+	}
+
+	r->fp = fopen(file_name, "wb");
+	r->buffer = malloc(RAW_BUFFER_SIZE);
+	if (r->fp == NULL || r->buffer == NULL) {
+		LOG(LOG_ERROR, "Could not open raw output: '%s'\n",
+				file_name);
+		goto error;
+	}
+	setvbuf(r->fp, r->buffer, _IOFBF, RAW_BUFFER_SIZE);
+
+	if (format == RAW_Y4M) {
+		if (sar.num <= 0 || sar.den <= 0)
+			sar = (AVRational){ 0, 0 };
+		fprintf(r->fp, "YUV4MPEG2 W%i H%i F%i:%i Ip A%i:%i C%s\n",
+				w, h, fps.num, fps.den, sar.num, sar.den,
+				colour);
+	} else {
+		LOG(LOG_INFO, "Raw video: %s, %ix%i, %i/%i fps\n",
+				av_get_pix_fmt_name(pix_fmt), w, h,
+				fps.num, fps.den);
+	}
+
+	return r;
+
+error:
+	r->ok = false;
+	raw_close(r);
+	return NULL;
+}
+
+
+/* Exported function, documented in raw.h */
+bool raw_write(struct raw_writer *r, const AVFrame *frame)
+{
+	int p, y;
+
+	if (!r->ok)
+		return false;
+
+	if (r->format == RAW_Y4M)
+		fputs("FRAME\n", r->fp);
+
+	for (p = 0; p < r->planes; p++) {
+		for (y = 0; y < r->rows[p]; y++)
+			fwrite(frame->data[p] + y * frame->linesize[p],
+					r->bytes[p], 1, r->fp);
+		stats_count(&stats.bytes, (uint64_t)r->bytes[p] * r->rows[p]);
+	}
+
+	if (ferror(r->fp)) {
+		LOG(LOG_ERROR, "Could not write raw frame\n");
+		r->ok = false;
+	}
+
+	return r->ok;
+}
+
+
+/* Exported function, documented in raw.h */
+bool raw_close(struct raw_writer *r)
+{
+	bool ok = r->ok;
+
+	if (r->fp != NULL && fclose(r->fp) != 0)
+		ok = false;
+	free(r->buffer);
+	free(r);
+
+	return ok;
+}
@@ -0,0 +1,86 @@
+/*
+ * Copyright (c) 2014 Codethink Ltd. (http://www.codethink.co.uk)
+ *
+ * This file is part of ebb
+ *
+ * ebb is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * ebb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Raw frame output
+ *
+ * Writes kept frames, uncompressed and in the decoder's pixel format, to a
+ * file or pipe, for an encoder outside ebb to read.  YUV4MPEG2 describes
+ * the frames in a header, so `ffmpeg -i -` needs nothing else; rawvideo is
+ * just the planes, for any pixel format, and the reader must be told the
+ * format, size and rate.
+ */
+
+#ifndef EBB_RAW_H
+#define EBB_RAW_H
+
+#include <stdbool.h>
+
+#include <libavcodec/avcodec.h>
+#include <libavutil/avutil.h>
+#include <libavutil/pixfmt.h>
+
+/** Ways of writing raw frames */
+enum raw_format {
+	RAW_Y4M,	/**< YUV4MPEG2 stream */
+	RAW_VIDEO	/**< Bare planes, one frame after another */
+};
+
+struct raw_writer;
+
+/**
+ * Find a raw format from its name, "y4m" or "rawvideo"
+ *
+ * \return true if the name is known, else false
+ */
+bool raw_format_parse(const char *name, enum raw_format *format);
+
+/**
+ * Open a file or pipe for raw frames
+ *
+ * \param file_name  Path to write to
+ * \param format     How to write frames
+ * \param pix_fmt    Pixel format of the frames
+ * \param w          Frame width
+ * \param h          Frame height
+ * \param fps        Frame rate
+ * \param sar        Sample aspect ratio, or 0:0 if unknown
+ * \return new writer, or NULL on failure
+ */
+struct raw_writer *raw_open(const char *file_name, enum raw_format format,
+		enum PixelFormat pix_fmt, int w, int h, AVRational fps,
+		AVRational sar);
+
+/**
+ * Write a frame
+ *
+ * \param r      Writer to use
+ * \param frame  Frame in the writer's pixel format
+ * \return true on success, else false
+ */
+bool raw_write(struct raw_writer *r, const AVFrame *frame);
+
+/**
+ * Finish and close the output
+ *
+ * \param r  Writer to close
+ * \return true if everything was written successfully, else false
+ */
+bool raw_close(struct raw_writer *r);
+
+#endif
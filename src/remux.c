@@ -0,0 +1,301 @@
+/*
+ * Copyright (c) 2014 Codethink Ltd. (http://www.codethink.co.uk)
+ *
+ * This file is part of ebb
+ *
+ * ebb is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * ebb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/avutil.h>
+
+#include "log.h"
+#include "remux.h"
+#include "stats.h"
+
+/** What is known about each GOP of the input stream */
+struct gops {
+	bool *drop;		/**< Whether each GOP is left out */
+	int64_t *start;		/**< Earliest timestamp in each GOP */
+	int count;		/**< Number of GOPs */
+	int size;		/**< Number of GOPs there's space for */
+};
+
+
+/** Find whether a timestamp is in the sorted list of dropped frames */
+static bool is_dropped(int64_t pts, const int64_t *drop, int n_drop)
+{
+	int lo = 0, hi = n_drop;
+
+	if (pts == AV_NOPTS_VALUE)
+		return false;
+
+	while (lo < hi) {
+		int mid = lo + (hi - lo) / 2;
+
+		if (drop[mid] == pts)
+			return true;
+		if (drop[mid] < pts)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return false;
+}
+
+
+/** Start a new GOP */
+static bool gops_add(struct gops *g)
+{
+	if (g->count == g->size) {
+		int size = g->size ? g->size * 2 : 256;
+		bool *drop = realloc(g->drop, size * sizeof(*drop));
+		int64_t *start;
+
+		if (drop == NULL)
+			return false;
+		g->drop = drop;
+
+		start = realloc(g->start, size * sizeof(*start));
+		if (start == NULL)
+			return false;
+		g->start = start;
+
+		g->size = size;
+	}
+
+	g->drop[g->count] = true;
+	g->start[g->count] = AV_NOPTS_VALUE;
+	g->count++;
+
+	return true;
+}
+
+
+/**
+ * Find which GOPs can be left out, by demuxing the input
+ *
+ * Packets before the first keyframe are never left out.
+ */
+static bool find_gops(const char *in_path, int stream_id,
+		const int64_t *drop, int n_drop, struct gops *g)
+{
+	AVFormatContext *fmt_ctx = NULL;
+	AVPacket pkt;
+	bool res = true;
+
+	if (avformat_open_input(&fmt_ctx, in_path, NULL, NULL) < 0) {
+		LOG(LOG_ERROR, "Could not open input video: '%s'\n", in_path);
+		return false;
+	}
+
+	av_init_packet(&pkt);
+	while (res && av_read_frame(fmt_ctx, &pkt) >= 0) {
+		if (pkt.stream_index == stream_id) {
+			if (pkt.flags & AV_PKT_FLAG_KEY)
+				res = gops_add(g);
+
+			if (res && g->count > 0) {
+				int i = g->count - 1;
+
+				if (!is_dropped(pkt.pts, drop, n_drop))
+					g->drop[i] = false;
+				if (pkt.pts != AV_NOPTS_VALUE &&
+						(g->start[i] == AV_NOPTS_VALUE ||
+						pkt.pts < g->start[i]))
+					g->start[i] = pkt.pts;
+			}
+		}
+		av_free_packet(&pkt);
+	}
+
+	avformat_close_input(&fmt_ctx);
+
+	if (!res)
+		LOG(LOG_ERROR, "Could not allocate GOP list\n");
+
+	return res;
+}
+
+
+/** Set up the output file, with a copy of the input's video stream */
+static AVFormatContext *open_output(const char *out_path, AVStream *in_st)
+{
+	AVFormatContext *out_ctx = NULL;
+	AVStream *out_st;
+
+	if (avformat_alloc_output_context2(&out_ctx, NULL, NULL,
+			out_path) < 0 || out_ctx == NULL) {
+		LOG(LOG_ERROR, "Could not find output format for: '%s'\n",
+				out_path);
+		return NULL;
+	}
+
+	out_st = avformat_new_stream(out_ctx, NULL);
+	if (out_st == NULL ||
+			avcodec_copy_context(out_st->codec, in_st->codec) < 0) {
+		LOG(LOG_ERROR, "Could not create output video stream\n");
+		goto error;
+	}
+
+	/* The input's codec tag may not mean anything in another format */
+	out_st->codec->codec_tag = 0;
+	out_st->time_base = in_st->time_base;
+	out_st->avg_frame_rate = in_st->avg_frame_rate;
+	out_st->sample_aspect_ratio = in_st->sample_aspect_ratio;
+	if (out_ctx->oformat->flags & AVFMT_GLOBALHEADER)
+		out_st->codec->flags |= CODEC_FLAG_GLOBAL_HEADER;
+
+	if (!(out_ctx->oformat->flags & AVFMT_NOFILE) &&
+			avio_open(&out_ctx->pb, out_path, AVIO_FLAG_WRITE) < 0) {
+		LOG(LOG_ERROR, "Could not open output video: '%s'\n",
+				out_path);
+		goto error;
+	}
+
+	if (avformat_write_header(out_ctx, NULL) < 0) {
+		LOG(LOG_ERROR, "Could not write output video header\n");
+		if (!(out_ctx->oformat->flags & AVFMT_NOFILE))
+			avio_close(out_ctx->pb);
+		goto error;
+	}
+
+	return out_ctx;
+
+error:
+	avformat_free_context(out_ctx);
+	return NULL;
+}
+
+
+/** Close the output file */
+static bool close_output(AVFormatContext *out_ctx)
+{
+	bool res = av_write_trailer(out_ctx) >= 0;
+
+	if (!(out_ctx->oformat->flags & AVFMT_NOFILE))
+		avio_close(out_ctx->pb);
+	avformat_free_context(out_ctx);
+
+	return res;
+}
+
+
+/* Exported function, documented in remux.h */
+bool remux(const char *in_path, const char *out_path, int stream_id,
+		const int64_t *drop, int n_drop)
+{
+	AVFormatContext *fmt_ctx = NULL;
+	AVFormatContext *out_ctx = NULL;
+	AVStream *in_st, *out_st;
+	struct gops g = { NULL, NULL, 0, 0 };
+	int64_t *offset = NULL;
+	int gop = -1;
+	int kept = 0;
+	AVPacket pkt;
+	bool res = false;
+	int i;
+
+	if (!find_gops(in_path, stream_id, drop, n_drop, &g))
+		goto free;
+
+	/* Work out how far back each GOP's timestamps shift, from the
+	 * running length of the GOPs left out before it */
+	offset = malloc((g.count + 1) * sizeof(*offset));
+	if (offset == NULL) {
+		LOG(LOG_ERROR, "Could not allocate GOP list\n");
+		goto free;
+	}
+	offset[0] = 0;
+	for (i = 0; i < g.count; i++) {
+		offset[i + 1] = offset[i];
+		if (g.drop[i] && i + 1 < g.count &&
+				g.start[i] != AV_NOPTS_VALUE &&
+				g.start[i + 1] != AV_NOPTS_VALUE)
+			offset[i + 1] += g.start[i + 1] - g.start[i];
+		if (!g.drop[i])
+			kept++;
+	}
+	LOG(LOG_INFO, "Remux keeps %i of %i GOPs\n", kept, g.count);
+
+	/* Copy the packets of the GOPs we're keeping */
+	if (avformat_open_input(&fmt_ctx, in_path, NULL, NULL) < 0 ||
+			avformat_find_stream_info(fmt_ctx, NULL) < 0) {
+		LOG(LOG_ERROR, "Could not open input video: '%s'\n", in_path);
+		goto free;
+	}
+	in_st = fmt_ctx->streams[stream_id];
+
+	out_ctx = open_output(out_path, in_st);
+	if (out_ctx == NULL)
+		goto free;
+	out_st = out_ctx->streams[0];
+
+	av_init_packet(&pkt);
+	res = true;
+	while (res && av_read_frame(fmt_ctx, &pkt) >= 0) {
+		if (pkt.stream_index != stream_id) {
+			av_free_packet(&pkt);
+			continue;
+		}
+
+		if ((pkt.flags & AV_PKT_FLAG_KEY) && gop + 1 < g.count)
+			gop++;
+
+		if (gop >= 0 && g.drop[gop]) {
+			av_free_packet(&pkt);
+			continue;
+		}
+
+		if (gop >= 0) {
+			if (pkt.pts != AV_NOPTS_VALUE)
+				pkt.pts -= offset[gop];
+			if (pkt.dts != AV_NOPTS_VALUE)
+				pkt.dts -= offset[gop];
+		}
+
+		if (pkt.pts != AV_NOPTS_VALUE)
+			pkt.pts = av_rescale_q(pkt.pts, in_st->time_base,
+					out_st->time_base);
+		if (pkt.dts != AV_NOPTS_VALUE)
+			pkt.dts = av_rescale_q(pkt.dts, in_st->time_base,
+					out_st->time_base);
+		pkt.duration = av_rescale_q(pkt.duration, in_st->time_base,
+				out_st->time_base);
+		pkt.pos = -1;
+		pkt.stream_index = out_st->index;
+
+		stats_count(&stats.bytes, pkt.size);
+		if (av_interleaved_write_frame(out_ctx, &pkt) < 0) {
+			LOG(LOG_ERROR, "Could not write packet to output "
+					"video\n");
+			res = false;
+		}
+		av_free_packet(&pkt);
+	}
+
+free:
+	if (out_ctx != NULL && !close_output(out_ctx))
+		res = false;
+	if (fmt_ctx != NULL)
+		avformat_close_input(&fmt_ctx);
+	free(offset);
+	free(g.drop);
+	free(g.start);
+
+	return res;
+}
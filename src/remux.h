@@ -0,0 +1,50 @@
+/*
+ * Copyright (c) 2014 Codethink Ltd. (http://www.codethink.co.uk)
+ *
+ * This file is part of ebb
+ *
+ * ebb is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * ebb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Lossless output
+ *
+ * Copies the input's video stream to a new file without re-encoding it,
+ * leaving out the boring bits.  Since nothing is decoded, only whole GOPs
+ * (a keyframe and the packets up to the next one) can be left out, so
+ * cuts snap to keyframes.  GOPs are assumed to be closed.
+ */
+
+#ifndef EBB_REMUX_H
+#define EBB_REMUX_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Copy a video stream to a new file, leaving out GOPs of dropped frames
+ *
+ * A GOP is left out only if every one of its frames is to be dropped.
+ * Timestamps of later packets are moved back to close the gap.
+ *
+ * \param in_path    Path to input file
+ * \param out_path   Path to output file, whose name sets the container
+ * \param stream_id  Index of the video stream in the input
+ * \param drop       Timestamps of frames to drop, in increasing order
+ * \param n_drop     Number of entries in drop
+ * \return true on success, else false
+ */
+bool remux(const char *in_path, const char *out_path, int stream_id,
+		const int64_t *drop, int n_drop);
+
+#endif
@@ -0,0 +1,172 @@
+/*
+ * Copyright (c) 2014 Codethink Ltd. (http://www.codethink.co.uk)
+ *
+ * This file is part of ebb
+ *
+ * ebb is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * ebb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "roi.h"
+
+
+/** Add a span to a region */
+static bool roi_add_span(struct roi *roi, int *size, int x0, int x1)
+{
+	if (roi->n_spans == *size) {
+		int new_size = *size ? *size * 2 : 64;
+		struct roi_span *spans = realloc(roi->spans,
+				new_size * sizeof(*spans));
+
+		if (spans == NULL)
+			return false;
+		roi->spans = spans;
+		*size = new_size;
+	}
+
+	roi->spans[roi->n_spans].x0 = x0;
+	roi->spans[roi->n_spans].x1 = x1;
+	roi->n_spans++;
+
+	return true;
+}
+
+
+/** Add a band of one row to a region */
+static bool roi_add_band(struct roi *roi, int *size, int y, int first)
+{
+	struct roi_band *band;
+
+	if (roi->n_bands == *size) {
+		int new_size = *size ? *size * 2 : 16;
+		struct roi_band *bands = realloc(roi->bands,
+				new_size * sizeof(*bands));
+
+		if (bands == NULL)
+			return false;
+		roi->bands = bands;
+		*size = new_size;
+	}
+
+	band = &roi->bands[roi->n_bands++];
+	band->y0 = y;
+	band->y1 = y + 1;
+	band->first = first;
+	band->count = roi->n_spans - first;
+
+	return true;
+}
+
+
+/* Exported function, documented in roi.h */
+bool roi_init(struct roi *roi, const uint8_t *map, int w, int h, int size)
+{
+	const int ow = w - size + 1;
+	const int oh = h - size + 1;
+	int bands_size = 0, spans_size = 0;
+	uint8_t *ok;
+	int x, y, r;
+
+	roi->bands = NULL;
+	roi->n_bands = 0;
+	roi->spans = NULL;
+	roi->n_spans = 0;
+
+	/* No neighbourhood fits */
+	if (ow <= 0 || oh <= 0)
+		return true;
+
+	ok = malloc(ow * h);
+	if (ok == NULL)
+		return false;
+
+	/* Find the neighbourhoods entirely in the region: first those whose
+	 * top row is, from the length of the run of pixels in the region
+	 * starting at each pixel, and then those whose every row is */
+	for (y = 0; y < h; y++) {
+		const uint8_t *m = map + y * w;
+		uint8_t *o = ok + y * ow;
+		int run = 0;
+
+		for (x = w - 1; x >= 0; x--) {
+			run = m[x] ? run + 1 : 0;
+			if (x < ow)
+				o[x] = run >= size;
+		}
+	}
+	for (y = 0; y < oh; y++) {
+		uint8_t *o = ok + y * ow;
+
+		for (r = 1; r < size; r++) {
+			const uint8_t *below = o + r * ow;
+
+			for (x = 0; x < ow; x++)
+				o[x] &= below[x];
+		}
+	}
+
+	/* Turn each row into spans, and put it in the band above if its
+	 * spans are the same */
+	for (y = 0; y < oh; y++) {
+		const uint8_t *o = ok + y * ow;
+		const int first = roi->n_spans;
+		struct roi_band *band;
+
+		for (x = 0; x < ow; x++) {
+			int x0 = x;
+
+			if (!o[x])
+				continue;
+			while (x < ow && o[x])
+				x++;
+			if (!roi_add_span(roi, &spans_size, x0, x))
+				goto fail;
+		}
+
+		band = roi->n_bands ? &roi->bands[roi->n_bands - 1] : NULL;
+		if (band != NULL && band->y1 == y &&
+				band->count == roi->n_spans - first &&
+				memcmp(roi->spans + band->first,
+						roi->spans + first,
+						band->count *
+						sizeof(*roi->spans)) == 0) {
+			band->y1++;
+			roi->n_spans = first;
+		} else if (roi->n_spans > first &&
+				!roi_add_band(roi, &bands_size, y, first)) {
+			goto fail;
+		}
+	}
+
+	free(ok);
+	return true;
+
+fail:
+	free(ok);
+	roi_fini(roi);
+	return false;
+}
+
+
+/* Exported function, documented in roi.h */
+void roi_fini(struct roi *roi)
+{
+	free(roi->bands);
+	free(roi->spans);
+	roi->bands = NULL;
+	roi->n_bands = 0;
+	roi->spans = NULL;
+	roi->n_spans = 0;
+}
@@ -0,0 +1,71 @@
+/*
+ * Copyright (c) 2014 Codethink Ltd. (http://www.codethink.co.uk)
+ *
+ * This file is part of ebb
+ *
+ * ebb is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * ebb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Regions of interest
+ *
+ * Changes are only looked for in the neighbourhoods that lie entirely in
+ * the region of interest.  The region is given as a map of the pixels in
+ * it, and turned into bands of rows that all have the same spans of
+ * neighbourhoods to check, so the comparison just iterates over them.
+ */
+
+#ifndef EBB_ROI_H
+#define EBB_ROI_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/** Neighbourhoods on a row to check, by left pixel */
+struct roi_span {
+	int x0;			/**< First neighbourhood */
+	int x1;			/**< Neighbourhood after the last */
+};
+
+/** Rows of neighbourhoods with the same spans */
+struct roi_band {
+	int y0;			/**< First row, by top pixel */
+	int y1;			/**< Row after the last */
+	int first;		/**< Index of band's first span */
+	int count;		/**< Number of spans in band */
+};
+
+/** A region of interest */
+struct roi {
+	struct roi_band *bands;	/**< Bands, from the top */
+	int n_bands;		/**< Number of bands */
+	struct roi_span *spans;	/**< Spans of every band, left to right */
+	int n_spans;		/**< Number of spans */
+};
+
+/**
+ * Work out which neighbourhoods are in a region of interest
+ *
+ * \param roi   Region to initialise
+ * \param map   One entry per pixel, non-zero for those in the region
+ * \param w     Width of map
+ * \param h     Height of map
+ * \param size  Width and height of neighbourhoods
+ * \return true on success, or false on memory exhaustion
+ */
+bool roi_init(struct roi *roi, const uint8_t *map, int w, int h, int size);
+
+/** Free a region of interest's resources */
+void roi_fini(struct roi *roi);
+
+#endif
@@ -0,0 +1,158 @@
+/*
+ * Copyright (c) 2014 Codethink Ltd. (http://www.codethink.co.uk)
+ *
+ * This file is part of ebb
+ *
+ * ebb is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * ebb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "log.h"
+#include "stats.h"
+
+struct stats stats;
+
+static const char *stage_names[STATS_STAGES] = {
+	"demux", "decode", "convert", "compare", "write"
+};
+
+static const char *queue_names[STATS_QUEUES] = {
+	"compare", "write"
+};
+
+
+/** Convert a time in ns to s */
+static inline double seconds(uint64_t ns)
+{
+	return ns / 1e9;
+}
+
+
+/* Exported function, documented in stats.h */
+void stats_init(bool enable, int progress)
+{
+	memset(&stats, 0, sizeof(stats));
+	if (!enable && progress <= 0)
+		return;
+
+	stats.enabled = true;
+	stats.start = stats_now();
+	stats.interval = (uint64_t)progress * 1000000000;
+	stats.next_progress = stats.start + stats.interval;
+}
+
+
+/* Exported function, documented in stats.h */
+void stats_queues(int compare, int write)
+{
+	int depth[STATS_QUEUES] = { compare, write };
+	int q;
+
+	if (!stats.enabled)
+		return;
+
+	for (q = 0; q < STATS_QUEUES; q++) {
+		int max = stats.depth_max[q];
+
+		stats.depth[q] = depth[q];
+		__sync_fetch_and_add(&stats.depth_sum[q], depth[q]);
+		while (depth[q] > max && !__sync_bool_compare_and_swap(
+				&stats.depth_max[q], max, depth[q]))
+			max = stats.depth_max[q];
+	}
+	__sync_fetch_and_add(&stats.samples, 1);
+}
+
+
+/** Write a progress line to stderr */
+static void write_progress(uint64_t now, bool done)
+{
+	double elapsed = seconds(now - stats.start);
+	int s, q;
+
+	fprintf(stderr, "{\"time\": %.3f, \"frames\": %" PRIu64 ", "
+			"\"kept\": %" PRIu64 ", \"fps\": %.2f, "
+			"\"bytes\": %" PRIu64 ", \"stages\": {",
+			elapsed, stats.frames_in, stats.frames_out,
+			elapsed > 0 ? stats.frames_in / elapsed : 0,
+			stats.bytes);
+	for (s = 0; s < STATS_STAGES; s++)
+		fprintf(stderr, "%s\"%s\": %.3f", s ? ", " : "",
+				stage_names[s], seconds(stats.time[s]));
+	fprintf(stderr, "}, \"queues\": {");
+	for (q = 0; q < STATS_QUEUES; q++)
+		fprintf(stderr, "%s\"%s\": %i", q ? ", " : "",
+				queue_names[q], stats.depth[q]);
+	fprintf(stderr, "}%s}\n", done ? ", \"done\": true" : "");
+}
+
+
+/* Exported function, documented in stats.h */
+void stats_progress(void)
+{
+	uint64_t next = stats.next_progress;
+	uint64_t now;
+
+	if (!stats.enabled || stats.interval == 0)
+		return;
+
+	now = stats_now();
+	if (now < next)
+		return;
+
+	/* Only one thread gets to write each line */
+	if (__sync_bool_compare_and_swap(&stats.next_progress, next,
+			now + stats.interval))
+		write_progress(now, false);
+}
+
+
+/* Exported function, documented in stats.h */
+void stats_report(void)
+{
+	uint64_t now;
+	double elapsed;
+	int s, q;
+
+	if (!stats.enabled)
+		return;
+
+	now = stats_now();
+	elapsed = seconds(now - stats.start);
+
+	if (stats.interval != 0)
+		write_progress(now, true);
+
+	LOG(LOG_RESULT, "Stage       Time (s)   Calls   ms/call\n");
+	for (s = 0; s < STATS_STAGES; s++) {
+		LOG(LOG_RESULT, "%-10s %9.3f %7" PRIu64 " %9.3f\n",
+				stage_names[s], seconds(stats.time[s]),
+				stats.calls[s], stats.calls[s] ?
+				seconds(stats.time[s]) * 1000 /
+				stats.calls[s] : 0);
+	}
+	LOG(LOG_RESULT, "%.3f s, %" PRIu64 " frames decoded (%.2f frames/s), "
+			"%" PRIu64 " kept, %" PRIu64 " bytes written\n",
+			elapsed, stats.frames_in,
+			elapsed > 0 ? stats.frames_in / elapsed : 0,
+			stats.frames_out, stats.bytes);
+	for (q = 0; q < STATS_QUEUES && stats.samples > 0; q++) {
+		LOG(LOG_RESULT, "Queue %s: %.2f average depth, %i deepest\n",
+				queue_names[q],
+				(double)stats.depth_sum[q] / stats.samples,
+				stats.depth_max[q]);
+	}
+}
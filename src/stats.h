@@ -0,0 +1,161 @@
+/*
+ * Copyright (c) 2014 Codethink Ltd. (http://www.codethink.co.uk)
+ *
+ * This file is part of ebb
+ *
+ * ebb is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * ebb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Run time statistics
+ *
+ * Counts the time spent in each stage of processing, and how much came
+ * out of it.  Stages may run in several threads at once, so times are
+ * totals over every thread, and counters are updated atomically.  Nothing
+ * is counted, and the clock isn't read, unless statistics are enabled.
+ */
+
+#ifndef EBB_STATS_H
+#define EBB_STATS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+/** Stages that time is counted for */
+enum stats_stage {
+	STATS_DEMUX,		/**< Reading packets */
+	STATS_DECODE,		/**< Decoding, and downloading from the GPU */
+	STATS_CONVERT,		/**< Pixel format conversion and scaling */
+	STATS_COMPARE,		/**< Hashing and comparing frames */
+	STATS_WRITE,		/**< Encoding and writing output */
+	STATS_STAGES
+};
+
+/** Queues whose depth is sampled */
+enum stats_queue {
+	STATS_QUEUE_COMPARE,	/**< Decoded frames waiting to be compared */
+	STATS_QUEUE_WRITE,	/**< Kept frames waiting to be written */
+	STATS_QUEUES
+};
+
+/** Statistics of the current run */
+struct stats {
+	bool enabled;				/**< Whether counting */
+	uint64_t start;				/**< Start of run (ns) */
+	uint64_t time[STATS_STAGES];		/**< Time in each stage (ns) */
+	uint64_t calls[STATS_STAGES];		/**< Times each stage ran */
+	uint64_t frames_in;			/**< Frames decoded */
+	uint64_t frames_out;			/**< Frames kept */
+	uint64_t bytes;				/**< Output bytes written */
+	uint64_t depth_sum[STATS_QUEUES];	/**< Total of depth samples */
+	int depth_max[STATS_QUEUES];		/**< Deepest queue seen */
+	int depth[STATS_QUEUES];		/**< Last depth sampled */
+	uint64_t samples;			/**< Number of depth samples */
+	uint64_t interval;			/**< Progress interval (ns) */
+	uint64_t next_progress;			/**< When progress is due (ns) */
+};
+
+extern struct stats stats;
+
+/** Read the monotonic clock, in ns */
+static inline uint64_t stats_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+#ifdef EBB_NO_STATS
+
+/*
+ * Code built into the library counts nothing, so doesn't need the global
+ * statistics
+ */
+
+static inline uint64_t stats_start(void)
+{
+	return 0;
+}
+
+static inline void stats_end(enum stats_stage stage, uint64_t start)
+{
+}
+
+static inline void stats_count(uint64_t *counter, uint64_t n)
+{
+}
+
+#else
+
+/** Note the start of some work, for stats_end() */
+static inline uint64_t stats_start(void)
+{
+	return stats.enabled ? stats_now() : 0;
+}
+
+/**
+ * Count the time since stats_start() against a stage
+ *
+ * \param stage  Stage the work was part of
+ * \param start  What stats_start() returned
+ */
+static inline void stats_end(enum stats_stage stage, uint64_t start)
+{
+	if (!stats.enabled)
+		return;
+
+	__sync_fetch_and_add(&stats.time[stage], stats_now() - start);
+	__sync_fetch_and_add(&stats.calls[stage], 1);
+}
+
+/** Add to one of the counters, such as stats.bytes */
+static inline void stats_count(uint64_t *counter, uint64_t n)
+{
+	if (stats.enabled)
+		__sync_fetch_and_add(counter, n);
+}
+
+#endif
+
+/**
+ * Start counting, if asked
+ *
+ * \param enable    Whether to count
+ * \param progress  Seconds between progress lines, or 0 for none
+ */
+void stats_init(bool enable, int progress);
+
+/**
+ * Sample the depth of the pipeline's queues
+ *
+ * May be called from any thread, such as those of the inputs being done
+ * at once in batch mode.
+ *
+ * \param compare  Frames waiting to be compared
+ * \param write    Frames waiting to be written
+ */
+void stats_queues(int compare, int write);
+
+/**
+ * Write a progress line, as JSON, to stderr if one is due
+ *
+ * May be called from any thread.
+ */
+void stats_progress(void);
+
+/** Report the statistics, and write a last progress line if asked */
+void stats_report(void);
+
+#endif
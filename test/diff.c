@@ -0,0 +1,357 @@
+/*
+ * Copyright (c) 2014 Codethink Ltd. (http://www.codethink.co.uk)
+ *
+ * This file is part of ebb
+ *
+ * ebb is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * ebb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Difference kernel tests
+ *
+ * Checks that every set of vector kernels the CPU can run gives exactly
+ * the same masks and neighbourhood results as the scalar kernels, so
+ * frames are kept or dropped the same whichever is picked.  Rows are
+ * random, or have differences at the tolerance and either side of it,
+ * and are every width up to a few vectors, so the scalar tails get
+ * checked too.  Each neighbourhood size and vote count is also checked
+ * against a plain count of the marked pixels.
+ *
+ * The kernels are static, so diff.c is built into the test, which lets it
+ * try the SSE2 kernels on a CPU that would get AVX2.
+ *
+ * Usage: diff
+ */
+
+#include <limits.h>
+#include <stdio.h>
+
+#include "../src/diff.c"
+
+/** Widest row tested (px), which covers a few blocks of every kernel */
+#define MAX_W 300
+
+/** Times each random test is repeated */
+#define ROUNDS 10
+
+/** A set of kernels to check against the scalar ones */
+struct kernel_set {
+	struct diff_kernels k;
+	bool usable;			/**< Whether the CPU can run them */
+};
+
+static struct diff_kernels scalar = {
+	"scalar", mask_rgb24_c, mask_8_c, mask_16_c, rows_c
+};
+
+static struct kernel_set sets[] = {
+#ifdef DIFF_X86
+	{ { "sse2", mask_rgb24_sse2, mask_8_sse2, mask_16_sse2, rows_sse2 },
+			false },
+	{ { "avx2", mask_rgb24_avx2, mask_8_avx2, mask_16_avx2, rows_avx2 },
+			false },
+#endif
+#ifdef DIFF_NEON
+	{ { "neon", mask_rgb24_neon, mask_8_neon, mask_16_neon, rows_neon },
+			true },
+#endif
+	{ { NULL, NULL, NULL, NULL, NULL }, false }
+};
+
+static int failures;
+
+
+/** Report a kernel giving a different result to the scalar one */
+static void fail(const char *set, const char *kernel, int n, int tolerance)
+{
+	if (failures++ < 20)
+		printf("FAIL: %s %s differs from scalar, n %i, tolerance %i\n",
+				set, kernel, n, tolerance);
+}
+
+
+/** Find which kernel sets this CPU can run */
+static void sets_init(void)
+{
+#ifdef DIFF_X86
+	__builtin_cpu_init();
+	sets[0].usable = __builtin_cpu_supports("sse2");
+	sets[1].usable = __builtin_cpu_supports("avx2");
+#endif
+}
+
+
+/** Random sample no bigger than max */
+static int random_sample(int max)
+{
+	return (int)(((unsigned)rand() << 8 ^ (unsigned)rand()) %
+			((unsigned)max + 1));
+}
+
+
+/**
+ * Fill two rows of samples
+ *
+ * Half the time samples are random.  Otherwise each pixel differs by
+ * the tolerance, one less or one more, spread over its samples.
+ *
+ * \param step  Samples per pixel
+ * \param max   Largest sample value
+ */
+static void rows_fill(uint16_t *prev, uint16_t *curr, int n, int step,
+		int max, int tolerance)
+{
+	bool edge = rand() & 1;
+	int x, s;
+
+	for (x = 0; x < n; x++) {
+		int d = tolerance + rand() % 3 - 1;
+
+		for (s = 0; s < step; s++) {
+			int i = x * step + s;
+			int share = (d + step - 1 - s) / step;
+
+			prev[i] = random_sample(max);
+			curr[i] = random_sample(max);
+			if (!edge)
+				continue;
+
+			if (share < 0)
+				share = 0;
+			if (share > max)
+				share = max;
+			if (prev[i] + share <= max) {
+				curr[i] = prev[i] + share;
+			} else {
+				prev[i] = max;
+				curr[i] = max - share;
+			}
+		}
+	}
+}
+
+
+/** Check a mask kernel against the scalar one */
+static void check_mask(const char *set, const char *kernel,
+		diff_row_mask_fn fn, diff_row_mask_fn ref, int step, int bytes,
+		const int *tolerances)
+{
+	const int max = (bytes == 2) ? 0xffff : 0xff;
+	static uint16_t prev16[MAX_W * 3], curr16[MAX_W * 3];
+	static uint8_t prev[MAX_W * 3 * 2], curr[MAX_W * 3 * 2];
+	static uint8_t mask[MAX_W * 3 + DIFF_MASK_PAD];
+	static uint8_t mask_ref[MAX_W * 3 + DIFF_MASK_PAD];
+	int t, n, r, i;
+
+	for (t = 0; tolerances[t] != INT_MIN; t++) {
+		for (n = 0; n <= MAX_W; n++) {
+			for (r = 0; r < ROUNDS; r++) {
+				rows_fill(prev16, curr16, n, step, max,
+						tolerances[t]);
+				for (i = 0; i < n * step; i++) {
+					if (bytes == 2) {
+						((uint16_t *)prev)[i] =
+								prev16[i];
+						((uint16_t *)curr)[i] =
+								curr16[i];
+					} else {
+						prev[i] = prev16[i];
+						curr[i] = curr16[i];
+					}
+				}
+
+				memset(mask, 0x55, sizeof(mask));
+				memset(mask_ref, 0x55, sizeof(mask_ref));
+				fn(prev, curr, mask, n, tolerances[t]);
+				ref(prev, curr, mask_ref, n, tolerances[t]);
+				if (memcmp(mask, mask_ref, n * step) != 0) {
+					fail(set, kernel, n, tolerances[t]);
+					break;
+				}
+			}
+		}
+	}
+}
+
+
+/**
+ * Fill two masks with a few marked pixels
+ *
+ * Sometimes a whole 2x2 neighbourhood is marked, anywhere in the row.
+ */
+static void masks_fill(uint8_t *mask_t, uint8_t *mask_n, int n, int step)
+{
+	int x;
+
+	memset(mask_t, 0, (n + 1) * step + DIFF_MASK_PAD);
+	memset(mask_n, 0, (n + 1) * step + DIFF_MASK_PAD);
+	for (x = 0; x <= n; x++) {
+		if (rand() % 4 == 0)
+			mask_t[x * step] = 0xff;
+		if (rand() % 4 == 0)
+			mask_n[x * step] = 0xff;
+	}
+
+	if (n > 0 && rand() % 2 == 0) {
+		x = rand() % n;
+		mask_t[x * step] = mask_t[(x + 1) * step] = 0xff;
+		mask_n[x * step] = mask_n[(x + 1) * step] = 0xff;
+	}
+}
+
+
+/** Check a rows kernel against the scalar one */
+static void check_rows(const char *set, diff_rows_fn fn)
+{
+	static uint8_t mask_t[(MAX_W + 1) * 3 + DIFF_MASK_PAD];
+	static uint8_t mask_n[(MAX_W + 1) * 3 + DIFF_MASK_PAD];
+	int step, n, r;
+
+	for (step = 1; step <= 3; step += 2) {
+		for (n = 0; n <= MAX_W; n++) {
+			for (r = 0; r < ROUNDS; r++) {
+				masks_fill(mask_t, mask_n, n, step);
+				if (fn(mask_t, mask_n, n, step) !=
+						rows_c(mask_t, mask_n, n,
+						step)) {
+					fail(set, "rows", n, -1);
+					break;
+				}
+			}
+		}
+	}
+}
+
+
+/** Find whether any neighbourhood has enough marked pixels, slowly */
+static bool window_ref(uint8_t *const *masks, int n, int step,
+		int size, int votes)
+{
+	int x, dx, r;
+
+	for (x = 0; x < n; x++) {
+		int count = 0;
+
+		for (r = 0; r < size; r++)
+			for (dx = 0; dx < size; dx++)
+				count += masks[r][(x + dx) * step] != 0;
+
+		if (count >= votes)
+			return true;
+	}
+
+	return false;
+}
+
+
+/** Check the window kernel for each neighbourhood configuration */
+static void check_windows(const char *set)
+{
+	static uint8_t rows[DIFF_MAX_SIZE][(MAX_W + DIFF_MAX_SIZE) * 3 +
+			DIFF_MASK_PAD];
+	uint8_t *masks[DIFF_MAX_SIZE];
+	int size, votes, step, n, r, x;
+
+	for (r = 0; r < DIFF_MAX_SIZE; r++)
+		masks[r] = rows[r];
+
+	for (size = 1; size <= DIFF_MAX_SIZE; size++) {
+		for (votes = 1; votes <= size * size; votes++) {
+			diff_window_fn fn = diff_window(size, votes);
+
+			for (step = 1; step <= 3; step += 2) {
+				for (n = 1; n <= MAX_W; n += 1 + n / 16) {
+					/* Mark about as many pixels as a
+					 * neighbourhood needs */
+					memset(rows, 0, sizeof(rows));
+					for (r = 0; r < size; r++)
+						for (x = 0; x < n + size - 1;
+								x++)
+							if (rand() % (size *
+								size + 1) <
+								votes)
+								masks[r][x *
+								step] = 0xff;
+
+					if (fn(masks, n, step, size, votes) !=
+							window_ref(masks, n,
+							step, size, votes)) {
+						printf("FAIL: %s window %ix%i "
+							"votes %i differs, "
+							"n %i\n",
+							set, size, size,
+							votes, n);
+						failures++;
+						break;
+					}
+				}
+			}
+		}
+	}
+}
+
+
+/** Tolerances to check, out to where each kernel gives up on vectors */
+static const int tolerances_rgb[] = {
+	-1, 0, 1, 2, 76, 229, 254, 255, 256, 764, 765, 766, 0x7fff, INT_MIN
+};
+static const int tolerances_8[] = {
+	-1, 0, 1, 2, 25, 76, 253, 254, 255, 256, INT_MIN
+};
+static const int tolerances_16[] = {
+	-1, 0, 1, 2, 255, 256, 6553, 0xfffe, 0xffff, 0x10000, INT_MIN
+};
+
+
+int main(void)
+{
+	int i;
+
+	sets_init();
+	srand(1);
+
+	/* The window kernels are scalar, apart from the 2x2 one that
+	 * calls the rows kernel, so check them with each */
+	diff = scalar;
+	check_windows(scalar.name);
+
+	for (i = 0; sets[i].k.name != NULL; i++) {
+		const struct diff_kernels *k = &sets[i].k;
+
+		if (!sets[i].usable) {
+			printf("Skipping %s, which this CPU can't run\n",
+					k->name);
+			continue;
+		}
+
+		printf("Checking %s\n", k->name);
+		check_mask(k->name, "mask_rgb24", k->mask_rgb24,
+				scalar.mask_rgb24, 3, 1, tolerances_rgb);
+		check_mask(k->name, "mask_8", k->mask_8, scalar.mask_8,
+				1, 1, tolerances_8);
+		check_mask(k->name, "mask_16", k->mask_16, scalar.mask_16,
+				1, 2, tolerances_16);
+		check_rows(k->name, k->rows);
+
+		diff = *k;
+		check_windows(k->name);
+	}
+
+	if (failures > 0) {
+		printf("%i failures\n", failures);
+		return EXIT_FAILURE;
+	}
+
+	printf("All kernels match\n");
+	return EXIT_SUCCESS;
+}
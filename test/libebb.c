@@ -0,0 +1,227 @@
+/*
+ * Copyright (c) 2014 Codethink Ltd. (http://www.codethink.co.uk)
+ *
+ * This file is part of ebb
+ *
+ * ebb is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * ebb is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Library tests
+ *
+ * Pushes a made up recording through libebb: a bright box that sits
+ * still, jumps across the frame, and sits still again.  The decisions
+ * must find the jump, keep frames for the slack after each change and
+ * drop the rest, and show the last different frame in every kept one.
+ * This is done comparing natively, in RGB24 and downscaled, and with
+ * several contexts at once, one per thread.
+ *
+ * Usage: libebb
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../src/libebb.h"
+
+/** Frame dimensions (px) */
+#define W 320
+#define H 240
+
+/** Frames in the recording, and the one the box jumps at */
+#define FRAMES 40
+#define JUMP 30
+
+/** Slack (cs) that's 10 frames at 25 fps */
+#define SLACK_CS 40
+#define SLACK_FRAMES 10
+
+/** Contexts used at once */
+#define THREADS 4
+
+/** Box's size and brightness, and where it is before and after the jump */
+#define BOX 32
+#define BOX_Y 100
+#define BOX_LUMA 235
+#define BOX_X_BEFORE 40
+#define BOX_X_AFTER 200
+
+/** A run of the recording through one context */
+struct run {
+	const char *name;		/**< What's being tested */
+	struct ebb_settings s;		/**< Settings to open with */
+	struct ebb_decision d[FRAMES];	/**< Decisions, as they came */
+	bool box_after[FRAMES];		/**< Whether kept frames showed the
+					 *   box where it jumped to */
+	int decisions;			/**< Number of decisions */
+	int failures;			/**< Number of things that went wrong */
+};
+
+
+/** Report something a run got wrong */
+static void fail(struct run *r, int frame, const char *what)
+{
+	if (r->failures++ < 20)
+		printf("FAIL: %s frame %i: %s\n", r->name, frame, what);
+}
+
+
+/** Draw a frame of the recording, with the box at x */
+static void draw(AVFrame *f, int box_x, int noise)
+{
+	int y;
+
+	for (y = 0; y < H; y++)
+		memset(f->data[0] + y * f->linesize[0], 16, W);
+	for (y = 0; y < H / 2; y++) {
+		memset(f->data[1] + y * f->linesize[1], 128, W / 2);
+		memset(f->data[2] + y * f->linesize[2], 128, W / 2);
+	}
+	for (y = BOX_Y; y < BOX_Y + BOX; y++)
+		memset(f->data[0] + y * f->linesize[0] + box_x, BOX_LUMA,
+				BOX);
+
+	/* A change of one level of one pixel is well below the tolerance */
+	f->data[0][(H / 2) * f->linesize[0] + W / 2] += noise;
+}
+
+
+/** Note a decision, and what the frame it shows looks like */
+static void decided(void *ctx, const struct ebb_decision *d)
+{
+	struct run *r = ctx;
+	const AVFrame *f = d->frame;
+
+	if (r->decisions == FRAMES) {
+		fail(r, d->index, "too many decisions");
+		return;
+	}
+
+	r->d[r->decisions] = *d;
+	r->box_after[r->decisions] = f != NULL &&
+			f->data[0][(BOX_Y + BOX / 2) * f->linesize[0] +
+			BOX_X_AFTER + BOX / 2] == BOX_LUMA;
+	r->decisions++;
+}
+
+
+/** Push the recording through a context, and check the decisions */
+static void *run_recording(void *data)
+{
+	struct run *r = data;
+	AVFrame *frame = frame_alloc(PIX_FMT_YUV420P, W, H);
+	AVFrame *small = frame_alloc(PIX_FMT_YUV420P, W / 2, H / 2);
+	struct ebb *e = NULL;
+	int i;
+
+	if (frame == NULL || small == NULL) {
+		fail(r, 0, "could not allocate frames");
+		goto free;
+	}
+
+	e = ebb_open(&r->s, PIX_FMT_YUV420P, W, H, (AVRational){ 25, 1 },
+			decided, r);
+	if (e == NULL) {
+		fail(r, 0, "could not open context");
+		goto free;
+	}
+
+	for (i = 0; i < FRAMES; i++) {
+		draw(frame, i < JUMP ? BOX_X_BEFORE : BOX_X_AFTER, i & 1);
+		if (!ebb_push(e, frame, i * 100))
+			fail(r, i, "frame not taken");
+	}
+
+	/* A frame of the wrong size must be turned away */
+	if (ebb_push(e, small, FRAMES * 100))
+		fail(r, FRAMES, "frame of the wrong size taken");
+
+	if (r->decisions != FRAMES) {
+		fail(r, r->decisions, "decisions missing");
+		goto free;
+	}
+
+	for (i = 0; i < FRAMES; i++) {
+		const struct ebb_decision *d = &r->d[i];
+		const int since = i < JUMP ? i : i - JUMP;
+
+		if (d->index != i || d->pts != i * 100)
+			fail(r, i, "wrong index or timestamp");
+		if (d->different != (i == 0 || i == JUMP))
+			fail(r, i, d->different ? "found different" :
+					"not found different");
+		if (d->keep != (since <= SLACK_FRAMES))
+			fail(r, i, d->keep ? "kept" : "dropped");
+		if (d->keep != (d->frame != NULL))
+			fail(r, i, "kept without a frame, or dropped with one");
+		if (d->keep && r->box_after[i] != (i >= JUMP))
+			fail(r, i, "kept frame shows the wrong frame");
+	}
+
+	if (ebb_kept(e) != 2 * (SLACK_FRAMES + 1))
+		fail(r, FRAMES, "wrong number kept");
+
+free:
+	ebb_close(e);
+	frame_free(frame);
+	frame_free(small);
+	return NULL;
+}
+
+
+int main(void)
+{
+	static struct run runs[3 + THREADS];
+	pthread_t threads[THREADS];
+	int failures = 0;
+	int i;
+
+	for (i = 0; i < 3 + THREADS; i++) {
+		ebb_settings_init(&runs[i].s);
+		runs[i].s.slack = SLACK_CS;
+		runs[i].name = "threaded";
+	}
+	runs[0].name = "native";
+	runs[1].name = "rgb";
+	runs[1].s.compare.mode = COMPARE_RGB;
+	runs[2].name = "downscaled";
+	runs[2].s.compare.scale = 2;
+
+	for (i = 0; i < 3; i++) {
+		printf("Checking %s\n", runs[i].name);
+		run_recording(&runs[i]);
+	}
+
+	printf("Checking %i contexts at once\n", THREADS);
+	for (i = 0; i < THREADS; i++) {
+		if (pthread_create(&threads[i], NULL, run_recording,
+				&runs[3 + i]) != 0) {
+			printf("FAIL: could not start thread\n");
+			return EXIT_FAILURE;
+		}
+	}
+	for (i = 0; i < THREADS; i++)
+		pthread_join(threads[i], NULL);
+
+	for (i = 0; i < 3 + THREADS; i++)
+		failures += runs[i].failures;
+	if (failures > 0) {
+		printf("%i failures\n", failures);
+		return EXIT_FAILURE;
+	}
+
+	printf("All decisions match\n");
+	return EXIT_SUCCESS;
+}